@@ -50,68 +50,6 @@ Atom::Atom(const std::string & value): Atom() {
   setSymbol(value);
 }
 
-//complex added to the copy constructor
-Atom::Atom(const Atom & x): Atom(){
-  if(x.isNumber()){
-	  if (m_type == SymbolKind || m_type == StringKind) {
-		  stringValue.~basic_string();
-	  }
-    setNumber(x.numberValue);
-  }
-  else if(x.isSymbol()){
-    setSymbol(x.stringValue);
-  }
-  else if (x.isComplex()) {
-	  if (m_type == SymbolKind || m_type == StringKind) {
-		  stringValue.~basic_string();
-	  }
-	setComplex(x.complexValue);
-  }
-  else if (x.m_type == StringKind) {
-	  setString(x.stringValue);
-  }
-}
-
-//complex added to the assignment opperator
-Atom & Atom::operator=(const Atom & x){
-
-  if(this != &x){
-    if(x.m_type == NoneKind){
-		if (m_type == SymbolKind || m_type == StringKind) {
-			stringValue.~basic_string();
-		}
-      m_type = NoneKind;
-    }
-    else if(x.m_type == NumberKind){
-		if (m_type == SymbolKind || m_type == StringKind) {
-			stringValue.~basic_string();
-		}
-      setNumber(x.numberValue);
-    }
-    else if(x.m_type == SymbolKind){
-      setSymbol(x.stringValue);
-    }
-	else if (x.m_type == ComplexKind) {
-		if (m_type == SymbolKind || m_type == StringKind) {
-			stringValue.~basic_string();
-		}
-		setComplex(x.complexValue);
-	}
-	else if (x.m_type == StringKind) {
-		setString(x.stringValue);
-	}
-  }
-  return *this;
-}
-  
-Atom::~Atom(){
-
-  // we need to ensure the destructor of the symbol string is called
-  if(m_type == SymbolKind || m_type == StringKind){
-    stringValue.~basic_string();
-  }
-}
-
 bool Atom::isNone() const noexcept{
   return m_type == NoneKind;
 }
@@ -141,15 +79,8 @@ void Atom::setNumber(double value){
 
 void Atom::setSymbol(const std::string & value){
 
-  // we need to ensure the destructor of the symbol string is called
-  if(m_type == SymbolKind || m_type == StringKind){
-    stringValue.~basic_string();
-  }
-    
   m_type = SymbolKind;
-
-  // copy construct in place
-  new (&stringValue) std::string(value);
+  symbolValue = intern(value);
 }
 
 void Atom::setComplex(const complex<double> value) {
@@ -159,12 +90,8 @@ void Atom::setComplex(const complex<double> value) {
 
 void Atom::setString(const std::string & value) {
 
-	// we need to ensure the destructor of the symbol string is called
-	setSymbol(value);
-
 	m_type = StringKind;
-
-	// copy construct in place
+	symbolValue = intern(value);
 }
 
 double Atom::asNumber() const noexcept{
@@ -178,7 +105,7 @@ std::string Atom::asSymbol() const noexcept{
   std::string result;
 
   if(m_type == SymbolKind){
-    result = stringValue;
+    result = symbolName(symbolValue);
   }
 
   return result;
@@ -194,12 +121,17 @@ std::string Atom::asString() const noexcept {
 	std::string result;
 
 	if (m_type == StringKind) {
-		result = stringValue;
+		result = symbolName(symbolValue);
 	}
 
 	return result;
 }
 
+SymbolId Atom::symbolId() const noexcept {
+
+	return (m_type == SymbolKind || m_type == StringKind) ? symbolValue : 0;
+}
+
 void Atom::setString()
 {
 	m_type = StringKind;
@@ -227,7 +159,7 @@ bool Atom::operator==(const Atom & right) const noexcept{
     {
       if(right.m_type != SymbolKind) return false;
 
-      return stringValue == right.stringValue;
+      return symbolValue == right.symbolValue;
     }
     break;
 	//added the case for ComplexKind
@@ -251,7 +183,7 @@ bool Atom::operator==(const Atom & right) const noexcept{
   {
 	  if (right.m_type != StringKind) return false;
 
-	  return stringValue == right.stringValue;
+	  return symbolValue == right.symbolValue;
   }
   break;
   default:
@@ -276,14 +208,14 @@ std::ostream & operator<<(std::ostream & out, const Atom & a){
     out << a.asNumber();
   }
   if(a.isSymbol()){
-    out << a.asSymbol();
+    out << symbolName(a.symbolId());
   }
   //added the case for complex
   if (a.isComplex()) {
 	  out << a.asComplex();
   }
   if (a.isString()) {
-	  out << a.asString();
+	  out << symbolName(a.symbolId());
   }
 
   return out;
@@ -6,6 +6,7 @@ Defines the Atom type and associated functions.
 #define ATOM_HPP
 
 #include "token.hpp"
+#include "symbol.hpp"
 //#include "expression.hpp"
 #include <map>
 #include <complex>
@@ -14,7 +15,8 @@ using std::complex;
 /*! \class Atom
 \brief A variant type that may be a Number or Symbol or the default type None.
 
-This class provides value semantics.
+This class provides value semantics. Symbols and Strings hold an interned
+SymbolId, so an Atom is trivially copyable and compares as integers.
 */
 class Atom {
 public:
@@ -34,15 +36,6 @@ public:
   /// Construct an Atom directly from a Token
   Atom(const Token & token);
 
-  /// Copy-construct an Atom
-  Atom(const Atom & x);
-
-  /// Assign an Atom
-  Atom & operator=(const Atom & x);
-
-  /// Atom destructor
-  ~Atom();
-
   /// predicate to determine if an Atom is of type None
   bool isNone() const noexcept;
 
@@ -67,6 +60,9 @@ public:
 
   void setString();
 
+  /// interned id of a Symbol or String, returns 0 (the empty spelling) otherwise
+  SymbolId symbolId() const noexcept;
+
   ///value of Atom as a number, returns 0,0 if not a Complex
   complex<double> asComplex() const noexcept;
 
@@ -82,11 +78,10 @@ private:
   // track the type
   Type m_type;
 
-  // values for the known types. Note the use of a union requires care
-  // when setting non POD values (see setSymbol)
+  // values for the known types, symbols and strings share the interned id
   union {
     double numberValue;
-    std::string stringValue;
+    SymbolId symbolValue;
 	complex<double> complexValue;
   };
 
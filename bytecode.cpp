@@ -0,0 +1,193 @@
+#include "bytecode.hpp"
+
+#include <iterator>
+#include <string>
+
+#include "semantic_error.hpp"
+
+std::size_t Chunk::emit(OpCode op, std::uint32_t operand, std::uint32_t count){
+  code.push_back(Instruction{op, operand, count});
+  return code.size() - 1;
+}
+
+/***********************************************************************
+Compiler
+**********************************************************************/
+
+namespace {
+
+std::uint32_t addNode(Chunk & chunk, const Expression & exp){
+  chunk.nodes.push_back(exp);
+  return static_cast<std::uint32_t>(chunk.nodes.size() - 1);
+}
+
+void emitFallback(Chunk & chunk, const Expression & exp){
+  chunk.emit(OpCode::EVAL_NODE, addNode(chunk, exp));
+}
+
+void compileNode(Chunk & chunk, const Expression & exp, const Environment & env){
+
+  const Atom & head = exp.head();
+  const ExpressionList & tail = exp.rTail();
+
+  Expression::Dispatch dispatch = exp.dispatch();
+
+  // a list folded by fold_constants is a value
+  if(exp.isLList()){
+    chunk.constants.push_back(exp);
+    chunk.emit(OpCode::PUSH_CONST, static_cast<std::uint32_t>(chunk.constants.size() - 1));
+    return;
+  }
+
+  if(dispatch == Expression::Dispatch::List){
+    for(auto & e : tail){
+      compileNode(chunk, e, env);
+    }
+    chunk.emit(OpCode::MAKE_LIST, 0, static_cast<std::uint32_t>(tail.size()));
+    return;
+  }
+
+  // terminal expressions
+  if(dispatch == Expression::Dispatch::Terminal){
+    if(head.isNumber() || head.isComplex()){
+      chunk.constants.push_back(Expression(head));
+      chunk.emit(OpCode::PUSH_CONST, static_cast<std::uint32_t>(chunk.constants.size() - 1));
+    }
+    else if(head.isString()){
+      chunk.constants.push_back(exp);
+      chunk.emit(OpCode::PUSH_CONST, static_cast<std::uint32_t>(chunk.constants.size() - 1));
+    }
+    else if(head.isSymbol()){
+      chunk.symbols.push_back(head);
+      chunk.emit(OpCode::LOOKUP, static_cast<std::uint32_t>(chunk.symbols.size() - 1));
+    }
+    else{
+      // let the tree walker report the invalid terminal
+      emitFallback(chunk, exp);
+    }
+    return;
+  }
+
+  if(dispatch == Expression::Dispatch::Begin){
+    for(std::size_t i = 0; i < tail.size(); ++i){
+      if(i != 0){
+        chunk.emit(OpCode::POP);
+      }
+      compileNode(chunk, tail[i], env);
+    }
+  }
+  else if(dispatch == Expression::Dispatch::Define){
+    // malformed defines are reported by the tree walker before evaluation
+    if((tail.size() != 2) || !tail[0].isHeadSymbol() ||
+       (tail[0].head().asSymbol() == "define") || (tail[0].head().asSymbol() == "begin")){
+      emitFallback(chunk, exp);
+      return;
+    }
+    compileNode(chunk, tail[1], env);
+    chunk.emit(OpCode::DEFINE, addNode(chunk, exp));
+  }
+  else if((dispatch != Expression::Dispatch::Call) || !env.find_proc(head)){
+    // user lambdas and special forms are evaluated by the tree walker
+    emitFallback(chunk, exp);
+  }
+  else{
+    for(auto & e : tail){
+      compileNode(chunk, e, env);
+    }
+    chunk.procs.push_back(env.find_builtin(head));
+    chunk.emit(OpCode::CALL_PROC, static_cast<std::uint32_t>(chunk.procs.size() - 1),
+	       static_cast<std::uint32_t>(tail.size()));
+  }
+}
+
+}
+
+Chunk compile(const Expression & ast, const Environment & env){
+
+  Chunk chunk;
+  compileNode(chunk, ast, env);
+  chunk.emit(OpCode::RETURN);
+  return chunk;
+}
+
+/***********************************************************************
+Virtual Machine
+**********************************************************************/
+
+Expression VirtualMachine::run(Chunk & chunk, Environment & env){
+
+  stack.clear();
+
+  for(std::size_t pc = 0; pc < chunk.code.size(); ++pc){
+
+    if(interupt == true){
+      interupt = false;
+      throw SemanticError("Error: interpreter kernel interrupted");
+    }
+
+    const Instruction & ins = chunk.code[pc];
+    switch(ins.op){
+    case OpCode::PUSH_CONST:
+      stack.push_back(chunk.constants[ins.operand]);
+      break;
+    case OpCode::LOOKUP:
+      {
+	// same resolution order as a terminal in Expression::eval
+	const Expression * value = env.value_at(env.value_key(chunk.symbols[ins.operand]));
+	if(!value){
+	  throw SemanticError("Error during evaluation: unknown symbol");
+	}
+	stack.push_back(*value);
+      }
+      break;
+    case OpCode::MAKE_LIST:
+      {
+	Expression result;
+	result.setLList(true);
+	if(ins.count == 0){
+	  result.rTail().push_back(Atom(""));
+	}
+	else{
+	  auto first = stack.end() - ins.count;
+	  result.rTail().assign(std::make_move_iterator(first), std::make_move_iterator(stack.end()));
+	  stack.erase(first, stack.end());
+	  result.rTail().pack();
+	}
+	stack.push_back(std::move(result));
+      }
+      break;
+    case OpCode::CALL_PROC:
+      {
+	// the arguments are the top count values, passed in place
+	const Builtin * builtin = chunk.procs[ins.operand];
+	std::size_t base = stack.size() - ins.count;
+	Expression result;
+	if((ins.count == 1) && builtin->unary){
+	  result = builtin->unary(stack[base]);
+	}
+	else if((ins.count == 2) && builtin->binary){
+	  result = builtin->binary(stack[base], stack[base + 1]);
+	}
+	else{
+	  result = builtin->proc(Arguments(stack.data() + base, ins.count));
+	}
+	stack.erase(stack.begin() + base, stack.end());
+	stack.push_back(std::move(result));
+      }
+      break;
+    case OpCode::DEFINE:
+      stack.back() = chunk.nodes[ins.operand].bind_define(env, stack.back());
+      break;
+    case OpCode::POP:
+      stack.pop_back();
+      break;
+    case OpCode::EVAL_NODE:
+      stack.push_back(chunk.nodes[ins.operand].eval(env));
+      break;
+    case OpCode::RETURN:
+      return stack.empty() ? Expression() : std::move(stack.back());
+    }
+  }
+
+  return Expression();
+}
@@ -0,0 +1,93 @@
+/*! \file bytecode.hpp
+Defines the bytecode representation of a parsed Expression, the compiler
+that produces it and the stack machine that executes it.
+
+The compiler lowers the common, hot parts of a program (literals, symbol
+lookups, begin, define, list and calls to built-in procedures) into a flat
+instruction sequence. Any other node (lambda, map, apply, plots, ...) is kept
+as an Expression and handed back to the tree walker through an EVAL_NODE
+instruction, so the results are always identical to Expression::eval.
+ */
+
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+// system includes
+#include <cstdint>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+#include "expression.hpp"
+#include "environment.hpp"
+
+/*! \enum OpCode
+\brief The instruction set of the stack machine.
+ */
+enum class OpCode : std::uint8_t {
+  PUSH_CONST, ///< push constants[operand]
+  LOOKUP,     ///< push the value of the symbol symbols[operand]
+  MAKE_LIST,  ///< pop count values and push them as a list
+  CALL_PROC,  ///< pop count values and push procs[operand](values)
+  DEFINE,     ///< define the symbol of nodes[operand] as the top of stack (left in place)
+  POP,        ///< discard the top of stack
+  EVAL_NODE,  ///< push nodes[operand].eval(env) using the tree walker
+  RETURN      ///< stop, the result is the top of stack
+};
+
+/*! \struct Instruction
+\brief A single instruction: an opcode, an index into one of the chunk tables
+and an argument count (only used by MAKE_LIST and CALL_PROC).
+ */
+struct Instruction {
+  OpCode op;
+  std::uint32_t operand;
+  std::uint32_t count;
+};
+
+/*! \class Chunk
+\brief The compiled form of one program.
+
+The chunk owns the instruction stream and the side tables the instructions
+index into.
+ */
+class Chunk {
+public:
+  std::vector<Instruction> code;
+  std::vector<Expression> constants;
+  std::vector<Atom> symbols;
+  std::vector<const Builtin *> procs;
+  std::vector<Expression> nodes;
+
+  /// emit an instruction, returning its position in the code
+  std::size_t emit(OpCode op, std::uint32_t operand = 0, std::uint32_t count = 0);
+};
+
+/*! \fn compile
+\brief compile a parsed Expression into a Chunk.
+
+\param ast the expression to compile
+\param env the environment, used to resolve built-in procedures
+\return the compiled chunk, always terminated by a RETURN
+ */
+Chunk compile(const Expression & ast, const Environment & env);
+
+/*! \class VirtualMachine
+\brief A stack machine that executes a Chunk against an Environment.
+ */
+class VirtualMachine {
+public:
+
+  /*! Run a chunk to completion.
+    \param chunk the compiled program
+    \param env the environment to evaluate in
+    \return the result of the program
+    \throws SemanticError when a semantic error is encountered
+   */
+  Expression run(Chunk & chunk, Environment & env);
+
+private:
+  std::vector<Expression> stack;
+};
+
+#endif
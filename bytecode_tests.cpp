@@ -0,0 +1,116 @@
+#include "catch.hpp"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include "parse.hpp"
+#include "semantic_error.hpp"
+#include "startup_config.hpp"
+#include "test_programs.hpp"
+
+static Expression parseProgram(const std::string & program){
+  std::istringstream iss(program);
+  return parse(tokenize(iss));
+}
+
+static Expression runIn(Interpreter::Mode mode, const std::string & program){
+  Interpreter interp;
+  interp.setMode(mode);
+  parseInto(interp, program, true);
+  return interp.evaluate();
+}
+
+TEST_CASE( "Test compiling a procedure call", "[bytecode]" ) {
+
+  Environment env;
+  Chunk chunk = compile(parseProgram("(+ 1 (* 2 3))"), env);
+
+  REQUIRE(chunk.code.size() == 6);
+  REQUIRE(chunk.code[0].op == OpCode::PUSH_CONST);
+  REQUIRE(chunk.code[1].op == OpCode::PUSH_CONST);
+  REQUIRE(chunk.code[2].op == OpCode::PUSH_CONST);
+  REQUIRE(chunk.code[3].op == OpCode::CALL_PROC);
+  REQUIRE(chunk.code[3].count == 2);
+  REQUIRE(chunk.code[4].op == OpCode::CALL_PROC);
+  REQUIRE(chunk.code[5].op == OpCode::RETURN);
+
+  VirtualMachine vm;
+  REQUIRE(vm.run(chunk, env) == Expression(7.));
+}
+
+TEST_CASE( "Test compiling special forms", "[bytecode]" ) {
+
+  Environment env;
+  Chunk chunk = compile(parseProgram("(begin (define a 1) (list a 2))"), env);
+
+  REQUIRE(chunk.code[0].op == OpCode::PUSH_CONST);
+  REQUIRE(chunk.code[1].op == OpCode::DEFINE);
+  REQUIRE(chunk.code[2].op == OpCode::POP);
+  REQUIRE(chunk.code[3].op == OpCode::LOOKUP);
+  REQUIRE(chunk.code[5].op == OpCode::MAKE_LIST);
+
+  VirtualMachine vm;
+  Expression result = vm.run(chunk, env);
+  REQUIRE(result.isLList());
+  REQUIRE(result.rTail().size() == 2);
+  REQUIRE(env.get_exp(Atom("a")) == Expression(1.));
+}
+
+TEST_CASE( "Test unknown forms fall back to the tree walker", "[bytecode]" ) {
+
+  Environment env;
+  Chunk chunk = compile(parseProgram("(begin (define f (lambda (x) (* 2 x))) (f 3))"), env);
+
+  std::size_t fallbacks = 0;
+  for(auto & ins : chunk.code){
+    if(ins.op == OpCode::EVAL_NODE) ++fallbacks;
+  }
+  REQUIRE(fallbacks == 2);
+
+  VirtualMachine vm;
+  REQUIRE(vm.run(chunk, env) == Expression(6.));
+}
+
+TEST_CASE( "Test bytecode errors match the tree walker", "[bytecode]" ) {
+
+  std::vector<std::string> programs = {
+    "(+ 1 a)", "(define begin 1)", "(begin (define a 1) (define a 2))",
+    "(first 1)", "(1 2)", "(/ 1 2 3)"};
+
+  for(auto & program : programs){
+    Environment env;
+    Chunk chunk = compile(parseProgram(program), env);
+    VirtualMachine vm;
+    REQUIRE_THROWS_AS(vm.run(chunk, env), SemanticError);
+  }
+}
+
+TEST_CASE( "Test bytecode and tree walker agree", "[bytecode]" ) {
+
+  std::vector<std::string> programs = {
+    "(+ 1 2 3)",
+    "(begin (define r 10) (* pi (* r r)))",
+    "(list 1 (list 2 I) (list))",
+    "(first (rest (list 1 2 3)))",
+    "(join (append (list 1) 2) (range 0 3 1))",
+    "(begin (define f (lambda (x y) (+ x y))) (map + (list (f 1 2) (f 3 4))))",
+    "(apply + (list 1 2 3))",
+    "(get-property \"note\" (set-property \"note\" \"a point\" (make-point 0 1)))",
+    "(begin (define a \"string\") a)",
+    "(begin (define f (lambda (x) (sin x))) (continuous-plot f (list (- pi) pi)))"};
+
+  for(auto & program : programs){
+    INFO(program);
+    Expression reference = runIn(Interpreter::TreeWalk, program);
+    Expression compiled = runIn(Interpreter::Bytecode, program);
+
+    std::ostringstream ref, out;
+    ref << reference;
+    out << compiled;
+    REQUIRE(ref.str() == out.str());
+    REQUIRE(reference == compiled);
+  }
+}
@@ -32,21 +32,21 @@ void Consumer::run()
 				Expression result(t);
 				result.setError();
 				//std::cerr << "Invalid Expression. Could not parse." << std::endl;
-				resultQ->push(result);
+				resultQ->push(std::move(result));
 			}
 			else
 			{
 				try
 				{
 					Expression exp = interp.evaluate();
-					resultQ->push(exp);
+					resultQ->push(std::move(exp));
 				}
 				catch (const SemanticError & ex) {
 					std::string t = ex.what();
 					Expression result(t);
 					result.setError();
 					//std::cerr << ex.what() << std::endl;
-					resultQ->push(result);
+					resultQ->push(std::move(result));
 				}
 			}
 		}
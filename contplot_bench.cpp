@@ -0,0 +1,83 @@
+// Microbenchmark for continuous-plot. Each case plots a function through a
+// memoized copy, whose counters give the number of calls the plot makes
+// and the number of distinct x it samples; refinement that only evaluates
+// new points makes the two equal. The samples are computed on the shared
+// thread pool, so costly functions plot faster with more cores. Build with
+// optimization, e.g. -DCMAKE_BUILD_TYPE=Release, for meaningful timings.
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "memo.hpp"
+#include "semantic_error.hpp"
+#include "startup_config.hpp"
+#include "thread_pool.hpp"
+
+struct BenchCase {
+  std::string name;
+  std::string lambda;
+};
+
+// best of several runs, in milliseconds
+static double timeProgram(const std::string & program, int runs){
+  double best = 0;
+  for(int r = 0; r < runs; ++r){
+    Interpreter interp;
+    std::ifstream ifs(STARTUP_FILE);
+    interp.parseStream(ifs);
+    interp.evaluate();
+    std::istringstream iss(program);
+    if(!interp.parseStream(iss)){
+      throw SemanticError("Error: benchmark program did not parse");
+    }
+    auto start = std::chrono::steady_clock::now();
+    interp.evaluate();
+    auto stop = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if((r == 0) || (ms < best)){
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main(){
+
+  std::vector<BenchCase> cases = {
+    {"linear", "(lambda (x) (+ (* 2 x) 1))"},
+    {"sine", "(lambda (x) (sin x))"},
+    {"fast sine", "(lambda (x) (sin (* 40 x)))"},
+    {"chirp", "(lambda (x) (sin (* x x x)))"},
+    {"peak", "(lambda (x) (/ 1 (+ 0.001 (* x x))))"},
+    {"series", "(lambda (x) (do (k 1 (+ k 1)) (s 0 (+ s (/ (sin (* k x)) k))) (> k 200) s))"},
+  };
+
+  std::cout << "threads: " << ThreadPool::shared().workers() + 1 << std::endl;
+
+  std::cout << std::left << std::setw(12) << "case" << std::right
+	    << std::setw(10) << "calls" << std::setw(10) << "distinct"
+	    << std::setw(10) << "ms" << std::endl;
+
+  for(auto & c : cases){
+    std::string program = "(begin (define f " + c.lambda + ") (define g (memoize f 1000000))"
+      " (continuous-plot g (list -3 3)))";
+
+    std::size_t hits = MemoTable::totalHits();
+    std::size_t misses = MemoTable::totalMisses();
+    double ms = timeProgram(program, 1);
+    std::size_t distinct = MemoTable::totalMisses() - misses;
+    std::size_t calls = distinct + (MemoTable::totalHits() - hits);
+    ms = timeProgram(program, 5);
+
+    std::cout << std::left << std::setw(12) << c.name << std::right
+	      << std::setw(10) << calls << std::setw(10) << distinct
+	      << std::setw(10) << std::fixed << std::setprecision(2) << ms << std::endl;
+  }
+  return 0;
+}
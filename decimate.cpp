@@ -0,0 +1,113 @@
+#include "decimate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// the indices of the points in order of increasing x, points with equal x
+// keep their order
+static std::vector<std::size_t> byX(const std::vector<double> & xs){
+  std::vector<std::size_t> order(xs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){
+      return xs[a] < xs[b];
+    });
+  return order;
+}
+
+std::vector<std::size_t> lttbIndices(const std::vector<double> & xs, const std::vector<double> & ys,
+				     std::size_t target){
+
+  std::vector<std::size_t> order = byX(xs);
+  std::size_t n = order.size();
+  if(n <= target){
+    return order;
+  }
+
+  std::vector<std::size_t> kept;
+  kept.reserve(target);
+  kept.push_back(order[0]);
+  if(target >= 3){
+    // buckets of the points between the first and the last
+    double width = static_cast<double>(n - 2) / (target - 2);
+    std::size_t previous = 0;
+    for(std::size_t b = 0; b < target - 2; ++b){
+      std::size_t begin = static_cast<std::size_t>(b * width) + 1;
+      std::size_t end = std::min(static_cast<std::size_t>((b + 1) * width) + 1, n - 1);
+
+      // the mean of the next bucket, the last point after the last bucket
+      std::size_t nextBegin = end;
+      std::size_t nextEnd = (b + 3 < target) ? std::min(static_cast<std::size_t>((b + 2) * width) + 1, n - 1) : n;
+      double meanX = 0, meanY = 0;
+      for(std::size_t i = nextBegin; i < nextEnd; ++i){
+	meanX += xs[order[i]];
+	meanY += ys[order[i]];
+      }
+      meanX /= (nextEnd - nextBegin);
+      meanY /= (nextEnd - nextBegin);
+
+      double ax = xs[order[previous]];
+      double ay = ys[order[previous]];
+      std::size_t best = begin;
+      double bestArea = -1;
+      for(std::size_t i = begin; i < end; ++i){
+	// twice the area of the triangle, which compares the same
+	double area = std::fabs((ax - meanX) * (ys[order[i]] - ay) - (ax - xs[order[i]]) * (meanY - ay));
+	if(area > bestArea){
+	  bestArea = area;
+	  best = i;
+	}
+      }
+      kept.push_back(order[best]);
+      previous = best;
+    }
+  }
+  kept.push_back(order[n - 1]);
+  return kept;
+}
+
+std::vector<std::size_t> minMaxIndices(const std::vector<double> & xs, const std::vector<double> & ys,
+				       std::size_t target){
+
+  std::vector<std::size_t> order = byX(xs);
+  std::size_t n = order.size();
+  if(n <= target){
+    return order;
+  }
+
+  std::size_t columns = std::max<std::size_t>(target / 2, 1);
+  double low = xs[order[0]];
+  double range = xs[order[n - 1]] - low;
+
+  // the positions in order of the lowest and highest point of each column
+  const std::size_t none = n;
+  std::vector<std::size_t> lowest(columns, none), highest(columns, none);
+  for(std::size_t i = 0; i < n; ++i){
+    std::size_t point = order[i];
+    std::size_t column = 0;
+    if(range > 0){
+      column = std::min(static_cast<std::size_t>((xs[point] - low) / range * columns), columns - 1);
+    }
+    if((lowest[column] == none) || (ys[point] < ys[order[lowest[column]]])){
+      lowest[column] = i;
+    }
+    if((highest[column] == none) || (ys[point] > ys[order[highest[column]]])){
+      highest[column] = i;
+    }
+  }
+
+  std::vector<std::size_t> kept;
+  kept.reserve(2 * columns);
+  for(std::size_t c = 0; c < columns; ++c){
+    if(lowest[c] == none){
+      continue;
+    }
+    std::size_t first = std::min(lowest[c], highest[c]);
+    std::size_t second = std::max(lowest[c], highest[c]);
+    kept.push_back(order[first]);
+    if(second != first){
+      kept.push_back(order[second]);
+    }
+  }
+  return kept;
+}
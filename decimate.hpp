@@ -0,0 +1,44 @@
+/*! \file decimate.hpp
+Defines the decimation discrete-plot uses to draw very large datasets with a
+bounded number of points.
+
+Both methods choose a subset of the points and return their indices in
+order of increasing x, the order they are drawn in. The input need not be
+sorted.
+ */
+
+#ifndef DECIMATE_HPP
+#define DECIMATE_HPP
+
+// system includes
+#include <cstddef>
+#include <vector>
+
+/*! Choose points by largest-triangle-three-buckets. The first and last
+  points are kept, the others are split into target - 2 buckets of
+  consecutive x, and from each bucket the point forming the largest
+  triangle with the point chosen before and the mean of the next bucket is
+  kept. This follows the shape of the data, peaks included.
+  \param xs the x coordinates
+  \param ys the y coordinates, as many as xs
+  \param target the most points to keep, at least 2
+  \return the indices of the points kept, all of them if there are no more
+  than target
+ */
+std::vector<std::size_t> lttbIndices(const std::vector<double> & xs, const std::vector<double> & ys,
+				     std::size_t target);
+
+/*! Choose points by min-max per column. The x range is split into target / 2
+  columns of equal width, and the lowest and the highest point of each
+  column are kept. This keeps the envelope of the data exactly, the
+  extremes of every column included.
+  \param xs the x coordinates
+  \param ys the y coordinates, as many as xs
+  \param target the most points to keep, at least 2
+  \return the indices of the points kept, all of them if there are no more
+  than target
+ */
+std::vector<std::size_t> minMaxIndices(const std::vector<double> & xs, const std::vector<double> & ys,
+				       std::size_t target);
+
+#endif
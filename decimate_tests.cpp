@@ -0,0 +1,72 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "decimate.hpp"
+
+// samples of a sine with a spike at 500
+static void spikedSine(std::vector<double> & xs, std::vector<double> & ys){
+  for(std::size_t i = 0; i < 1000; ++i){
+    xs.push_back(i * 0.01);
+    ys.push_back(std::sin(i * 0.01));
+  }
+  ys[500] = 10;
+}
+
+static bool increasingX(const std::vector<double> & xs, const std::vector<std::size_t> & kept){
+  for(std::size_t i = 1; i < kept.size(); ++i){
+    if(xs[kept[i - 1]] > xs[kept[i]]){
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST_CASE( "Test largest-triangle-three-buckets", "[decimate]" ) {
+
+  std::vector<double> xs, ys;
+  spikedSine(xs, ys);
+
+  std::vector<std::size_t> kept = lttbIndices(xs, ys, 100);
+  REQUIRE(kept.size() == 100);
+  REQUIRE(kept.front() == 0);
+  REQUIRE(kept.back() == 999);
+  REQUIRE(increasingX(xs, kept));
+  REQUIRE(std::find(kept.begin(), kept.end(), 500) != kept.end());
+
+  REQUIRE(lttbIndices(xs, ys, 2) == std::vector<std::size_t>({0, 999}));
+  REQUIRE(lttbIndices(xs, ys, 1000).size() == 1000);
+
+  INFO("the input need not be sorted");
+  std::vector<double> rx(xs.rbegin(), xs.rend()), ry(ys.rbegin(), ys.rend());
+  kept = lttbIndices(rx, ry, 100);
+  REQUIRE(kept.size() == 100);
+  REQUIRE(kept.front() == 999);
+  REQUIRE(kept.back() == 0);
+  REQUIRE(increasingX(rx, kept));
+  REQUIRE(std::find(kept.begin(), kept.end(), 499) != kept.end());
+}
+
+TEST_CASE( "Test min-max decimation", "[decimate]" ) {
+
+  std::vector<double> xs, ys;
+  spikedSine(xs, ys);
+
+  std::vector<std::size_t> kept = minMaxIndices(xs, ys, 100);
+  REQUIRE(kept.size() <= 100);
+  REQUIRE(increasingX(xs, kept));
+
+  INFO("the extremes of each column are kept");
+  auto has = [&](std::size_t i){ return std::find(kept.begin(), kept.end(), i) != kept.end(); };
+  REQUIRE(has(500));
+  REQUIRE(has(std::min_element(ys.begin(), ys.end()) - ys.begin()));
+  REQUIRE(has(0));
+  REQUIRE(has(999));
+
+  INFO("points with the same x fall in one column");
+  std::vector<double> same(10, 1.), values = {3, 1, 4, 1, 5, 9, 2, 6, 5, 3};
+  REQUIRE(minMaxIndices(same, values, 4) == std::vector<std::size_t>({1, 5}));
+  REQUIRE(minMaxIndices(same, values, 10).size() == 10);
+}
@@ -0,0 +1,64 @@
+// Microbenchmark for discrete-plot of large datasets, drawn in full and
+// decimated to a bounded number of points. The points are built before the
+// timing starts, so each row times the plot alone, and the objects column
+// is the number of graphics items it gives the output widget. Build with
+// optimization, e.g. -DCMAKE_BUILD_TYPE=Release, for meaningful timings.
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "startup_config.hpp"
+
+struct BenchCase {
+  std::string name;
+  std::string options;
+};
+
+// evaluates program after the startup file
+static Expression evaluate(Interpreter & interp, const std::string & program){
+  std::istringstream iss(program);
+  if(!interp.parseStream(iss)){
+    throw SemanticError("Error: benchmark program did not parse");
+  }
+  return interp.evaluate();
+}
+
+int main(){
+
+  std::vector<BenchCase> cases = {
+    {"full", "(list)"},
+    {"lttb", "(list (list \"max-points\" 2000))"},
+    {"min-max", "(list (list \"max-points\" 2000) (list \"decimation\" \"min-max\"))"},
+  };
+
+  std::cout << std::left << std::setw(10) << "points" << std::setw(10) << "case" << std::right
+	    << std::setw(10) << "objects" << std::setw(10) << "ms" << std::endl;
+
+  for(int points : {10000, 100000, 300000}){
+    Interpreter interp;
+    std::ifstream ifs(STARTUP_FILE);
+    interp.parseStream(ifs);
+    interp.evaluate();
+    evaluate(interp, "(begin (define f (lambda (x) (list x (+ (sin x) (* 0.1 (sin (* 50 x)))))))"
+	     " (define data (map f (range 0 100 " + std::to_string(100.0 / points) + "))))");
+
+    for(auto & c : cases){
+      auto start = std::chrono::steady_clock::now();
+      Expression plot = evaluate(interp, "(discrete-plot data " + c.options + ")");
+      auto stop = std::chrono::steady_clock::now();
+      double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+
+      std::cout << std::left << std::setw(10) << points << std::setw(10) << c.name << std::right
+		<< std::setw(10) << plot.rTail().size()
+		<< std::setw(10) << std::fixed << std::setprecision(2) << ms << std::endl;
+    }
+  }
+  return 0;
+}
@@ -1,9 +1,14 @@
 #include "environment.hpp"
 
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <functional>
+#include <type_traits>
 
 #include "environment.hpp"
+#include "kernels.hpp"
+#include "memo.hpp"
 #include "semantic_error.hpp"
 
 /*********************************************************************** 
@@ -11,203 +16,391 @@ Helper Functions
 **********************************************************************/
 
 // predicate, the number of args is nargs
-bool nargs_equal(const std::vector<Expression> & args, unsigned nargs){
+bool nargs_equal(Arguments args, unsigned nargs){
   return args.size() == nargs;
 }
 
 /*********************************************************************** 
-Each of the functions below have the signature that corresponds to the
-typedef'd Procedure function pointer.
+Elementwise helpers. The arithmetic and math procedures also accept lists:
+list arguments must have the same length and scalar arguments are broadcast
+over them. Packed numeric lists go through the kernels, anything else
+applies the scalar procedure to each element.
 **********************************************************************/
 
-// the default procedure always returns an expresison of type None
-Expression default_proc(const std::vector<Expression> & args){
-  args.size(); // make compiler happy we used this parameter
-  return Expression();
-};
+// predicate, at least one argument is a list
+bool has_list(Arguments args){
+  for(auto & a : args){
+    if(a.isLList()) return true;
+  }
+  return false;
+}
 
-Expression add(const std::vector<Expression> & args){
+// number of elements of a list, the empty list holds a single empty symbol.
+// Packed lists hold Numbers, checked first so a pending range stays pending.
+std::size_t list_length(const Expression & list){
+  const ExpressionList & tail = list.rTail();
+  if(tail.empty() || (!tail.packed() && tail.headAt(0).isSymbol() && (tail.headAt(0).symbolId() == 0))){
+    return 0;
+  }
+  return tail.size();
+}
 
-  // check all aruments are numbers, or complex, while adding
-  double result = 0.0;
-  bool hasImag = false;
-  complex<double> Ires(0.0, 0.0);
-  for( auto & a :args){
-    if(a.isHeadNumber()){
-      Ires = Ires + a.head().asNumber();      
-    }
-	else if (a.isHeadComplex())
-	{
-		hasImag = true;
-		Ires = Ires + a.head().asComplex();
-	}
-    else{
-      throw SemanticError("Error in call to add, argument not a number or a complex number");
+// the common length of the list arguments
+std::size_t common_length(Arguments args, const std::string & name){
+  bool found = false;
+  std::size_t n = 0;
+  for(auto & a : args){
+    if(a.isLList()){
+      std::size_t length = list_length(a);
+      if(found && (length != n)){
+	throw SemanticError("Error in call to " + name + ": list arguments of different lengths.");
+      }
+      found = true;
+      n = length;
     }
   }
-  if (!hasImag)
-  {
-	  result = Ires.real();
-	  return Expression(result);
+  return n;
+}
+
+// wrap a kernel result as a packed list
+template<typename T>
+Expression packed_list(const std::vector<T> & values){
+  Expression result;
+  result.rTail() = ExpressionList(values);
+  result.setLList(true);
+  return result;
+}
+
+// apply the scalar procedure to each element, used for arguments that are
+// not packed (nested lists, mixed kinds, ...) and outside the kernel domains
+Expression elementwise(Arguments args, Procedure scalar, const std::string & name){
+  std::size_t n = common_length(args, name);
+  Expression result;
+  result.setLList(true);
+  if(n == 0){
+    result.rTail().push_back(Atom(""));
+    return result;
   }
-  else
-  {
-	  return Expression(Ires);
+  result.rTail().reserve(n);
+  std::vector<Expression> elements(args.size());
+  for(std::size_t i = 0; i < n; ++i){
+    for(std::size_t j = 0; j < args.size(); ++j){
+      if(!args[j].isLList()){
+	elements[j] = args[j];
+      }
+      else if(args[j].rTail().packed()){
+	elements[j] = Expression(args[j].rTail().headAt(i));
+      }
+      else{
+	elements[j] = args[j].rTail()[i];
+      }
+    }
+    result.rTail().push_back(scalar(elements));
   }
-};
-
+  result.rTail().pack();
+  return result;
+}
 
-Expression mul(const std::vector<Expression> & args){
- 
-  // check all aruments are numbers, or complex, while multiplying
-	double result = 1.0;
-	bool hasImag = false;
-	complex<double> Ires(1.0, 0.0);
-  for( auto & a :args){
-    if(a.isHeadNumber()){
-      Ires = Ires * a.head().asNumber();      
+// the kernel operands of the arguments, false if an argument is neither a
+// packed list nor a Number or Complex. Broadcast scalars point into reals
+// and complexes.
+bool packed_operands(Arguments args, std::vector<Operand> & ops,
+		     std::vector<double> & reals, std::vector<complex<double>> & complexes,
+		     bool & anyComplex){
+  anyComplex = false;
+  reals.resize(args.size());
+  complexes.resize(args.size());
+  for(std::size_t j = 0; j < args.size(); ++j){
+    const Expression & a = args[j];
+    if(a.isLList() && a.rTail().reals()){
+      ops.push_back(realOperand(a.rTail().reals()));
+    }
+    else if(a.isLList() && a.rTail().complexes()){
+      anyComplex = true;
+      ops.push_back(complexOperand(a.rTail().complexes()));
+    }
+    else if(a.isHeadNumber() && !a.isLList()){
+      reals[j] = a.head().asNumber();
+      ops.push_back(realOperand(&reals[j], true));
+    }
+    else if(a.isHeadComplex() && !a.isLList()){
+      anyComplex = true;
+      complexes[j] = a.head().asComplex();
+      ops.push_back(complexOperand(&complexes[j], true));
     }
-	else if (a.isHeadComplex()) {
-		hasImag = true;
-		Ires = Ires * a.head().asComplex();
-	}
     else{
-      throw SemanticError("Error in call to mul, argument not a number or a complex");
+      return false;
     }
   }
-  if (!hasImag)
-  {
-	  result = Ires.real();
-	  return Expression(result);
+  return true;
+}
+
+// n-ary add and mul over lists, folding from the identity like the scalar versions
+Expression fold_lists(Arguments args, BinaryOp op, double identity,
+		      Procedure scalar, const std::string & name){
+  std::size_t n = common_length(args, name);
+  std::vector<Operand> ops;
+  std::vector<double> reals;
+  std::vector<complex<double>> complexes;
+  bool anyComplex;
+  if((n == 0) || !packed_operands(args, ops, reals, complexes, anyComplex)){
+    return elementwise(args, scalar, name);
   }
-  else
-  {
-	  return Expression(Ires);
+  if(!anyComplex){
+    std::vector<double> out(n);
+    Operand acc = realOperand(&identity, true);
+    for(auto & o : ops){
+      realBinary(op, acc, o, out.data(), n);
+      acc = realOperand(out.data());
+    }
+    return packed_list(out);
   }
-  
-};
+  std::vector<complex<double>> out(n);
+  complex<double> start(identity, 0.0);
+  Operand acc = complexOperand(&start, true);
+  for(auto & o : ops){
+    complexBinary(op, acc, o, out.data(), n);
+    acc = complexOperand(out.data());
+  }
+  return packed_list(out);
+}
 
-Expression subneg(const std::vector<Expression> & args){
-	//returns a number, or complex, * -1 if one argument is given
-	//else return argument[0] - argument[1] for any combinmation of numbers or complex numbers
-  double result = 0.0;
-  bool hasImag = false;
-  complex<double> Ires(0.0,0.0);
+// binary subtraction, division and power over lists
+Expression binary_lists(Arguments args, BinaryOp op,
+			Procedure scalar, const std::string & name){
+  std::size_t n = common_length(args, name);
+  std::vector<Operand> ops;
+  std::vector<double> reals;
+  std::vector<complex<double>> complexes;
+  bool anyComplex;
+  if((n == 0) || (args.size() != 2) || !packed_operands(args, ops, reals, complexes, anyComplex)){
+    return elementwise(args, scalar, name);
+  }
+  if(!anyComplex){
+    std::vector<double> out(n);
+    realBinary(op, ops[0], ops[1], out.data(), n);
+    return packed_list(out);
+  }
+  std::vector<complex<double>> out(n);
+  complexBinary(op, ops[0], ops[1], out.data(), n);
+  return packed_list(out);
+}
 
-  // preconditions
-  if(nargs_equal(args,1)){
-    if(args[0].isHeadNumber()){
-      Ires = -args[0].head().asNumber();
+// one argument procedures over a list
+Expression unary_lists(Arguments args, UnaryOp op,
+		       Procedure scalar, const std::string & name){
+  if(args.size() == 1){
+    const ExpressionList & tail = args[0].rTail();
+    std::size_t n = tail.size();
+    if(tail.reals() && realDomain(op, tail.reals(), n)){
+      std::vector<double> out(n);
+      realUnary(op, tail.reals(), out.data(), n);
+      return packed_list(out);
     }
-	else if (args[0].isHeadComplex()) {
-		hasImag = true;
-		Ires = -args[0].head().asComplex();
-	}
-    else{
-      throw SemanticError("Error in call to negate: invalid argument.");
+    if(tail.complexes() && complexDomain(op)){
+      std::vector<complex<double>> out(n);
+      complexUnary(op, tail.complexes(), out.data(), n);
+      return packed_list(out);
     }
   }
-  //performs subtraction for any combination of numbers and complex numbers
-  else if(nargs_equal(args,2)){
-    if( (args[0].isHeadNumber()) && (args[1].isHeadNumber()) ){
-      Ires = args[0].head().asNumber() - args[1].head().asNumber();
-    }
-	else if ((args[0].isHeadComplex()) && (args[1].isHeadNumber()))
-	{
-		hasImag = true;
-		Ires = args[0].head().asComplex() - args[1].head().asNumber();
-	}
-	else if ((args[0].isHeadNumber()) && (args[1].isHeadComplex()))
-	{
-		hasImag = true;
-		Ires = args[0].head().asNumber() - args[1].head().asComplex();
-	}
-	else if ((args[0].isHeadComplex()) && (args[1].isHeadComplex()))
-	{
-		hasImag = true;
-		Ires = args[0].head().asComplex() - args[1].head().asComplex();
-	}
-    else{      
-      throw SemanticError("Error in call to subtraction: invalid argument.");
-    }
+  return elementwise(args, scalar, name);
+}
+
+/*********************************************************************** 
+Scalar kernels for the arithmetic procedures. The kind of each operand is
+found once per call and selects a kernel instantiated for that combination
+of double and complex<double>, so real operands never touch complex
+arithmetic. Each kernel performs exactly the operations, in the same order
+and types, that the procedures always have, so results are bit-identical.
+**********************************************************************/
+
+// the kind of a scalar operand, indexes the kernel tables
+enum ScalarKind { RealKind = 0, ComplexKind = 1, InvalidKind = 2 };
+
+ScalarKind scalar_kind(const Expression & arg){
+  return arg.isHeadNumber() ? RealKind : (arg.isHeadComplex() ? ComplexKind : InvalidKind);
+}
+
+// the value of an operand of known kind
+template <typename T> T scalar_value(const Expression & arg);
+
+template <> double scalar_value<double>(const Expression & arg){
+  return arg.head().asNumber();
+}
+
+template <> complex<double> scalar_value<complex<double>>(const Expression & arg){
+  return arg.head().asComplex();
+}
+
+// the operations, the operand types decide real or complex arithmetic
+struct Plus {
+  template <typename L, typename R>
+  static auto apply(const L & l, const R & r) -> decltype(l + r){ return l + r; }
+};
+
+struct Times {
+  template <typename L, typename R>
+  static auto apply(const L & l, const R & r) -> decltype(l * r){ return l * r; }
+};
+
+struct Minus {
+  template <typename L, typename R>
+  static auto apply(const L & l, const R & r) -> decltype(l - r){ return l - r; }
+};
+
+struct Divide {
+  template <typename L, typename R>
+  static auto apply(const L & l, const R & r) -> decltype(l / r){ return l / r; }
+};
+
+struct Power {
+  template <typename L, typename R>
+  static auto apply(const L & l, const R & r) -> decltype(std::pow(l, r)){ return std::pow(l, r); }
+};
+
+struct Negate {
+  template <typename T>
+  static T apply(const T & x){ return -x; }
+};
+
+struct Reciprocal {
+  template <typename T>
+  static T apply(const T & x){ return 1.0 / x; }
+};
+
+typedef Expression (*ScalarUnaryKernel)(const Expression & arg);
+typedef Expression (*ScalarBinaryKernel)(const Expression & left, const Expression & right);
+
+template <typename Op, typename T>
+Expression unary_kernel(const Expression & arg){
+  return Expression(Op::apply(scalar_value<T>(arg)));
+}
+
+template <typename Op, typename L, typename R>
+Expression binary_kernel(const Expression & left, const Expression & right){
+  return Expression(Op::apply(scalar_value<L>(left), scalar_value<R>(right)));
+}
+
+template <typename Op>
+Expression scalar_unary(const Expression & arg, const char * error){
+  static const ScalarUnaryKernel kernels[2] = {
+    unary_kernel<Op, double>, unary_kernel<Op, complex<double>>
+  };
+  ScalarKind kind = scalar_kind(arg);
+  if(kind == InvalidKind){
+    throw SemanticError(error);
   }
-  else{
-    throw SemanticError("Error in call to subtraction or negation: invalid number of arguments.");
+  return kernels[kind](arg);
+}
+
+template <typename Op>
+Expression scalar_binary(const Expression & left, const Expression & right, const char * error){
+  static const ScalarBinaryKernel kernels[2][2] = {
+    {binary_kernel<Op, double, double>, binary_kernel<Op, double, complex<double>>},
+    {binary_kernel<Op, complex<double>, double>, binary_kernel<Op, complex<double>, complex<double>>}
+  };
+  ScalarKind l = scalar_kind(left);
+  ScalarKind r = scalar_kind(right);
+  if((l == InvalidKind) || (r == InvalidKind)){
+    throw SemanticError(error);
   }
+  return kernels[l][r](left, right);
+}
 
-  if (!hasImag)
-  {
-	  result = Ires.real();
-	  return Expression(result);
+// n-ary add and mul. Without complex operands the fold is real; with any, it
+// accumulates in complex from the start, as a complex identity, exactly as
+// before, since e.g. multiplying the imaginary zero by a negative Number
+// gives -0.0 and that sign reaches the later complex products.
+template <typename Op>
+Expression scalar_fold(Arguments args, double identity, const char * error){
+  bool anyComplex = false;
+  for(auto & a : args){
+    ScalarKind kind = scalar_kind(a);
+    if(kind == InvalidKind){
+      throw SemanticError(error);
+    }
+    anyComplex = anyComplex || (kind == ComplexKind);
   }
-  else
-  {
-	  return Expression(Ires);
+  if(!anyComplex){
+    double result = identity;
+    for(auto & a : args){
+      result = Op::apply(result, a.head().asNumber());
+    }
+    return Expression(result);
+  }
+  complex<double> result(identity, 0.0);
+  for(auto & a : args){
+    if(a.isHeadNumber()){
+      result = Op::apply(result, a.head().asNumber());
+    }
+    else{
+      result = Op::apply(result, a.head().asComplex());
+    }
   }
+  return Expression(result);
+}
+
+/*********************************************************************** 
+Each of the functions below have the signature that corresponds to the
+typedef'd Procedure function pointer.
+**********************************************************************/
+
+// the default procedure always returns an expresison of type None
+Expression default_proc(Arguments args){
+  args.size(); // make compiler happy we used this parameter
+  return Expression();
 };
 
-Expression div(const std::vector<Expression> & args){
-	//performs division for any combnation of complex numbers and numbers
-	//at least two numbers/complex are requred or an error is thown
-	double result = 0.0;
-	bool hasImag = false;
-	complex<double> Ires(0.0, 0.0);
+Expression add(Arguments args){
+  if(has_list(args)) return fold_lists(args, BinaryOp::Add, 0.0, add, "add");
 
+  // check all aruments are numbers, or complex, then add
+  return scalar_fold<Plus>(args, 0.0, "Error in call to add, argument not a number or a complex number");
+};
 
-  if(nargs_equal(args,2)){
-    if( (args[0].isHeadNumber()) && (args[1].isHeadNumber()) ){
-      result = args[0].head().asNumber() / args[1].head().asNumber();
-    }
-	else if ((args[0].isHeadComplex()) && (args[1].isHeadNumber()))
-	{
-		hasImag = true;
-		Ires = args[0].head().asComplex() / args[1].head().asNumber();
-	}
-	else if ((args[0].isHeadNumber()) && (args[1].isHeadComplex()))
-	{
-		hasImag = true;
-		Ires = args[0].head().asNumber() / args[1].head().asComplex();
-	}
-	else if ((args[0].isHeadComplex()) && (args[1].isHeadComplex()))
-	{
-		hasImag = true;
-		Ires = args[0].head().asComplex() / args[1].head().asComplex();
-	}
-    else{      
-      throw SemanticError("Error in call to division: invalid argument.");
-    }
+
+Expression mul(Arguments args){
+  if(has_list(args)) return fold_lists(args, BinaryOp::Mul, 1.0, mul, "mul");
+ 
+  // check all aruments are numbers, or complex, then multiply
+  return scalar_fold<Times>(args, 1.0, "Error in call to mul, argument not a number or a complex");
+};
+
+Expression subneg(Arguments args){
+  if(has_list(args)){
+    return (args.size() == 1) ? unary_lists(args, UnaryOp::Neg, subneg, "negate") :
+      binary_lists(args, BinaryOp::Sub, subneg, "subtraction");
   }
-  else if (nargs_equal(args, 1))
-  {
-	  if (args[0].isHeadNumber())
-	  {
-		  result = 1.0 / args[0].head().asNumber();
-	  }
-	  else if (args[0].isHeadComplex())
-	  {
-		  hasImag = true;
-		  Ires = 1.0 / args[0].head().asComplex();
-	  }
-	  else
-	  {
-		  throw SemanticError("Error in call to division: invalid argument.");
-	  }
+  //returns a number, or complex, * -1 if one argument is given
+  //else return argument[0] - argument[1] for any combinmation of numbers or complex numbers
+  if(nargs_equal(args,1)){
+    return scalar_unary<Negate>(args[0], "Error in call to negate: invalid argument.");
+  }
+  else if(nargs_equal(args,2)){
+    return scalar_binary<Minus>(args[0], args[1], "Error in call to subtraction: invalid argument.");
   }
-  else{
-    throw SemanticError("Error in call to division: invalid number of arguments.");
+  throw SemanticError("Error in call to subtraction or negation: invalid number of arguments.");
+};
+
+Expression div(Arguments args){
+  if(has_list(args)){
+    return (args.size() == 1) ? unary_lists(args, UnaryOp::Recip, div, "division") :
+      binary_lists(args, BinaryOp::Div, div, "division");
   }
-  if (!hasImag)
-  {
-	  return Expression(result);
+  //performs division for any combnation of complex numbers and numbers
+  //one argument gives the reciprocal
+  if(nargs_equal(args,2)){
+    return scalar_binary<Divide>(args[0], args[1], "Error in call to division: invalid argument.");
   }
-  else
-  {
-	  return Expression(Ires);
+  else if(nargs_equal(args, 1)){
+    return scalar_unary<Reciprocal>(args[0], "Error in call to division: invalid argument.");
   }
+  throw SemanticError("Error in call to division: invalid number of arguments.");
 };
 
-Expression sq(const std::vector<Expression> & args) {
+Expression sq(Arguments args) {
 	//performs sqrt on numbers and complex values. returns a complex value if the input is complex or neagtive
+	if (has_list(args)) return unary_lists(args, UnaryOp::Sqrt, sq, "sqrt");
 	double result = 0;
 	complex<double> Ires(0.0, 0.0);
 	complex<double> temp(0.0, 0.0);
@@ -247,53 +440,22 @@ Expression sq(const std::vector<Expression> & args) {
 	
 };
 
-Expression pow(const std::vector<Expression> & args) {
+Expression pow(Arguments args) {
 	//perfroms the power function on complex or real numbers as either argument returns complex if a complexnumber is
 	//used in either slot
-	double result = 0.0;
-	bool hasImag = false;
-	complex<double> Ires(0.0, 0.0);
+	if (has_list(args)) return binary_lists(args, BinaryOp::Pow, pow, "power");
 
 	if (nargs_equal(args, 2)) {
-		if ((args[0].isHeadNumber()) && (args[1].isHeadNumber())) {
-			result = std::pow(args[0].head().asNumber(), args[1].head().asNumber());
-		}
-		else if ((args[0].isHeadComplex()) && (args[1].isHeadNumber()))
-		{
-			hasImag = true;
-			Ires = std::pow(args[0].head().asComplex(), args[1].head().asNumber());
-		}
-		else if ((args[0].isHeadNumber()) && (args[1].isHeadComplex()))
-		{
-			hasImag = true;
-			Ires = std::pow(args[0].head().asNumber(), args[1].head().asComplex());
-		}
-		else if ((args[0].isHeadComplex()) && (args[1].isHeadComplex()))
-		{
-			hasImag = true;
-			Ires = std::pow(args[0].head().asComplex(), args[1].head().asComplex());
-		}
-		else {
-			throw SemanticError("Error in call to power: invalid argument.");
-		}
-	}
-	else {
-		throw SemanticError("Error in call to power: invalid number of arguments.");
-	}
-	if (!hasImag)
-	{
-		return Expression(result);
-	}
-	else
-	{
-		return Expression(Ires);
+		return scalar_binary<Power>(args[0], args[1], "Error in call to power: invalid argument.");
 	}
+	throw SemanticError("Error in call to power: invalid number of arguments.");
 };
 
-Expression logn(const std::vector<Expression> & args) {
+Expression logn(Arguments args) {
 	//performs the ln operation in real numbers
 	//thows an error in ln is called on 0 or a negative number
 	//can't be called on a complex value
+	if (has_list(args)) return unary_lists(args, UnaryOp::Log, logn, "ln");
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -320,8 +482,9 @@ Expression logn(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression sn(const std::vector<Expression> & args) {
+Expression sn(Arguments args) {
 	//performs sin on numbers. Treats the number argument as radians.
+	if (has_list(args)) return unary_lists(args, UnaryOp::Sin, sn, "sin");
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -338,8 +501,9 @@ Expression sn(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression cn(const std::vector<Expression> & args) {
+Expression cn(Arguments args) {
 	//performs cos on numbers. Treats the number argument as radians.
+	if (has_list(args)) return unary_lists(args, UnaryOp::Cos, cn, "cos");
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -356,8 +520,9 @@ Expression cn(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression tn(const std::vector<Expression> & args) {
+Expression tn(Arguments args) {
 	//performs tan on numbers. Treats the number argument as radians.
+	if (has_list(args)) return unary_lists(args, UnaryOp::Tan, tn, "tan");
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -374,7 +539,7 @@ Expression tn(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression IMreal(const std::vector<Expression> & args) {
+Expression IMreal(Arguments args) {
 	//returns the real component of a complex number. throws an error if called on more than one number.
 	//also throws an error if called on a non-complex number
 	double result = 0;
@@ -393,7 +558,7 @@ Expression IMreal(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression IMimag(const std::vector<Expression> & args) {
+Expression IMimag(Arguments args) {
 	//returns the imaginary component of a complex number. throws an error if called on more than one number.
 	//also throws an error if called on a non-complex number
 	double result = 0;
@@ -412,7 +577,7 @@ Expression IMimag(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression IMmag(const std::vector<Expression> & args) {
+Expression IMmag(Arguments args) {
 	//returns the magnitude of a complex number. throws an error if called on more than one number.
 	//also throws an error if called on a non-complex number
 	double result = 0;
@@ -431,7 +596,7 @@ Expression IMmag(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression IMarg(const std::vector<Expression> & args) {
+Expression IMarg(Arguments args) {
 	//returns the angle of a complex number. throws an error if called on more than one number.
 	//also throws an error if called on a non-complex number
 	double result = 0;
@@ -450,7 +615,7 @@ Expression IMarg(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression IMconj(const std::vector<Expression> & args) {
+Expression IMconj(Arguments args) {
 	//returns the conjugate of a complex number. throws an error if called on more than one number.
 	//also throws an error if called on a non-complex number
 	complex<double> Ires;
@@ -469,15 +634,17 @@ Expression IMconj(const std::vector<Expression> & args) {
 	return Expression(Ires);
 };
 
-Expression Lfirst(const std::vector<Expression> & args) {
+Expression Lfirst(Arguments args) {
 	Expression result;
 	if (nargs_equal(args, 1))
 	{
 		if (args[0].isLList())
 		{
-			if (!args[0].rTail()[0].head().isSymbol())
+			// the empty list holds a symbol, packed lists hold Numbers
+			if (args[0].rTail().packed() || !args[0].rTail().headAt(0).isSymbol())
 			{
-				result = args[0].rTail()[0];
+				// the element of a packed list is rebuilt from its head
+				result = args[0].rTail().packed() ? Expression(args[0].rTail().headAt(0)) : args[0].rTail()[0];
 			}
 			else
 			{
@@ -497,20 +664,18 @@ Expression Lfirst(const std::vector<Expression> & args) {
 	return result;
 };
 
-Expression Lrest(const std::vector<Expression> & args) {
+Expression Lrest(Arguments args) {
 	Expression result;
 	if (nargs_equal(args, 1))
 	{
 		if (args[0].isLList())
 		{
-			if (!args[0].rTail()[0].head().isSymbol())
+			if (args[0].rTail().packed() || !args[0].rTail().headAt(0).isSymbol())
 			{
 				result.setLList(true);
 				std::size_t listL = args[0].rTail().size();
-				for (std::size_t i = 1; i < listL; i++)
-				{
-					result.rTail().push_back(args[0].rTail()[i]);
-				}
+				// the rest shares the argument's storage
+				result.rTail() = args[0].rTail().drop(1);
 				if (listL == 1)
 				{
 					result.rTail().push_back(Atom(""));
@@ -534,20 +699,13 @@ Expression Lrest(const std::vector<Expression> & args) {
 	return result;
 };
 
-Expression Llength(const std::vector<Expression> & args) {
+Expression Llength(Arguments args) {
 	double result = 0.0;
 	if (nargs_equal(args, 1))
 	{
 		if (args[0].isLList())
 		{
-			if (!args[0].rTail()[0].isHeadSymbol())
-			{
-				result = args[0].rTail().size();
-			}
-			else
-			{
-				result = 0.0;
-			}
+			result = list_length(args[0]);
 		}
 		else
 		{
@@ -561,18 +719,109 @@ Expression Llength(const std::vector<Expression> & args) {
 	return Expression(result);
 };
 
-Expression Lappend(const std::vector<Expression> & args) {
+// the element of a list at an index, or the last element. The element is
+// read in place, packed elements are rebuilt from their Number. The element
+// of a pending range is added up the way the range generates it, without
+// generating the others.
+Expression list_element(const Expression & list, std::size_t index){
+  const ExpressionList & tail = list.rTail();
+  double num, step;
+  if(tail.pending(num, step)){
+    for(std::size_t i = 0; i < index; ++i){
+      num += step;
+    }
+    return Expression(num);
+  }
+  return tail.packed() ? Expression(tail.headAt(index)) : tail[index];
+}
+
+// an index argument: a Number holding a whole index no greater than bound
+std::size_t list_index(const Expression & arg, std::size_t bound, const std::string & name){
+  if(!arg.isHeadNumber() || arg.isLList() || (std::floor(arg.head().asNumber()) != arg.head().asNumber())){
+    throw SemanticError("Error: index to " + name + " is not an integer");
+  }
+  double index = arg.head().asNumber();
+  if((index < 0) || (index > bound)){
+    throw SemanticError("Error: index out of range in call to " + name);
+  }
+  return static_cast<std::size_t>(index);
+}
+
+Expression Lnth(Arguments args) {
+  if(!nargs_equal(args, 2)){
+    throw SemanticError("Error: invalid number of arguments in call to nth");
+  }
+  if(!args[0].isLList()){
+    throw SemanticError("Error: first argument to nth is not a list");
+  }
+  std::size_t length = list_length(args[0]);
+  if(length == 0){
+    throw SemanticError("Error: index out of range in call to nth");
+  }
+  return list_element(args[0], list_index(args[1], length - 1, "nth"));
+};
+
+Expression Llast(Arguments args) {
+  if(!nargs_equal(args, 1)){
+    throw SemanticError("Error: more than one argument in call to last");
+  }
+  if(!args[0].isLList()){
+    throw SemanticError("Error: argument to last is not a list");
+  }
+  std::size_t length = list_length(args[0]);
+  if(length == 0){
+    throw SemanticError("Error: argument to last is an empty list");
+  }
+  return list_element(args[0], length - 1);
+};
+
+// the elements from index begin up to, not including, index end
+Expression Lslice(Arguments args) {
+  if(!nargs_equal(args, 3)){
+    throw SemanticError("Error: invalid number of arguments in call to slice");
+  }
+  if(!args[0].isLList()){
+    throw SemanticError("Error: first argument to slice is not a list");
+  }
+  std::size_t length = list_length(args[0]);
+  std::size_t end = list_index(args[2], length, "slice");
+  std::size_t begin = list_index(args[1], end, "slice");
+
+  // the slice shares the argument's storage
+  Expression result;
+  result.rTail() = args[0].rTail().slice(begin, end - begin);
+  if(begin == end){
+    result.rTail().push_back(Atom(""));
+  }
+  result.setLList(true);
+  return result;
+};
+
+// a copy of a lambda whose calls with Numbers are memoized, keeping at most
+// capacity results
+Expression Lmemoize(Arguments args) {
+  if(!nargs_equal(args, 1) && !nargs_equal(args, 2)){
+    throw SemanticError("Error: invalid number of arguments in call to memoize");
+  }
+  std::size_t capacity = MemoTable::DefaultCapacity;
+  if(args.size() == 2){
+    double value = args[1].isHeadNumber() ? args[1].head().asNumber() : 0;
+    if(!args[1].isHeadNumber() || !(value >= 1) || (value != std::floor(value)) || (value > 1e9)){
+      throw SemanticError("Error: capacity in call to memoize is not a positive integer");
+    }
+    capacity = static_cast<std::size_t>(value);
+  }
+  return args[0].memoized(capacity);
+};
+
+Expression Lappend(Arguments args) {
 	Expression result;
 	if (nargs_equal(args, 2))
 	{
 		if (args[0].isLList())
 		{
-			std::size_t length = args[0].rTail().size();
-			std::size_t i;
-			for (i = 0; i < length; i++)
-			{
-				result.rTail().push_back(args[0].rTail()[i]);
-			}
+			// shares the list's storage, the new element takes the next free slot
+			result.rTail() = args[0].rTail();
 			result.rTail().push_back(args[1].head());
 			result.setLList(true);
 		}
@@ -588,24 +837,15 @@ Expression Lappend(const std::vector<Expression> & args) {
 	return result;
 };
 
-Expression Ljoin(const std::vector<Expression> & args) {
+Expression Ljoin(Arguments args) {
 	Expression result;
 	if (nargs_equal(args, 2))
 	{
 		if (args[0].isLList() && args[1].isLList())
 		{
-			std::size_t length = args[0].rTail().size();
-			std::size_t i;
-			for (i = 0; i < length; i++)
-			{
-				result.rTail().push_back(args[0].rTail().at(i));
-			}
-			std::size_t length2 = args[1].rTail().size();
-			std::size_t j;
-			for (j = 0; j < length2; j++)
-			{
-				result.rTail().push_back(args[1].rTail().at(j));
-			}
+			// shares the first list's storage and appends the second
+			result.rTail() = args[0].rTail();
+			result.rTail().extend(args[1].rTail());
 			result.setLList(true);
 		}
 		else
@@ -620,7 +860,7 @@ Expression Ljoin(const std::vector<Expression> & args) {
 	return result;
 };
 
-Expression Lrange(const std::vector<Expression> & args) {
+Expression Lrange(Arguments args) {
 	Expression result;
 	if (nargs_equal(args, 3))
 	{
@@ -630,16 +870,20 @@ Expression Lrange(const std::vector<Expression> & args) {
 			{
 				if (args[2].head().asNumber() > 0.0)
 				{
+					// ranges are a pending sequence, the numbers are generated
+					// when the list is first read, by the same additions
+					std::size_t count = 0;
 					double num = args[0].head().asNumber();
 					while (num <= args[1].head().asNumber()) //change base upon behavior of (range 3 3 1)/ ect.
 					{
-						result.rTail().push_back(Expression(num));
+						++count;
 						num += args[2].head().asNumber();
 					}
 					if (Expression(num) == args[1])
 					{
-						result.rTail().push_back(Expression(num));
+						++count;
 					}
+					result.rTail() = ExpressionList::sequence(args[0].head().asNumber(), args[2].head().asNumber(), count);
 					result.setLList(true);
 				}
 				else
@@ -664,12 +908,192 @@ Expression Lrange(const std::vector<Expression> & args) {
 	return result;
 };
 
+// comparisons of two Numbers evaluate to 1 if true and 0 if false
+template <typename Compare>
+Expression compare(Arguments args){
+  if(!nargs_equal(args, 2)){
+    throw SemanticError("Error in call to comparison: invalid number of arguments.");
+  }
+  if(!args[0].isHeadNumber() || !args[1].isHeadNumber()){
+    throw SemanticError("Error in call to comparison: argument not a number.");
+  }
+  return Expression(Compare()(args[0].head().asNumber(), args[1].head().asNumber()) ? 1.0 : 0.0);
+};
+
+Expression logical_not(Arguments args){
+  if(!nargs_equal(args, 1)){
+    throw SemanticError("Error in call to not: invalid number of arguments.");
+  }
+  if(!args[0].isHeadNumber()){
+    throw SemanticError("Error in call to not: argument not a number.");
+  }
+  return Expression((args[0].head().asNumber() == 0) ? 1.0 : 0.0);
+};
+
+/*********************************************************************** 
+Fixed arity entry points, see Builtin. The digit in a name is its number of
+arguments. Plain numbers are handled directly, with the same arithmetic as
+the procedures above. Any other argument goes through the procedure, which
+handles lists and reports errors.
+**********************************************************************/
+
+// the one argument entry point of a procedure
+template <Procedure P>
+Expression unary_entry(const Expression & arg){
+  return P(Arguments(&arg, 1));
+}
+
+// the two argument entry point of a procedure
+template <Procedure P>
+Expression binary_entry(const Expression & left, const Expression & right){
+  const Expression args[] = {left, right};
+  return P(Arguments(args, 2));
+}
+
+// predicate, the argument is a plain Number
+bool is_number(const Expression & arg){
+  return arg.isHeadNumber() && !arg.isLList();
+}
+
+Expression add2(const Expression & left, const Expression & right){
+  // add sums from a complex zero, so -0.0 + -0.0 is 0.0 there too
+  if(is_number(left) && is_number(right)){
+    return Expression((0.0 + left.head().asNumber()) + right.head().asNumber());
+  }
+  return binary_entry<add>(left, right);
+}
+
+Expression mul2(const Expression & left, const Expression & right){
+  if(is_number(left) && is_number(right)){
+    return Expression(left.head().asNumber() * right.head().asNumber());
+  }
+  return binary_entry<mul>(left, right);
+}
+
+Expression neg1(const Expression & arg){
+  if(is_number(arg)){
+    return Expression(-arg.head().asNumber());
+  }
+  return unary_entry<subneg>(arg);
+}
+
+Expression sub2(const Expression & left, const Expression & right){
+  if(is_number(left) && is_number(right)){
+    return Expression(left.head().asNumber() - right.head().asNumber());
+  }
+  return binary_entry<subneg>(left, right);
+}
+
+Expression recip1(const Expression & arg){
+  if(is_number(arg)){
+    return Expression(1.0 / arg.head().asNumber());
+  }
+  return unary_entry<div>(arg);
+}
+
+Expression div2(const Expression & left, const Expression & right){
+  if(is_number(left) && is_number(right)){
+    return Expression(left.head().asNumber() / right.head().asNumber());
+  }
+  return binary_entry<div>(left, right);
+}
+
+Expression sq1(const Expression & arg){
+  if(is_number(arg) && (arg.head().asNumber() >= 0)){
+    return Expression(std::sqrt(arg.head().asNumber()));
+  }
+  return unary_entry<sq>(arg);
+}
+
+Expression pow2(const Expression & left, const Expression & right){
+  if(is_number(left) && is_number(right)){
+    return Expression(std::pow(left.head().asNumber(), right.head().asNumber()));
+  }
+  return binary_entry<pow>(left, right);
+}
+
+Expression logn1(const Expression & arg){
+  if(is_number(arg) && (arg.head().asNumber() > 0)){
+    return Expression(std::log(arg.head().asNumber()));
+  }
+  return unary_entry<logn>(arg);
+}
+
+Expression sn1(const Expression & arg){
+  if(is_number(arg)){
+    return Expression(std::sin(arg.head().asNumber()));
+  }
+  return unary_entry<sn>(arg);
+}
+
+Expression cn1(const Expression & arg){
+  if(is_number(arg)){
+    return Expression(std::cos(arg.head().asNumber()));
+  }
+  return unary_entry<cn>(arg);
+}
+
+Expression tn1(const Expression & arg){
+  if(is_number(arg)){
+    return Expression(std::tan(arg.head().asNumber()));
+  }
+  return unary_entry<tn>(arg);
+}
+
+template <typename Compare>
+Expression compare2(const Expression & left, const Expression & right){
+  if(is_number(left) && is_number(right)){
+    return Expression(Compare()(left.head().asNumber(), right.head().asNumber()) ? 1.0 : 0.0);
+  }
+  return binary_entry<compare<Compare> >(left, right);
+}
+
+// the least or greatest of one or more Numbers, the first of equal ones
+template <typename Compare>
+Expression extremum(Arguments args){
+  const char * name = std::is_same<Compare, std::less<double> >::value ? "min" : "max";
+  if(args.empty()){
+    throw SemanticError(std::string("Error in call to ") + name + ": invalid number of arguments.");
+  }
+  double result = 0;
+  for(std::size_t i = 0; i < args.size(); ++i){
+    if(!is_number(args[i])){
+      throw SemanticError(std::string("Error in call to ") + name + ": argument not a number.");
+    }
+    double x = args[i].head().asNumber();
+    if((i == 0) || Compare()(x, result)){
+      result = x;
+    }
+  }
+  return Expression(result);
+};
+
+template <typename Compare>
+Expression extremum2(const Expression & left, const Expression & right){
+  if(is_number(left) && is_number(right)){
+    return Compare()(right.head().asNumber(), left.head().asNumber()) ? right : left;
+  }
+  return binary_entry<extremum<Compare> >(left, right);
+}
+
+// the reduce entry point of an associative procedure, see Builtin
+template <ReduceOp Op>
+Expression reduce_entry(const ExpressionList & list){
+  return Expression(realReduce(Op, list.reals(), list.size()));
+}
 
 //Variables set up for pi, e, and I
 const double PI = std::atan2(0, -1);
 const double EXP = std::exp(1);
 const complex<double> IMI(0.0, 1.0);
 
+// the last epoch handed out, 0 is never used so it can mark unresolved nodes
+static std::atomic<std::uint32_t> epochs(0);
+
+// the last generation handed out, 0 is never used so a new MemoTable never
+// matches
+static std::atomic<std::uint32_t> generations(0);
+
 Environment::Environment(){
 
   reset();
@@ -678,14 +1102,14 @@ Environment::Environment(){
 bool Environment::is_known(const Atom & sym) const{
   if(!sym.isSymbol()) return false;
   
-  return envmap.find(sym.asSymbol()) != envmap.end();
+  return envmap.find(sym.symbolId()) != nullptr;
 }
 
 bool Environment::is_exp(const Atom & sym) const{
   if(!sym.isSymbol()) return false;
   
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ExpressionType);
+  const EnvResult * result = envmap.find(sym.symbolId());
+  return result && (result->type == ExpressionType);
 }
 
 Expression Environment::get_exp(const Atom & sym) const{
@@ -693,9 +1117,9 @@ Expression Environment::get_exp(const Atom & sym) const{
   Expression exp;
   
   if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ExpressionType)){
-      exp = result->second.exp;
+    const EnvResult * result = envmap.find(sym.symbolId());
+    if(result && (result->type == ExpressionType)){
+      exp = values[result->value];
     }
   }
 
@@ -704,23 +1128,25 @@ Expression Environment::get_exp(const Atom & sym) const{
 
 void Environment::add_exp(const Atom & sym, const Expression & exp){
 
+  check_unshared();
+
   if(!sym.isSymbol()){
     throw SemanticError("Attempt to add non-symbol to environment");
   }
     
   // error if overwriting symbol map
-  if(envmap.find(sym.asSymbol()) != envmap.end()){
+  if(envmap.find(sym.symbolId())){
     throw SemanticError("Attempt to overwrite symbol in environemnt");
   }
 
-  envmap.emplace(sym.asSymbol(), EnvResult(ExpressionType, exp)); 
+  envmap.insert(sym.symbolId(), EnvResult(ExpressionType, add_value(exp)));
 }
 
 bool Environment::is_lambda_exp(const Atom & sym) const {
 	if (!sym.isSymbol()) return false;
 
-	auto result = envmapLambda.find(sym.asSymbol());
-	return (result != envmapLambda.end()) && (result->second.type == ExpressionType);
+	const EnvResult * result = envmapLambda.find(sym.symbolId());
+	return result && (result->type == ExpressionType);
 }
 
 Expression Environment::get_lambda_exp(const Atom & sym) const {
@@ -728,9 +1154,9 @@ Expression Environment::get_lambda_exp(const Atom & sym) const {
 	Expression exp;
 
 	if (sym.isSymbol()) {
-		auto result = envmapLambda.find(sym.asSymbol());
-		if ((result != envmapLambda.end()) && (result->second.type == ExpressionType)) {
-			exp = result->second.exp;
+		const EnvResult * result = envmapLambda.find(sym.symbolId());
+		if (result && (result->type == ExpressionType)) {
+			exp = values[result->value];
 		}
 	}
 
@@ -739,21 +1165,34 @@ Expression Environment::get_lambda_exp(const Atom & sym) const {
 
 void Environment::add_lambda_exp(const Atom & sym, const Expression & exp) {
 
+	check_unshared();
+
 	if (!sym.isSymbol()) {
 		throw SemanticError("Attempt to add non-symbol to environment");
 	}
-	if (envmapLambda.find(sym.asSymbol()) != envmapLambda.end()) {
-		envmapLambda.erase(sym.asSymbol());
+
+	// overwrite in place, keys to the old value find the new one
+	EnvResult * result = envmapLambda.find(sym.symbolId());
+	if (result) {
+		new_generation();
+		values[result->value] = exp;
+		return;
 	}
 
-	envmapLambda.emplace(sym.asSymbol(), EnvResult(ExpressionType, exp));
+	envmapLambda.insert(sym.symbolId(), EnvResult(ExpressionType, add_value(exp)));
+
+	// keys to a value of the same symbol now find the wrong binding
+	const EnvResult * shadowed = envmap.find(sym.symbolId());
+	if (shadowed && (shadowed->type == ExpressionType)) {
+		new_epoch();
+	}
 }
 
 bool Environment::is_lambda(const Atom & sym) const {
 	if (!sym.isSymbol()) return false;
 
-	auto result = envmap.find(sym.asSymbol());
-	return (result != envmap.end()) && (result->second.type == LambdaType);
+	const EnvResult * result = envmap.find(sym.symbolId());
+	return result && (result->type == LambdaType);
 }
 
 Expression Environment::get_lambda(const Atom & sym) const {
@@ -761,9 +1200,9 @@ Expression Environment::get_lambda(const Atom & sym) const {
 	Expression exp;
 
 	if (sym.isSymbol()) {
-		auto result = envmap.find(sym.asSymbol());
-		if ((result != envmap.end()) && (result->second.type == LambdaType)) {
-			exp = result->second.exp;
+		const EnvResult * result = envmap.find(sym.symbolId());
+		if (result && (result->type == LambdaType)) {
+			exp = values[result->value];
 		}
 	}
 
@@ -772,23 +1211,30 @@ Expression Environment::get_lambda(const Atom & sym) const {
 
 void Environment::add_lambda(const Atom & sym, const Expression & exp) {
 
+	check_unshared();
+
 	if (!sym.isSymbol()) {
 		throw SemanticError("Attempt to add non-symbol to environment");
 	}
 
 	// error if overwriting symbol map
-	if (envmap.find(sym.asSymbol()) != envmap.end()) {
+	if (envmap.find(sym.symbolId())) {
 		throw SemanticError("Attempt to overwrite symbol in environemnt");
 	}
 
-	envmap.emplace(sym.asSymbol(), EnvResult(LambdaType, exp));
+	envmap.insert(sym.symbolId(), EnvResult(LambdaType, add_value(exp)));
+
+	// a lambda is found before the values defined in lambdas
+	if (envmapLambda.find(sym.symbolId())) {
+		new_epoch();
+	}
 }
 
 bool Environment::is_proc(const Atom & sym) const{
   if(!sym.isSymbol()) return false;
   
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ProcedureType);
+  const EnvResult * result = envmap.find(sym.symbolId());
+  return result && (result->type == ProcedureType);
 }
 
 Procedure Environment::get_proc(const Atom & sym) const{
@@ -796,93 +1242,244 @@ Procedure Environment::get_proc(const Atom & sym) const{
   //Procedure proc = default_proc;
 
   if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ProcedureType)){
-      return result->second.proc;
+    const EnvResult * result = envmap.find(sym.symbolId());
+    if(result && (result->type == ProcedureType)){
+      return result->builtin->proc;
     }
   }
 
   return default_proc;
 }
 
+Procedure Environment::find_proc(const Atom & sym) const noexcept{
+
+  const Builtin * builtin = find_builtin(sym);
+  return builtin ? builtin->proc : nullptr;
+}
+
+const Builtin * Environment::find_builtin(const Atom & sym) const noexcept{
+
+  if(sym.isSymbol()){
+    const EnvResult * result = envmap.find(sym.symbolId());
+    if(result && (result->type == ProcedureType)){
+      return result->builtin;
+    }
+  }
+
+  return nullptr;
+}
+
+std::uint32_t Environment::epoch() const noexcept{
+  return the_epoch;
+}
+
+std::uint32_t Environment::generation() const noexcept{
+  return the_generation;
+}
+
+std::uint64_t Environment::value_key(const Atom & sym) const{
+
+  if(!sym.isSymbol()) return 0;
+
+  // same order as a terminal in Expression::eval: lambdas, then the
+  // values defined in lambdas, then other values
+  const EnvResult * result = envmap.find(sym.symbolId());
+  if(result && (result->type == LambdaType)){
+    return key_of(result->value);
+  }
+  const EnvResult * inLambda = envmapLambda.find(sym.symbolId());
+  if(inLambda){
+    return key_of(inLambda->value);
+  }
+  if(result && (result->type == ExpressionType)){
+    return key_of(result->value);
+  }
+  return 0;
+}
+
+std::uint64_t Environment::lambda_key(const Atom & sym) const{
+
+  if(!sym.isSymbol()) return 0;
+
+  const EnvResult * result = envmap.find(sym.symbolId());
+  return (result && (result->type == LambdaType)) ? key_of(result->value) : 0;
+}
+
+const Expression * Environment::value_at(std::uint64_t key) const noexcept{
+
+  // the epoch is in the high half and never 0, so key 0 never matches
+  if(static_cast<std::uint32_t>(key >> 32) != the_epoch){
+    return nullptr;
+  }
+  return &values[static_cast<std::uint32_t>(key)];
+}
+
+void Environment::new_epoch() noexcept{
+  do{
+    the_epoch = ++epochs;
+  } while(the_epoch == 0);
+
+  // a binding found before may now be another one
+  new_generation();
+}
+
+void Environment::new_generation() noexcept{
+  do{
+    the_generation = ++generations;
+  } while(the_generation == 0);
+}
+
+void Environment::add_builtin(const std::string & name, Procedure proc,
+			      UnaryProcedure unary, BinaryProcedure binary,
+			      ReduceProcedure reduce){
+  builtins.push_back(Builtin{proc, unary, binary, reduce});
+  envmap.insert(intern(name), EnvResult(ProcedureType, &builtins.back()));
+}
+
+std::uint32_t Environment::add_value(const Expression & exp){
+  values.push_back(exp);
+  return static_cast<std::uint32_t>(values.size() - 1);
+}
+
+std::uint64_t Environment::key_of(std::uint32_t index) const noexcept{
+  return (static_cast<std::uint64_t>(the_epoch) << 32) | index;
+}
+
+Environment::Sharing::Sharing(Environment & env) noexcept: env(env){
+  env.sharing.count.fetch_add(1);
+}
+
+Environment::Sharing::~Sharing(){
+  env.sharing.count.fetch_sub(1);
+}
+
+void Environment::check_unshared() const{
+  if(sharing.count.load() > 0){
+    throw SemanticError("Error during evaluation: attempt to modify an environment shared between threads");
+  }
+}
+
 /*
 Reset the environment to the default state. First remove all entries and
 then re-add the default ones.
  */
 void Environment::reset(){
 
+  check_unshared();
+
   envmap.clear();
   envmapLambda.clear();
+  values.clear();
+  builtins.clear();
+  new_epoch();
   
   // Built-In value of pi
-  envmap.emplace("pi", EnvResult(ExpressionType, Expression(PI)));
+  envmap.insert(intern("pi"), EnvResult(ExpressionType, add_value(Expression(PI))));
 
   // Built-In value of e
-  envmap.emplace("e", EnvResult(ExpressionType, Expression(EXP)));
+  envmap.insert(intern("e"), EnvResult(ExpressionType, add_value(Expression(EXP))));
 
   // Built-In value of I
-  envmap.emplace("I", EnvResult(ExpressionType, Expression(IMI)));
+  envmap.insert(intern("I"), EnvResult(ExpressionType, add_value(Expression(IMI))));
 
   // Procedure: add;
-  envmap.emplace("+", EnvResult(ProcedureType, add)); 
+  add_builtin("+", add, nullptr, add2, reduce_entry<ReduceOp::Add>);
 
   // Procedure: subneg;
-  envmap.emplace("-", EnvResult(ProcedureType, subneg)); 
+  add_builtin("-", subneg, neg1, sub2);
 
   // Procedure: mul;
-  envmap.emplace("*", EnvResult(ProcedureType, mul)); 
+  add_builtin("*", mul, nullptr, mul2, reduce_entry<ReduceOp::Mul>);
 
   // Procedure: div;
-  envmap.emplace("/", EnvResult(ProcedureType, div));
+  add_builtin("/", div, recip1, div2);
 
   // Procedure: sqrt;
-  envmap.emplace("sqrt", EnvResult(ProcedureType, sq));
+  add_builtin("sqrt", sq, sq1);
 
   // Procedure: pow;
-  envmap.emplace("^", EnvResult(ProcedureType, pow));
+  add_builtin("^", pow, nullptr, pow2);
 
   // Procedure: logn;
-  envmap.emplace("ln", EnvResult(ProcedureType, logn));
+  add_builtin("ln", logn, logn1);
 
   // Procedure: sin;
-  envmap.emplace("sin", EnvResult(ProcedureType, sn));
+  add_builtin("sin", sn, sn1);
 
   // Procedure: cos;
-  envmap.emplace("cos", EnvResult(ProcedureType, cn));
+  add_builtin("cos", cn, cn1);
 
   // Procedure: tan;
-  envmap.emplace("tan", EnvResult(ProcedureType, tn));
+  add_builtin("tan", tn, tn1);
 
   // Procedure: real;
-  envmap.emplace("real", EnvResult(ProcedureType, IMreal));
+  add_builtin("real", IMreal, unary_entry<IMreal>);
 
   // Procedure: imag;
-  envmap.emplace("imag", EnvResult(ProcedureType, IMimag));
+  add_builtin("imag", IMimag, unary_entry<IMimag>);
 
   // Procedure: mag;
-  envmap.emplace("mag", EnvResult(ProcedureType, IMmag));
+  add_builtin("mag", IMmag, unary_entry<IMmag>);
 
   // Procedure: arg;
-  envmap.emplace("arg", EnvResult(ProcedureType, IMarg));
+  add_builtin("arg", IMarg, unary_entry<IMarg>);
 
   // Procedure: conj;
-  envmap.emplace("conj", EnvResult(ProcedureType, IMconj));
+  add_builtin("conj", IMconj, unary_entry<IMconj>);
 
   // Procedure: first;
-  envmap.emplace("first", EnvResult(ProcedureType, Lfirst));
+  add_builtin("first", Lfirst, unary_entry<Lfirst>);
 
   // Procedure: rest;
-  envmap.emplace("rest", EnvResult(ProcedureType, Lrest));
+  add_builtin("rest", Lrest, unary_entry<Lrest>);
 
   // Procedure: length;
-  envmap.emplace("length", EnvResult(ProcedureType, Llength));
+  add_builtin("length", Llength, unary_entry<Llength>);
+
+  // Procedure: nth;
+  add_builtin("nth", Lnth, nullptr, binary_entry<Lnth>);
+
+  // Procedure: last;
+  add_builtin("last", Llast, unary_entry<Llast>);
+
+  // Procedure: slice;
+  add_builtin("slice", Lslice);
 
   // Procedure: append;
-  envmap.emplace("append", EnvResult(ProcedureType, Lappend));
+  add_builtin("append", Lappend);
 
   // Procedure: join;
-  envmap.emplace("join", EnvResult(ProcedureType, Ljoin));
+  add_builtin("join", Ljoin);
 
   // Procedure: range;
-  envmap.emplace("range", EnvResult(ProcedureType, Lrange));
+  add_builtin("range", Lrange);
+
+  // Procedure: <;
+  add_builtin("<", compare<std::less<double> >, nullptr, compare2<std::less<double> >);
+
+  // Procedure: >;
+  add_builtin(">", compare<std::greater<double> >, nullptr, compare2<std::greater<double> >);
+
+  // Procedure: <=;
+  add_builtin("<=", compare<std::less_equal<double> >, nullptr, compare2<std::less_equal<double> >);
+
+  // Procedure: >=;
+  add_builtin(">=", compare<std::greater_equal<double> >, nullptr, compare2<std::greater_equal<double> >);
+
+  // Procedure: =;
+  add_builtin("=", compare<std::equal_to<double> >, nullptr, compare2<std::equal_to<double> >);
+
+  // Procedure: not;
+  add_builtin("not", logical_not, unary_entry<logical_not>);
+
+  // Procedure: min;
+  add_builtin("min", extremum<std::less<double> >, unary_entry<extremum<std::less<double> > >,
+	      extremum2<std::less<double> >, reduce_entry<ReduceOp::Min>);
+
+  // Procedure: max;
+  add_builtin("max", extremum<std::greater<double> >, unary_entry<extremum<std::greater<double> > >,
+	      extremum2<std::greater<double> >, reduce_entry<ReduceOp::Max>);
+
+  // Procedure: memoize;
+  add_builtin("memoize", Lmemoize);
 }
@@ -11,17 +11,37 @@ needed.
 #define ENVIRONMENT_HPP
 
 // system includes
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <deque>
 
 // module includes
 #include "atom.hpp"
 #include "expression.hpp"
+#include "symbol_map.hpp"
 
 /*! \typedef Procedure
-\brief A Procedure is a C++ function pointer taking a vector of 
-       Expressions as arguments and returning an Expression.
+\brief A Procedure is a C++ function pointer taking a view of the argument
+       Expressions and returning an Expression.
+
+Declared in expression.hpp, which caches resolved procedures.
+*/
+
+/*! \struct Builtin
+\brief The entry points of a built-in procedure.
+
+proc takes any number of arguments and reports any error in their number.
+unary and binary may be null; when set, eval calls them instead of proc for
+calls with exactly one or two arguments, without gathering the arguments.
+reduce is set for associative procedures; reduce and fold call it with a
+packed list of at least one Number instead of calling binary per element.
 */
-typedef Expression (*Procedure)(const std::vector<Expression> & args);
+struct Builtin {
+  Procedure proc;
+  UnaryProcedure unary;
+  BinaryProcedure binary;
+  ReduceProcedure reduce;
+};
 
 /*! \class Environment
 \brief A class representing the interpreter environment.
@@ -36,6 +56,10 @@ return you can obtain
 the mapped-to value using get_exp or get_proc.
 
 To add an symbol to expression mapping use the add_exp member function.
+
+Call sites that look the same symbol up repeatedly can keep the key
+returned by value_key or lambda_key and read the binding back with
+value_at, which skips the lookup while the key is valid.
  */
 class Environment {
 public:
@@ -89,29 +113,140 @@ public:
           or does not map to a known procedure.
   */
   Procedure get_proc(const Atom &sym) const;
+
+  /*! Get the Procedure the argument symbol maps to with a single lookup
+    \param sym the symbol to lookup
+    \return the procedure it maps to or nullptr
+  */
+  Procedure find_proc(const Atom &sym) const noexcept;
+
+  /*! Get all the entry points of the procedure the symbol maps to
+    \param sym the symbol to lookup
+    \return the builtin, valid while the epoch is unchanged, or nullptr
+  */
+  const Builtin * find_builtin(const Atom &sym) const noexcept;
+
+  /*! The epoch of the bindings. Within an epoch a symbol, once bound,
+    always finds the same binding: procedures are only added by reset and
+    can never be redefined, and defines cannot shadow an existing binding.
+    So a Procedure or key found in this environment stays valid while the
+    epoch is unchanged. Every reset, and every define that does shadow a
+    binding, starts a new epoch, unique across all environments.
+   */
+  std::uint32_t epoch() const noexcept;
+
+  /*! The generation of the bindings. It changes with every epoch, and
+    also when a define in a lambda overwrites the value of its symbol, to a
+    value unique across all environments. Other defines only add bindings
+    that no lookup found before, so a result computed from the bindings of
+    one generation, see MemoTable, is still the result while the generation
+    is unchanged.
+   */
+  std::uint32_t generation() const noexcept;
+
+  /*! Find the value a symbol evaluates to, in the order eval looks it up.
+    \param sym the symbol to lookup
+    \return a key for value_at, or 0 if the symbol is not bound to a value
+   */
+  std::uint64_t value_key(const Atom &sym) const;
+
+  /*! Find the lambda a symbol is defined as.
+    \param sym the symbol to lookup
+    \return a key for value_at, or 0 if the symbol is not a lambda
+   */
+  std::uint64_t lambda_key(const Atom &sym) const;
+
+  /*! Get the value a key refers to without a lookup.
+    \param key a key returned by value_key or lambda_key
+    \return the value, or nullptr if key is 0 or from another epoch
+   */
+  const Expression * value_at(std::uint64_t key) const noexcept;
+
   Expression get_lambda(const Atom &sym) const;
   /*! Reset the environment to its default state. */
   void reset();
 
+  /*! \class Sharing
+  \brief Marks an environment as read by several threads for its lifetime.
+
+  The const members only read the environment, so threads may call them
+  concurrently while no thread modifies it. While a Sharing exists, adding a
+  binding or resetting throws a SemanticError instead.
+   */
+  class Sharing {
+  public:
+    explicit Sharing(Environment & env) noexcept;
+    ~Sharing();
+
+    Sharing(const Sharing &) = delete;
+    Sharing & operator=(const Sharing &) = delete;
+
+  private:
+    Environment & env;
+  };
+
 private:
   
   // Environment is a mapping from symbols to expressions or procedures
   enum EnvResultType { ExpressionType, ProcedureType, LambdaType };
 
+  // a compact entry, the expressions themselves are kept in values
   struct EnvResult {
     EnvResultType type;
-    Expression exp; // used when type is ExpressionType
-    Procedure proc; // used when type is ProcedureType
+    union {
+      std::uint32_t value; // index into values, unless type is ProcedureType
+      const Builtin * builtin; // used when type is ProcedureType
+    };
 
-    // constructors for use in container emplace
     EnvResult(){};
-    EnvResult(EnvResultType t, Expression e) : type(t), exp(e){};
-    EnvResult(EnvResultType t, Procedure p) : type(t), proc(p){};
+    EnvResult(EnvResultType t, std::uint32_t v) : type(t), value(v){};
+    EnvResult(EnvResultType t, const Builtin * b) : type(t), builtin(b){};
+  };
+
+  // the environment map, keyed by interned symbol id
+  SymbolMap<EnvResult> envmap;
+  SymbolMap<EnvResult> envmapLambda;
+
+  // the defined expressions, a deque so they never move while bound
+  std::deque<Expression> values;
+
+  // the built-in procedures, also never moved
+  std::deque<Builtin> builtins;
+
+  // bind name to a built-in procedure with the given entry points
+  void add_builtin(const std::string & name, Procedure proc,
+		   UnaryProcedure unary = nullptr, BinaryProcedure binary = nullptr,
+		   ReduceProcedure reduce = nullptr);
+
+  // the current epoch, see epoch()
+  std::uint32_t the_epoch = 0;
+
+  // the current generation, see generation()
+  std::uint32_t the_generation = 0;
+
+  // start a new generation, after a change to a binding found before
+  void new_generation() noexcept;
+
+  // start a new epoch, invalidating every cached binding, and a new generation
+  void new_epoch() noexcept;
+
+  // store exp in values, returning its index
+  std::uint32_t add_value(const Expression & exp);
+
+  // the value_at key of values[index] in the current epoch
+  std::uint64_t key_of(std::uint32_t index) const noexcept;
+
+  // number of live Sharing objects, a copy of the environment is unshared
+  struct SharingCount {
+    std::atomic<unsigned> count{0};
+    SharingCount() = default;
+    SharingCount(const SharingCount &){}
+    SharingCount & operator=(const SharingCount &){ return *this; }
   };
+  SharingCount sharing;
 
-  // the environment map
-  std::map<std::string, EnvResult> envmap;
-  std::map<std::string, EnvResult> envmapLambda;
+  // throw if the environment is shared, see Sharing
+  void check_unshared() const;
 };
 
 #endif
@@ -0,0 +1,121 @@
+// Microbenchmarks for symbol lookup with many user definitions. The first
+// table times a lookup in the Environment against a std::map keyed the same
+// way, the second times a program that calls a global lambda reading a
+// global value, after the given number of other definitions. Build with
+// optimization, e.g. -DCMAKE_BUILD_TYPE=Release, for meaningful numbers.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedNs(Clock::time_point start, Clock::time_point stop){
+  return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+// nanoseconds per lookup of a random defined symbol, environment and std::map
+static void timeLookups(std::size_t n, std::size_t lookups, double & envNs, double & mapNs){
+
+  Environment env;
+  std::map<SymbolId, Expression> tree;
+  std::vector<Atom> symbols;
+  for(std::size_t i = 0; i < n; ++i){
+    symbols.emplace_back("bench-value-" + std::to_string(i));
+    env.add_exp(symbols.back(), Expression(double(i)));
+    tree.emplace(symbols.back().symbolId(), Expression(double(i)));
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+  std::vector<Atom> order;
+  for(std::size_t i = 0; i < lookups; ++i){
+    order.push_back(symbols[pick(gen)]);
+  }
+
+  double sum = 0;
+  auto start = Clock::now();
+  for(auto & sym : order){
+    sum += env.value_at(env.value_key(sym))->head().asNumber();
+  }
+  auto stop = Clock::now();
+  envNs = elapsedNs(start, stop) / lookups;
+
+  start = Clock::now();
+  for(auto & sym : order){
+    sum -= tree.find(sym.symbolId())->second.head().asNumber();
+  }
+  stop = Clock::now();
+  mapNs = elapsedNs(start, stop) / lookups;
+
+  if(sum != 0){
+    throw SemanticError("Error: benchmark lookups disagree");
+  }
+}
+
+// milliseconds to map a lambda over a range after n other definitions
+static double timeCalls(std::size_t n, const std::string & range){
+
+  std::ostringstream program;
+  program << "(begin";
+  for(std::size_t i = 0; i < n; ++i){
+    program << " (define bench-value-" << i << " " << i << ")";
+  }
+  program << " (define c 3) (define g (lambda (y) (+ y c)))"
+	  << " (define f (lambda (x) (g (* x c))))";
+  std::string prefix = program.str();
+
+  Interpreter setup;
+  std::istringstream defines(prefix + ")");
+  if(!setup.parseStream(defines)){
+    throw SemanticError("Error: benchmark program did not parse");
+  }
+  setup.evaluate();
+
+  std::istringstream calls("(map f " + range + ")");
+  if(!setup.parseStream(calls)){
+    throw SemanticError("Error: benchmark program did not parse");
+  }
+  double best = 0;
+  for(int r = 0; r < 3; ++r){
+    auto start = Clock::now();
+    setup.evaluate();
+    double ms = elapsedNs(start, Clock::now()) / 1e6;
+    if((r == 0) || (ms < best)){
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]){
+
+  std::string n = (argc > 1) ? argv[1] : "100000";
+  std::string range = "(range 1 " + n + " 1)";
+  std::vector<std::size_t> sizes = {100, 10000, 100000};
+
+  std::cout << std::left << std::setw(14) << "definitions" << std::right
+	    << std::setw(16) << "env (ns)" << std::setw(16) << "std::map (ns)"
+	    << std::setw(16) << "calls (ms)" << std::endl;
+
+  for(auto size : sizes){
+    double envNs, mapNs;
+    timeLookups(size, 1000000, envNs, mapNs);
+    double callMs = timeCalls(size, range);
+    std::cout << std::left << std::setw(14) << size << std::right << std::fixed << std::setprecision(1)
+	      << std::setw(16) << envNs << std::setw(16) << mapNs
+	      << std::setw(16) << std::setprecision(3) << callMs << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -4,6 +4,10 @@
 #include "semantic_error.hpp"
 
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
 
 TEST_CASE( "Test default constructor", "[environment]" ) {
 
@@ -47,6 +51,33 @@ TEST_CASE( "Test add expression", "[environment]" ) {
   REQUIRE_THROWS_AS(env.add_exp(Atom(1.0), b), SemanticError);
 }
 
+TEST_CASE( "Test generations", "[environment]" ) {
+  Environment env;
+
+  INFO("a define that only adds a binding keeps the generation");
+  std::uint32_t generation = env.generation();
+  env.add_exp(Atom("one"), Expression(1.));
+  env.add_lambda_exp(Atom("two"), Expression(2.));
+  REQUIRE(env.generation() == generation);
+
+  INFO("a define that fails keeps the generation, and the memoized results");
+  REQUIRE_THROWS_AS(env.add_exp(Atom("one"), Expression(2.)), SemanticError);
+  REQUIRE_THROWS_AS(env.add_exp(Atom(1.0), Expression(2.)), SemanticError);
+  REQUIRE_THROWS_AS(env.add_lambda(Atom("one"), Expression(2.)), SemanticError);
+  REQUIRE_THROWS_AS(env.add_lambda_exp(Atom(1.0), Expression(2.)), SemanticError);
+  REQUIRE(env.generation() == generation);
+
+  INFO("overwriting, shadowing and reset change what lookups find");
+  env.add_lambda_exp(Atom("two"), Expression(3.));
+  REQUIRE(env.generation() != generation);
+  generation = env.generation();
+  env.add_lambda_exp(Atom("one"), Expression(3.));
+  REQUIRE(env.generation() != generation);
+  generation = env.generation();
+  env.reset();
+  REQUIRE(env.generation() != generation);
+}
+
 TEST_CASE( "Test get built-in procedure", "[environment]" ) {
   Environment env;
 
@@ -65,6 +96,242 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
   REQUIRE(padd(args) == Expression(3.0));
 }
 
+TEST_CASE( "Test find procedure and epochs", "[environment]" ) {
+  Environment env;
+
+  REQUIRE(env.find_proc(Atom("+")) == env.get_proc(Atom("+")));
+  REQUIRE(env.find_proc(Atom("pi")) == nullptr);
+  REQUIRE(env.find_proc(Atom("doesnotexist")) == nullptr);
+  REQUIRE(env.find_proc(Atom(1.0)) == nullptr);
+
+  INFO("only reset changes the procedures, so only reset starts an epoch")
+  std::uint64_t first = env.epoch();
+  env.add_exp(Atom("one"), Expression(1.0));
+  REQUIRE(env.epoch() == first);
+  env.reset();
+  REQUIRE(env.epoch() != first);
+
+  Environment other;
+  REQUIRE(other.epoch() != env.epoch());
+}
+
+TEST_CASE( "Test cached bindings", "[environment]" ) {
+  Environment env;
+
+  REQUIRE(env.value_key(Atom("undefined")) == 0);
+  REQUIRE(env.value_at(0) == nullptr);
+  REQUIRE(*env.value_at(env.value_key(Atom("pi"))) == Expression(std::atan2(0, -1)));
+  REQUIRE(env.lambda_key(Atom("pi")) == 0);
+  REQUIRE(env.value_key(Atom("+")) == 0);
+
+  INFO("keys stay valid while definitions are added")
+  std::uint64_t one = env.value_key(Atom("pi"));
+  for(int i = 0; i < 1000; ++i){
+    env.add_exp(Atom("v" + std::to_string(i)), Expression(double(i)));
+  }
+  REQUIRE(env.value_at(one) == env.value_at(env.value_key(Atom("pi"))));
+  REQUIRE(*env.value_at(env.value_key(Atom("v999"))) == Expression(999.));
+
+  INFO("a value defined in a lambda shadows the global one and invalidates keys")
+  std::uint64_t v1 = env.value_key(Atom("v1"));
+  env.add_lambda_exp(Atom("v1"), Expression(-1.));
+  REQUIRE(env.value_at(v1) == nullptr);
+  REQUIRE(*env.value_at(env.value_key(Atom("v1"))) == Expression(-1.));
+
+  INFO("overwriting it keeps keys valid")
+  std::uint64_t shadow = env.value_key(Atom("v1"));
+  env.add_lambda_exp(Atom("v1"), Expression(-2.));
+  REQUIRE(*env.value_at(shadow) == Expression(-2.));
+
+  INFO("keys are not valid after reset or in another environment")
+  Environment other;
+  REQUIRE(other.value_at(one) == nullptr);
+  env.reset();
+  REQUIRE(env.value_at(one) == nullptr);
+}
+
+// equal, or both the same infinity or nan, which never compare equal
+static bool same(const Expression & a, const Expression & b){
+  std::ostringstream left, right;
+  left << a;
+  right << b;
+  return (a == b) || (left.str() == right.str());
+}
+
+TEST_CASE( "Test fixed arity entry points", "[environment]" ) {
+  Environment env;
+
+  const Builtin * sine = env.find_builtin(Atom("sin"));
+  REQUIRE(sine != nullptr);
+  REQUIRE(sine->proc == env.get_proc(Atom("sin")));
+  REQUIRE(sine->unary != nullptr);
+  REQUIRE(env.find_builtin(Atom("+"))->binary != nullptr);
+  REQUIRE(env.find_builtin(Atom("range"))->unary == nullptr);
+  REQUIRE(env.find_builtin(Atom("pi")) == nullptr);
+
+  Expression list;
+  list.setLList(true);
+  list.append(Atom(4.0));
+  list.append(Atom(-9.0));
+  std::vector<Expression> values = {Expression(2.0), Expression(-0.0), Expression(-4.0),
+				    Expression(0.0), Expression(std::complex<double>(1, 2)),
+				    Expression(Atom("a")), list};
+
+  INFO("the entry points give the same results and errors as the procedures")
+  for(auto & name : {"-", "/", "sqrt", "ln", "sin", "cos", "tan", "real", "conj", "first"}){
+    const Builtin * builtin = env.find_builtin(Atom(name));
+    for(auto & x : values){
+      std::vector<Expression> args = {x};
+      bool procThrows = false;
+      Expression expected;
+      try{
+	expected = builtin->proc(args);
+      }
+      catch(const SemanticError &){
+	procThrows = true;
+      }
+      if(procThrows){
+	REQUIRE_THROWS_AS(builtin->unary(x), SemanticError);
+      }
+      else{
+	REQUIRE(same(builtin->unary(x), expected));
+      }
+    }
+  }
+  for(auto & name : {"+", "-", "*", "/", "^"}){
+    const Builtin * builtin = env.find_builtin(Atom(name));
+    for(auto & x : values){
+      for(auto & y : values){
+	std::vector<Expression> args = {x, y};
+	bool procThrows = false;
+	Expression expected;
+	try{
+	  expected = builtin->proc(args);
+	}
+	catch(const SemanticError &){
+	  procThrows = true;
+	}
+	if(procThrows){
+	  REQUIRE_THROWS_AS(builtin->binary(x, y), SemanticError);
+	}
+	else{
+	  REQUIRE(same(builtin->binary(x, y), expected));
+	}
+      }
+    }
+  }
+
+  INFO("signed zeros are kept the same way")
+  Expression zero = env.find_builtin(Atom("+"))->binary(Expression(-0.0), Expression(-0.0));
+  REQUIRE(!std::signbit(zero.head().asNumber()));
+}
+
+// the complex accumulation add and mul always used, kept as the reference
+// for the typed kernels
+static Expression reference_fold(const std::vector<Expression> & args, bool product){
+  bool hasImag = false;
+  std::complex<double> Ires(product ? 1.0 : 0.0, 0.0);
+  for(auto & a : args){
+    if(a.isHeadNumber()){
+      Ires = product ? (Ires * a.head().asNumber()) : (Ires + a.head().asNumber());
+    }
+    else{
+      hasImag = true;
+      Ires = product ? (Ires * a.head().asComplex()) : (Ires + a.head().asComplex());
+    }
+  }
+  return hasImag ? Expression(Ires) : Expression(Ires.real());
+}
+
+// same kind and the same bits
+static bool identical(const Expression & a, const Expression & b){
+  if(a.isHeadNumber() && b.isHeadNumber()){
+    double x = a.head().asNumber(), y = b.head().asNumber();
+    return std::memcmp(&x, &y, sizeof(double)) == 0;
+  }
+  if(a.isHeadComplex() && b.isHeadComplex()){
+    std::complex<double> x = a.head().asComplex(), y = b.head().asComplex();
+    return std::memcmp(&x, &y, sizeof(x)) == 0;
+  }
+  return false;
+}
+
+TEST_CASE( "Test arithmetic kernels are bit-identical", "[environment]" ) {
+  Environment env;
+  Procedure add = env.get_proc(Atom("+"));
+  Procedure mul = env.get_proc(Atom("*"));
+  Procedure sub = env.get_proc(Atom("-"));
+  Procedure div = env.get_proc(Atom("/"));
+  Procedure pow = env.get_proc(Atom("^"));
+
+  double inf = std::numeric_limits<double>::infinity();
+  std::vector<Expression> values = {
+    Expression(-0.0), Expression(0.0), Expression(-2.5), Expression(3.0), Expression(inf),
+    Expression(1e308), Expression(4.9e-324), Expression(std::complex<double>(0.0, -0.0)),
+    Expression(std::complex<double>(-1.5, 2.0)), Expression(std::complex<double>(inf, 1.0)),
+    Expression(std::complex<double>(1e-300, -1e300))
+  };
+
+  bool all = true;
+  for(auto & x : values){
+    for(auto & y : values){
+      std::complex<double> cx = x.isHeadNumber() ? std::complex<double>(x.head().asNumber(), 0.0) : x.head().asComplex();
+      bool complexArgs = x.isHeadComplex() || y.isHeadComplex();
+      for(auto & z : values){
+	std::vector<Expression> args = {x, y, z};
+	all = all && identical(add(args), reference_fold(args, false));
+	all = all && identical(mul(args), reference_fold(args, true));
+      }
+      std::vector<Expression> args = {x, y};
+      all = all && identical(add(args), reference_fold(args, false));
+      all = all && identical(mul(args), reference_fold(args, true));
+      if(!complexArgs){
+	double a = x.head().asNumber(), b = y.head().asNumber();
+	all = all && identical(sub(args), Expression(a - b));
+	all = all && identical(div(args), Expression(a / b));
+	all = all && identical(pow(args), Expression(std::pow(a, b)));
+      }
+      else if(y.isHeadNumber()){
+	double b = y.head().asNumber();
+	all = all && identical(sub(args), Expression(cx - b));
+	all = all && identical(div(args), Expression(cx / b));
+	all = all && identical(pow(args), Expression(std::pow(cx, b)));
+      }
+      else if(x.isHeadNumber()){
+	double a = x.head().asNumber();
+	std::complex<double> b = y.head().asComplex();
+	all = all && identical(sub(args), Expression(a - b));
+	all = all && identical(div(args), Expression(a / b));
+	all = all && identical(pow(args), Expression(std::pow(a, b)));
+      }
+      else{
+	std::complex<double> b = y.head().asComplex();
+	all = all && identical(sub(args), Expression(cx - b));
+	all = all && identical(div(args), Expression(cx / b));
+	all = all && identical(pow(args), Expression(std::pow(cx, b)));
+      }
+    }
+    std::vector<Expression> one = {x};
+    if(x.isHeadNumber()){
+      all = all && identical(sub(one), Expression(-x.head().asNumber()));
+      all = all && identical(div(one), Expression(1.0 / x.head().asNumber()));
+    }
+    else{
+      all = all && identical(sub(one), Expression(-x.head().asComplex()));
+      all = all && identical(div(one), Expression(1.0 / x.head().asComplex()));
+    }
+  }
+  REQUIRE(all);
+
+  INFO("invalid operands are reported as before")
+  std::vector<Expression> bad = {Expression(1.0), Expression(Atom("a"))};
+  REQUIRE_THROWS_AS(add(bad), SemanticError);
+  REQUIRE_THROWS_AS(mul(bad), SemanticError);
+  REQUIRE_THROWS_AS(sub(bad), SemanticError);
+  REQUIRE_THROWS_AS(div(bad), SemanticError);
+  REQUIRE_THROWS_AS(pow(bad), SemanticError);
+}
+
 TEST_CASE( "Test reset", "[environment]" ) {
   Environment env;
 
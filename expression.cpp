@@ -1,54 +1,152 @@
 #include "expression.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <string>
 #include <list>
 #include <iomanip>
+#include <mutex>
+#include <numeric>
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#include "decimate.hpp"
 #include "environment.hpp"
+#include "frame.hpp"
 #include "semantic_error.hpp"
+#include "thread_pool.hpp"
 
 volatile std::atomic_bool interupt(false);
 
+// interned ids of the special forms, compared against the head in eval
+static const SymbolId LIST_ID = intern("list");
+static const SymbolId BEGIN_ID = intern("begin");
+static const SymbolId DEFINE_ID = intern("define");
+static const SymbolId APPLY_ID = intern("apply");
+static const SymbolId MAP_ID = intern("map");
+static const SymbolId PMAP_ID = intern("pmap");
+static const SymbolId REDUCE_ID = intern("reduce");
+static const SymbolId FOLD_ID = intern("fold");
+static const SymbolId SETPROP_ID = intern("set-property");
+static const SymbolId GETPROP_ID = intern("get-property");
+static const SymbolId DISCPLOT_ID = intern("discrete-plot");
+static const SymbolId CONTPLOT_ID = intern("continuous-plot");
+static const SymbolId LAMBDA_ID = intern("lambda");
+static const SymbolId IF_ID = intern("if");
+static const SymbolId COND_ID = intern("cond");
+static const SymbolId AND_ID = intern("and");
+static const SymbolId OR_ID = intern("or");
+static const SymbolId DO_ID = intern("do");
+static const SymbolId WHILE_ID = intern("while");
+static const SymbolId FOREACH_ID = intern("for-each");
+
+// a string atom, spelling includes the quotes
+static Atom string_atom(const std::string & spelling)
+{
+	Atom atom(spelling);
+	atom.setString();
+	return atom;
+}
+
+// the property keys and object names of the objects plots are built from,
+// the same the make-point, make-line and make-text lambdas of the startup
+// file set
+static const Atom OBJECT_NAME_KEY = string_atom("\"object-name\"");
+static const Atom SIZE_KEY = string_atom("\"size\"");
+static const Atom THICKNESS_KEY = string_atom("\"thickness\"");
+static const Atom POSITION_KEY = string_atom("\"position\"");
+static const Atom TEXT_SCALE_KEY = string_atom("\"text-scale\"");
+static const Atom POINT_NAME = string_atom("\"point\"");
+static const Atom LINE_NAME = string_atom("\"line\"");
+static const Atom TEXT_NAME = string_atom("\"text\"");
+
+#ifdef EXPRESSION_COUNT_COPIES
+// number of Expression copies made, see Expression::copyCount
+static std::atomic<std::size_t> copies(0);
+#endif
+
 Expression::Expression(){}
 
 Expression::Expression(const Atom & a){
   m_head = a;
 }
 
-// recursive copy
-Expression::Expression(const Expression & a){
+// copy, the tail is shared with a until either is modified
+Expression::Expression(const Expression & a):
+  inLambda(a.inLambda), m_head(a.m_head), propMap(a.propMap), error(a.error),
+  isList(a.isList), islambda(a.islambda), m_tail(a.m_tail), m_slot(a.m_slot),
+  m_closure(a.m_closure), m_dispatch(a.m_dispatch), m_builtin(a.m_builtin), m_epoch(a.m_epoch),
+  m_cache(a.m_cache.load(std::memory_order_relaxed)){
 
-  m_head = a.m_head;
-  isList = a.isList;
-  islambda = a.islambda;
-  inLambda = a.inLambda;
-  propMap = a.propMap;
-  error = a.error;
-  for(auto e : a.m_tail){
-    m_tail.push_back(e);
-  }
+#ifdef EXPRESSION_COUNT_COPIES
+  copies.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+Expression::Expression(Expression && a) noexcept:
+  inLambda(a.inLambda), m_head(a.m_head), propMap(std::move(a.propMap)), error(a.error),
+  isList(a.isList), islambda(a.islambda), m_tail(std::move(a.m_tail)), m_slot(a.m_slot),
+  m_closure(std::move(a.m_closure)), m_dispatch(a.m_dispatch), m_builtin(a.m_builtin), m_epoch(a.m_epoch),
+  m_cache(a.m_cache.load(std::memory_order_relaxed)){
 }
 
 Expression & Expression::operator=(const Expression & a){
 
   // prevent self-assignment
   if(this != &a){
+#ifdef EXPRESSION_COUNT_COPIES
+    copies.fetch_add(1, std::memory_order_relaxed);
+#endif
     m_head = a.m_head;
 	isList = a.isList;
 	islambda = a.islambda;
 	inLambda = a.inLambda;
 	propMap = a.propMap;
 	error = a.error;
-    m_tail.clear();
-    for(auto e : a.m_tail){
-      m_tail.push_back(e);
-    } 
+    m_tail = a.m_tail;
+    m_slot = a.m_slot;
+    m_closure = a.m_closure;
+    m_dispatch = a.m_dispatch;
+    m_builtin = a.m_builtin;
+    m_epoch = a.m_epoch;
+    m_cache.store(a.m_cache.load(std::memory_order_relaxed), std::memory_order_relaxed);
   }
   
   return *this;
 }
 
+Expression & Expression::operator=(Expression && a) noexcept{
+
+  // prevent self-assignment
+  if(this != &a){
+    m_head = a.m_head;
+	isList = a.isList;
+	islambda = a.islambda;
+	inLambda = a.inLambda;
+	propMap = std::move(a.propMap);
+	error = a.error;
+    m_tail = std::move(a.m_tail);
+    m_slot = a.m_slot;
+    m_closure = std::move(a.m_closure);
+    m_dispatch = a.m_dispatch;
+    m_builtin = a.m_builtin;
+    m_epoch = a.m_epoch;
+    m_cache.store(a.m_cache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  return *this;
+}
+
+std::size_t Expression::copyCount() noexcept{
+#ifdef EXPRESSION_COUNT_COPIES
+  return copies.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
 
 Atom & Expression::head(){
   return m_head;
@@ -58,11 +156,11 @@ const Atom & Expression::head() const{
   return m_head;
 }
 
-std::vector<Expression> & Expression::rTail() {
+ExpressionList & Expression::rTail() {
 	return m_tail;
 }
 
-const std::vector<Expression> & Expression::rTail() const {
+const ExpressionList & Expression::rTail() const {
 	return m_tail;
 }
 
@@ -101,6 +199,14 @@ void Expression::append(const Atom & a){
   m_tail.emplace_back(a);
 }
 
+void Expression::append(const Expression & e){
+  m_tail.push_back(e);
+}
+
+void Expression::append(Expression && e){
+  m_tail.push_back(std::move(e));
+}
+
 
 Expression * Expression::tail(){
   Expression * ptr = nullptr;
@@ -120,7 +226,7 @@ Expression::ConstIteratorType Expression::tailConstEnd() const noexcept{
   return m_tail.cend();
 }
 
-Expression apply(const Atom & op, const std::vector<Expression> & args, const Environment & env){
+Expression apply(const Atom & op, Arguments args, const Environment & env){
 
   // head must be a symbol
   if(!op.isSymbol()){
@@ -128,18 +234,16 @@ Expression apply(const Atom & op, const std::vector<Expression> & args, const En
   }
   
   // must map to a proc
-  if(!env.is_proc(op)){
+  Procedure proc = env.find_proc(op);
+  if(!proc){
     throw SemanticError("Error during evaluation: symbol does not name a procedure");
   }
   
-  // map from symbol to proc
-  Procedure proc = env.get_proc(op);
-  
   // call proc with args
   return proc(args);
 }
 
-Expression Expression::handle_lookup(const Atom & head, const Environment & env){
+Expression Expression::handle_lookup(const Atom & head, const Environment & env) const{
     if(head.isSymbol()){ // if symbol is in env return value
 		if (env.is_lambda_exp(head))
 		{
@@ -168,7 +272,7 @@ Expression Expression::handle_lookup(const Atom & head, const Environment & env)
     }
 }
 
-Expression Expression::handle_begin(Environment & env){
+Expression Expression::handle_begin(Environment & env) const{
   
   if(m_tail.size() == 0){
     throw SemanticError("Error during evaluation: zero arguments to begin");
@@ -176,7 +280,7 @@ Expression Expression::handle_begin(Environment & env){
 
   // evaluate each arg from tail, return the last
   Expression result;
-  for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
+  for(Expression::ConstIteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
     result = it->eval(env);
   }
   
@@ -184,7 +288,7 @@ Expression Expression::handle_begin(Environment & env){
 }
 
 
-Expression Expression::handle_define(Environment & env){
+Expression Expression::handle_define(Environment & env) const{
 
   // tail must have size 3 or error
   if(m_tail.size() != 2){
@@ -197,8 +301,8 @@ Expression Expression::handle_define(Environment & env){
   }
 
   // but tail[0] must not be a special-form or procedure
-  std::string s = m_tail[0].head().asSymbol();
-  if((s == "define") || (s == "begin")){
+  SymbolId s = m_tail[0].head().symbolId();
+  if((s == DEFINE_ID) || (s == BEGIN_ID)){
     throw SemanticError("Error during evaluation: attempt to redefine a special-form");
   }
   
@@ -211,19 +315,27 @@ Expression Expression::handle_define(Environment & env){
 
   // eval tail[1]
   Expression result = m_tail[1].eval(env);
-  if (result.isLLambda())
-  {
-	  islambda = true;
-  }
-  if (result.islambdaexp)
-  {
-	  islambdaexp = true;
+
+  return bind_define(env, result);
+}
+
+Expression Expression::bind_define(Environment & env, const Expression & result) const{
+
+  // a symbol defined in a lambda body lives in the call's frame
+  Frame * frame = Frame::current();
+  int slot = m_tail.front().m_slot;
+  if((slot >= 0) && frame && (static_cast<std::size_t>(slot) < frame->size())){
+    frame->bind(slot, result);
+    return result;
   }
 
+  bool lambdaValue = islambda || result.isLLambda();
+  bool lambdaExp = islambdaexp || result.islambdaexp;
+
   //and add to env
-  if (!islambda)
+  if (!lambdaValue)
   {
-	  if (!islambdaexp)
+	  if (!lambdaExp)
 	  {
 		  //throw SemanticError("also incorrect");
 		  if (env.is_exp(m_head)) {
@@ -253,7 +365,7 @@ Expression Expression::handle_define(Environment & env){
 }
 
 
-Expression Expression::handle_list(Environment & env)
+Expression Expression::handle_list(Environment & env) const
 {
 	Expression result;
 	result.isList = true;
@@ -264,41 +376,73 @@ Expression Expression::handle_list(Environment & env)
 	}
 	else
 	{
-		for (Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it) {
+		result.m_tail.reserve(m_tail.size());
+		for (Expression::ConstIteratorType it = m_tail.begin(); it != m_tail.end(); ++it) {
 			result.m_tail.push_back(it->eval(env));
 		}
+		result.m_tail.pack();
 	}
 	return result;
 }
 
 
-Expression Expression::handle_lambda()
+Expression Expression::handle_lambda() const
 {
 	if (m_tail.size() == 0)
 	{
 		throw SemanticError("Error during evaluation: zero arguments to lambda");
 	}
-	Expression s1;
-	Expression s2;
 	//lists
 	Expression result;
 	Expression arguments;
-	Expression procedure;
 	std::size_t length = m_tail.size();
 	if (length == 2)
 	{
-		s1 = m_tail[0];
-		s2 = m_tail[1];
+		const Expression & s1 = m_tail[0];
 		std::size_t s1Length = s1.m_tail.size();
+		arguments.rTail().reserve(s1Length + 1);
 		arguments.rTail().push_back(s1.m_head);
 		for (std::size_t i = 0; i < s1Length; i++)
 		{
 			arguments.rTail().push_back(s1.m_tail[i]);
 		}
-		procedure = s2;
 		arguments.setLList(true);
-		result.rTail().push_back(arguments);
-		result.rTail().push_back(procedure);
+
+		// the slots: parameters, then symbols defined in the body, then the
+		// symbols of the enclosing frame the body (or a nested lambda) uses
+		std::shared_ptr<Closure> closure = std::make_shared<Closure>();
+		for (auto & a : arguments.m_tail)
+		{
+			closure->names.push_back(a.m_head.isSymbol() ? a.m_head.symbolId() : 0);
+		}
+		closure->params = closure->names.size();
+		const Expression & body = m_tail[1];
+		body.collect_locals(closure->names);
+		closure->locals = closure->names.size() - closure->params;
+		Frame * enclosing = Frame::current();
+		if (enclosing)
+		{
+			std::vector<SymbolId> used;
+			body.collect_symbols(used);
+			for (SymbolId sym : used)
+			{
+				int slot = enclosing->closure().find(sym);
+				if ((slot >= 0) && enclosing->bound(slot) && (closure->find(sym) < 0))
+				{
+					closure->names.push_back(sym);
+					closure->captured.push_back((*enclosing)[slot]);
+				}
+			}
+		}
+
+		result.rTail().reserve(2);
+		result.rTail().push_back(std::move(arguments));
+		// the resolved body is immutable, every call evaluates it in place
+		Expression prepared = body.resolved(*closure);
+		prepared.inLambda = body.inLambda;
+		closure->pure = !prepared.writes_environment();
+		result.rTail().push_back(std::move(prepared));
+		result.m_closure = std::move(closure);
 	}
 	else
 	{
@@ -308,58 +452,631 @@ Expression Expression::handle_lambda()
 	return result;
 }
 
-Expression Expression::handle_lambda_lookup(const Atom & head, Environment & env)
+// true if the head names a special form, those are never resolved to slots
+static bool is_special_form(const Atom & head)
 {
-	Expression result;
-	Expression stage1 = env.get_lambda(head);
+	SymbolId s = head.symbolId();
+	return (s == LIST_ID) || (s == BEGIN_ID) || (s == DEFINE_ID) || (s == APPLY_ID) ||
+		(s == MAP_ID) || (s == PMAP_ID) || (s == REDUCE_ID) || (s == FOLD_ID) || (s == SETPROP_ID) || (s == GETPROP_ID) || (s == DISCPLOT_ID) ||
+		(s == CONTPLOT_ID) || (s == LAMBDA_ID) || (s == IF_ID) || (s == COND_ID) ||
+		(s == AND_ID) || (s == OR_ID) || (s == DO_ID) || (s == WHILE_ID) || (s == FOREACH_ID);
+}
+
+// the evaluated arguments of the procedure calls in progress on this thread,
+// reused so that calls do not allocate
+static thread_local std::vector<Expression> argumentStack;
 
-	Expression arguments = stage1.m_tail[0];
-	Expression operations = stage1.m_tail[1];
-	result = operations;
+namespace {
 
+// pops the arguments a call pushed, also when evaluating one of them throws
+struct ArgumentScope {
+  std::size_t base;
+  ArgumentScope(): base(argumentStack.size()){}
+  explicit ArgumentScope(std::size_t base): base(base){}
+  ~ArgumentScope(){
+    argumentStack.erase(argumentStack.begin() + base, argumentStack.end());
+  }
+};
+
+// the most lambda calls nested on one thread, calls in tail position reuse
+// their frame and do not count
+const std::size_t MaxCallDepth = 1024;
+
+// the C++ stack left for the innermost call, a quarter of the stack of the
+// thread but at least StackReserveMin and at most half of it; a call takes a
+// few kilobytes, more when its body nests deeply
+const std::uintptr_t StackReserveMin = 256 * 1024;
+
+// the stack the nested calls of a thread may use where the platform cannot
+// tell the size of the stack, a little under the smallest common default
+const std::uintptr_t FallbackStackUse = 768 * 1024;
+
+// the lowest address and the size of the stack of this thread, a size of 0
+// where the platform cannot tell
+void thread_stack(std::uintptr_t & low, std::uintptr_t & size)
+{
+  low = 0;
+  size = 0;
+#if defined(__linux__)
+  pthread_attr_t attr;
+  if(pthread_getattr_np(pthread_self(), &attr) == 0){
+    void * addr;
+    std::size_t bytes;
+    if(pthread_attr_getstack(&attr, &addr, &bytes) == 0){
+      low = reinterpret_cast<std::uintptr_t>(addr);
+      size = bytes;
+    }
+    pthread_attr_destroy(&attr);
+  }
+#elif defined(__APPLE__)
+  size = pthread_get_stacksize_np(pthread_self());
+  low = reinterpret_cast<std::uintptr_t>(pthread_get_stackaddr_np(pthread_self())) - size;
+#endif
+}
+
+// the lambda calls in progress on this thread, and the lowest stack address
+// a call may start at, the stack grows down towards it
+thread_local std::size_t callDepth = 0;
+thread_local std::uintptr_t callStackLimit = 0;
+thread_local bool callStackKnown = false;
+
+// counts a lambda call for as long as it runs, a call nested too deep throws
+// rather than overflow the C++ stack
+struct CallDepthScope {
+  CallDepthScope(){
+    char marker;
+    std::uintptr_t here = reinterpret_cast<std::uintptr_t>(&marker);
+    if(!callStackKnown){
+      std::uintptr_t low, size;
+      thread_stack(low, size);
+      if(size > 0){
+	callStackLimit = low + std::min(std::max(size / 4, StackReserveMin), size / 2);
+      }
+      callStackKnown = (size > 0);
+    }
+    if(!callStackKnown && (callDepth == 0)){
+      callStackLimit = (here > FallbackStackUse) ? here - FallbackStackUse : 0;
+    }
+    if((callDepth == MaxCallDepth) || (here < callStackLimit)){
+      throw SemanticError("Error during evaluation: maximum recursion depth exceeded");
+    }
+    ++callDepth;
+  }
+  ~CallDepthScope(){
+    --callDepth;
+  }
+};
+
+// move the arguments pushed since base into the parameter slots of frame
+void take_arguments(Frame & frame, std::size_t base)
+{
+	for (std::size_t i = base; i < argumentStack.size(); ++i)
+	{
+		frame[i - base] = std::move(argumentStack[i]);
+	}
+	argumentStack.erase(argumentStack.begin() + base, argumentStack.end());
+}
+
+}
+
+// a parameter of a lambda must be a symbol that does not name a special form
+static void check_parameter(const Atom & name)
+{
+	if (!name.isSymbol())
+	{
+		throw SemanticError("Error during evaluation: first argument to define not symbol");
+	}
+	if ((name.symbolId() == DEFINE_ID) || (name.symbolId() == BEGIN_ID))
+	{
+		throw SemanticError("Error during evaluation: attempt to redefine a special-form");
+	}
+}
+
+// evaluate the arguments of a call to lambda onto the argument stack, in the
+// frame of the caller
+void Expression::push_arguments(const Expression & lambda, Environment & env) const
+{
+	const Expression & arguments = lambda.m_tail.front();
 	std::size_t lengtharg = arguments.m_tail.size();
-	if (m_tail.size() == lengtharg)
+	if (m_tail.size() != lengtharg)
 	{
-		for (std::size_t i = 0; i < lengtharg; i++)
+		throw SemanticError("Error in call to procedure: invalid number of arguments.");
+	}
+	for (std::size_t i = 0; i < lengtharg; i++)
+	{
+		check_parameter(arguments.m_tail[i].head());
+		argumentStack.push_back(m_tail[i].eval(env));
+	}
+}
+
+// Calls a lambda with the arguments of this call, see run_lambda
+Expression Expression::handle_lambda_call(const Expression & lambda, Environment & env) const
+{
+	ArgumentScope scope;
+	push_arguments(lambda, env);
+	return run_lambda(lambda, env, scope.base);
+}
+
+// Calls a lambda with the arguments pushed since base. A memoized lambda
+// called with Numbers looks for the result of an earlier call in its
+// MemoTable first, and records the result if there is none. A call that
+// throws records nothing.
+Expression Expression::run_lambda(const Expression & lambda, Environment & env, std::size_t base) const
+{
+	MemoTable * memo = lambda.m_closure->memo.get();
+	MemoKey key;
+	if (!memo || !memo_key(base, key))
+	{
+		return run_body(lambda, env, base);
+	}
+
+	std::uint32_t generation = env.generation();
+	Expression result;
+	if (memo->find(key, generation, result))
+	{
+		argumentStack.erase(argumentStack.begin() + base, argumentStack.end());
+		return result;
+	}
+	result = run_body(lambda, env, base);
+	memo->insert(key, generation, result);
+	return result;
+}
+
+// the key of the arguments pushed since base, false unless they are at most
+// MemoKey::MaxArguments plain Numbers
+bool Expression::memo_key(std::size_t base, MemoKey & key)
+{
+	std::size_t count = argumentStack.size() - base;
+	if (count > MemoKey::MaxArguments)
+	{
+		return false;
+	}
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const Expression & arg = argumentStack[base + i];
+		if (!arg.isHeadNumber() || !arg.m_tail.empty() || !arg.propMap.empty())
 		{
-			Expression args(Atom("define"));
-			args.append(arguments.m_tail[i].head());
-			Expression argi = m_tail[i].eval(env);
-			args.rTail().emplace_back(argi);
-			args.islambdaexp = true;
-			args.handle_define(env);
+			return false;
 		}
-		helperinL(operations);
-		result = operations.eval(env);
+		key.values[i] = arg.m_head.asNumber();
 	}
-	else
+	key.count = count;
+	return true;
+}
+
+// Runs the body of a lambda with the arguments pushed since base. The body is evaluated
+// in a loop that follows the expressions in tail position, the last of a
+// begin, the branch of an if or cond and the last operand of and/or. A call to
+// a lambda found there reuses the frame instead of recursing, so tail
+// recursion runs in constant C++ stack space. A memoized lambda is called
+// instead, so its table sees the call. Calls nested more than MaxCallDepth
+// deep, or leaving too little of the thread's stack, throw.
+Expression Expression::run_body(const Expression & lambda, Environment & env, std::size_t base) const
+{
+	ArgumentScope scope(base);
+	CallDepthScope depth;
+	Frame frame(*lambda.m_closure);
+	take_arguments(frame, scope.base);
+	Frame::Activation activation(frame);
+
+	// the lambda of a tail call, it owns the closure of the frame and the body
+	Expression callee;
+
+	// the body is shared by every call, it was prepared when the lambda was created
+	const Expression * node = &lambda.m_tail.back();
+	while (true)
 	{
-		throw SemanticError("Error in call to procedure: invalid number of arguments.");
+		if (interupt == true)
+		{
+			interupt = false;
+			throw SemanticError("Error: interpreter kernel interrupted");
+		}
+		switch (node->dispatch())
+		{
+		case Dispatch::Begin:
+			for (auto it = node->m_tail.begin(); it + 1 < node->m_tail.end(); ++it)
+			{
+				it->eval(env);
+			}
+			node = &node->m_tail.back();
+			continue;
+		case Dispatch::If:
+			node = &node->if_branch(env);
+			continue;
+		case Dispatch::Cond:
+			node = node->cond_branch(env);
+			continue;
+		case Dispatch::And:
+		case Dispatch::Or:
+		{
+			Expression result;
+			node = node->logic_operands(env, result);
+			if (!node)
+			{
+				return result;
+			}
+			continue;
+		}
+		case Dispatch::Call:
+		{
+			const Expression * next = node->lambda_callee(env);
+			if (next && !next->m_closure->memo)
+			{
+				node->push_arguments(*next, env);
+				// next may be in a slot of the frame, copy it before the reset
+				Expression tail(*next);
+				frame.reset(*tail.m_closure);
+				take_arguments(frame, scope.base);
+				callee = std::move(tail);
+				node = &callee.m_tail.back();
+				continue;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		return node->eval(env);
+	}
+}
+
+// the lambda a Call calls: one in a slot of the current frame, or one in the
+// environment unless the head names a built-in procedure
+const Expression * Expression::lambda_callee(const Environment & env) const
+{
+	if (is_slot_lambda())
+	{
+		return &(*Frame::current())[m_slot];
+	}
+	const Builtin * builtin = (m_epoch == env.epoch()) ? m_builtin : nullptr;
+	return builtin ? nullptr : cached_binding(env, true);
+}
+
+// conditions are Numbers, 0 is false and any other Number true
+static bool is_true(const Expression & condition)
+{
+	if (!condition.isHeadNumber())
+	{
+		throw SemanticError("Error during evaluation: condition not a number");
+	}
+	return condition.head().asNumber() != 0;
+}
+
+// evaluate the condition of an if and return the branch it selects
+const Expression & Expression::if_branch(Environment & env) const
+{
+	if (m_tail.size() != 3)
+	{
+		throw SemanticError("Error during evaluation: invalid number of arguments to if");
+	}
+	return is_true(m_tail[0].eval(env)) ? m_tail[1] : m_tail[2];
+}
+
+// evaluate the conditions of a cond up to the first true one and return the
+// expression it selects, or the default after the last pair
+const Expression * Expression::cond_branch(Environment & env) const
+{
+	std::size_t pairs = m_tail.size() / 2;
+	for (std::size_t i = 0; i < pairs; ++i)
+	{
+		if (is_true(m_tail[2 * i].eval(env)))
+		{
+			return &m_tail[2 * i + 1];
+		}
+	}
+	if (m_tail.size() % 2 == 1)
+	{
+		return &m_tail.back();
 	}
+	throw SemanticError("Error during evaluation: no condition of cond is true");
+}
+
+// Evaluates do, while and for-each. The loop variables are the slots of a
+// frame, like the parameters of a lambda: the parts evaluated in the loop
+// are resolved against them once, and every iteration evaluates the steps
+// onto the argument stack and moves the values into the slots. The initial
+// values, and the list of a for-each, are evaluated outside the loop.
+Expression Expression::handle_loop(Environment & env) const
+{
+	bool forEach = (dispatch() == Dispatch::ForEach);
+	bool untilTrue = (dispatch() == Dispatch::Do);
+
+	// for-each starts with (<symbol> <list>), do and while end with the condition
+	if (m_tail.size() < 2)
+	{
+		throw SemanticError("Error during evaluation: invalid number of arguments to loop");
+	}
+	std::size_t first = forEach ? 1 : 0;
+	std::size_t last = m_tail.size() - (forEach ? 1 : 2);
+	for (std::size_t i = 0; i < last; ++i)
+	{
+		const Expression & binding = m_tail[i];
+		std::size_t parts = binding.m_tail.size();
+		if (!binding.isHeadSymbol() || (parts == 0) || (parts > ((i < first) ? 1u : 2u)) ||
+			is_special_form(binding.m_head))
+		{
+			throw SemanticError("Error during evaluation: invalid loop variable");
+		}
+	}
+
+	// the slots: loop variables, then symbols defined in the loop, then the
+	// symbols of the enclosing frame the loop uses
+	Closure closure;
+	for (std::size_t i = 0; i < last; ++i)
+	{
+		closure.names.push_back(m_tail[i].m_head.symbolId());
+	}
+	closure.params = closure.names.size();
+	std::vector<const Expression *> parts;
+	for (std::size_t i = first; i < last; ++i)
+	{
+		if (m_tail[i].m_tail.size() == 2)
+		{
+			parts.push_back(&m_tail[i].m_tail[1]);
+		}
+	}
+	std::size_t steps = parts.size();
+	for (std::size_t i = last; i < m_tail.size(); ++i)
+	{
+		parts.push_back(&m_tail[i]);
+	}
+	for (auto part : parts)
+	{
+		part->collect_locals(closure.names);
+	}
+	closure.locals = closure.names.size() - closure.params;
+	Frame * enclosing = Frame::current();
+	if (enclosing)
+	{
+		std::vector<SymbolId> used;
+		for (auto part : parts)
+		{
+			part->collect_symbols(used);
+		}
+		for (SymbolId sym : used)
+		{
+			int slot = enclosing->closure().find(sym);
+			if ((slot >= 0) && enclosing->bound(slot) && (closure.find(sym) < 0))
+			{
+				closure.names.push_back(sym);
+				closure.captured.push_back((*enclosing)[slot]);
+			}
+		}
+	}
+
+	ArgumentScope scope;
+	for (std::size_t i = 0; i < last; ++i)
+	{
+		argumentStack.push_back(m_tail[i].m_tail[0].eval(env));
+	}
+	Expression list;
+	if (forEach)
+	{
+		list = std::move(argumentStack[scope.base]);
+		if (!list.isList)
+		{
+			throw SemanticError("Error during evaluation: for-each over a value that is not a list");
+		}
+	}
+
+	std::vector<Expression> prepared;
+	prepared.reserve(parts.size());
+	for (auto part : parts)
+	{
+		prepared.push_back(part->resolved(closure));
+	}
+
+	Frame frame(closure);
+	take_arguments(frame, scope.base);
+	Frame::Activation activation(frame);
+
+	// the slots the steps assign, in order
+	std::vector<std::size_t> stepped;
+	for (std::size_t i = first; i < last; ++i)
+	{
+		if (m_tail[i].m_tail.size() == 2)
+		{
+			stepped.push_back(i);
+		}
+	}
+
+	// the empty list holds the empty symbol, a pending range is walked
+	// without generating it
+	std::size_t count = (forEach && (list.m_tail.packed() || !list.m_tail.headAt(0).isSymbol())) ?
+		list.m_tail.size() : 0;
+	double num = 0, step = 0;
+	bool pending = forEach && list.m_tail.pending(num, step);
+	for (std::size_t index = 0; ; ++index)
+	{
+		if (interupt == true)
+		{
+			interupt = false;
+			throw SemanticError("Error: interpreter kernel interrupted");
+		}
+		if (forEach)
+		{
+			if (index == count)
+			{
+				break;
+			}
+			if (pending)
+			{
+				frame[0] = Expression(num);
+				num += step;
+			}
+			else
+			{
+				frame[0] = list.m_tail.packed() ? Expression(list.m_tail.headAt(index)) : list.m_tail[index];
+			}
+		}
+		else if (is_true(prepared[steps].eval(env)) == untilTrue)
+		{
+			break;
+		}
+		for (std::size_t i = 0; i < steps; ++i)
+		{
+			argumentStack.push_back(prepared[i].eval(env));
+		}
+		for (std::size_t i = 0; i < steps; ++i)
+		{
+			frame[stepped[i]] = std::move(argumentStack[scope.base + i]);
+		}
+		argumentStack.erase(argumentStack.begin() + scope.base, argumentStack.end());
+	}
+	return prepared.back().eval(env);
+}
+
+// evaluate the operands of and/or but the last. The first false operand of an
+// and, or true operand of an or, decides the value: it is stored in result and
+// nullptr returned. Otherwise returns the last operand, which is the value.
+const Expression * Expression::logic_operands(Environment & env, Expression & result) const
+{
+	bool isAnd = (dispatch() == Dispatch::And);
+	for (std::size_t i = 0; i + 1 < m_tail.size(); ++i)
+	{
+		result = m_tail[i].eval(env);
+		if (is_true(result) != isAnd)
+		{
+			return nullptr;
+		}
+	}
+	return &m_tail.back();
+}
+
+bool Expression::is_slot_lambda() const
+{
+	Frame * frame = Frame::current();
+	return (m_slot >= 0) && frame && (static_cast<std::size_t>(m_slot) < frame->size()) &&
+		frame->bound(m_slot) && (*frame)[m_slot].isLLambda();
+}
+
+void Expression::collect_locals(std::vector<SymbolId> & names) const
+{
+	// nested lambdas have their own frames
+	if (m_head.isSymbol() && m_head.symbolId() == LAMBDA_ID)
+	{
+		return;
+	}
+	if (m_head.isSymbol() && (m_head.symbolId() == DEFINE_ID) && (m_tail.size() == 2) &&
+		m_tail.front().isHeadSymbol())
+	{
+		SymbolId sym = m_tail.front().head().symbolId();
+		if (std::find(names.begin(), names.end(), sym) == names.end())
+		{
+			names.push_back(sym);
+		}
+	}
+	for (auto & e : m_tail)
+	{
+		e.collect_locals(names);
+	}
+}
+
+// true if evaluating the resolved body of a lambda may define a symbol in
+// the environment: a define outside nested lambdas whose symbol has no slot
+bool Expression::writes_environment() const
+{
+	if (m_head.isSymbol() && m_head.symbolId() == LAMBDA_ID)
+	{
+		return false;
+	}
+	if (m_head.isSymbol() && (m_head.symbolId() == DEFINE_ID) &&
+		(m_tail.empty() || (m_tail.front().m_slot < 0)))
+	{
+		return true;
+	}
+	for (auto & e : m_tail)
+	{
+		if (e.writes_environment())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+Expression Expression::memoized(std::size_t capacity) const
+{
+	if (!islambda || !m_closure)
+	{
+		throw SemanticError("Error: argument to memoize is not a procedure");
+	}
+	if (!m_closure->pure)
+	{
+		throw SemanticError("Error: argument to memoize defines a symbol in the environment");
+	}
+	std::shared_ptr<Closure> closure = std::make_shared<Closure>(*m_closure);
+	closure->memo = std::make_shared<MemoTable>(capacity);
+	Expression result(*this);
+	result.m_closure = std::move(closure);
 	return result;
 }
 
-void Expression::helperinL(Expression & oper)
+void Expression::collect_symbols(std::vector<SymbolId> & names) const
 {
-	for (size_t i = 0; i < oper.rTail().size(); i++)
+	if (m_head.isSymbol() && (m_head.symbolId() != 0) &&
+		(std::find(names.begin(), names.end(), m_head.symbolId()) == names.end()))
+	{
+		names.push_back(m_head.symbolId());
+	}
+	for (auto & e : m_tail)
 	{
-		oper.rTail()[i].inLambda = true;
-		helperinL(oper.rTail()[i]);
+		e.collect_symbols(names);
 	}
 }
 
-Expression Expression::handle_apply(Environment & env)
+Expression Expression::resolved(const Closure & closure) const
+{
+	// nested lambdas are resolved when they are created, folded lists are
+	// values and hold no symbols
+	if ((m_head.isSymbol() && m_head.symbolId() == LAMBDA_ID) || isList)
+	{
+		return *this;
+	}
+	Expression result(*this);
+	result.m_slot = -1;
+	result.inLambda = true;
+	if (m_head.isSymbol() && (m_head.symbolId() != 0) && !is_special_form(m_head))
+	{
+		result.m_slot = closure.find(m_head.symbolId());
+	}
+	if (!m_tail.empty())
+	{
+		ExpressionList tail;
+		tail.reserve(m_tail.size());
+		for (auto & e : m_tail)
+		{
+			tail.push_back(e.resolved(closure));
+		}
+		result.m_tail = std::move(tail);
+	}
+	return result;
+}
+
+// a call with the first argument of map or apply as its head and builtin, the
+// procedure it names, so map looks the procedure up once for every element
+Expression Expression::make_callee_call(const Builtin * builtin, const Environment & env) const
+{
+	Expression expr(m_tail[0].head());
+	expr.m_slot = m_tail[0].m_slot;
+	expr.m_dispatch = Dispatch::Call;
+	expr.m_builtin = builtin;
+	expr.m_epoch = env.epoch();
+	return expr;
+}
+
+Expression Expression::handle_apply(Environment & env) const
 {
 	//check the head/tail for relevent vars
 	Expression result;
 
-	if ((env.is_proc(m_tail[0].head()) || env.is_lambda(m_tail[0].head())) && (m_tail[0].m_tail.empty()))
+	if ((env.is_proc(m_tail[0].head()) || env.is_lambda(m_tail[0].head()) || m_tail[0].is_slot_lambda()) && (m_tail[0].m_tail.empty()))
 	{
 		Expression list = m_tail[1].eval(env);
 		if (list.isLList())
 		{
-			Expression expr(m_tail[0].head());
-			expr.m_tail = list.m_tail;
+			Expression expr = make_callee_call(env.find_builtin(m_tail[0].head()), env);
+			expr.m_tail = std::move(list.m_tail);
 			try
 			{
 			result = expr.eval(env);
@@ -383,63 +1100,377 @@ Expression Expression::handle_apply(Environment & env)
 	return result;
 }
 
-Expression Expression::handle_map(Environment & env)
+// the argument a map passes for a value of the list it maps over: the head
+// of the value, evaluated unless it is a plain number
+static Atom map_input(const Expression & value, Environment & env)
+{
+	if (value.tailConstBegin() == value.tailConstEnd() && (value.isHeadNumber() || value.isHeadComplex()))
+	{
+		return value.head();
+	}
+	return value.eval(env).head();
+}
+
+// A map over the result of other maps runs as one pass: each element goes
+// through all the procedures, innermost first, and only the final list is
+// built. Errors are reported as if each map ran in turn: a failure in an
+// inner map wins over one in an outer map, and within a map the first element
+// that fails wins. A pending range is walked without generating it.
+Expression Expression::handle_map(Environment & env) const
 {
 	//check the head/tail for relevent vars
 	Expression resultf;
 
-	if ((env.is_proc(m_tail[0].head()) || env.is_lambda(m_tail[0].head())) && (m_tail[0].m_tail.empty()))
+	// the maps of the chain, outermost first
+	std::vector<const Expression *> maps;
+	const Expression * node = this;
+	while (true)
 	{
-		Expression list = m_tail[1].eval(env);
-		if (list.isLList())
+		if (!((env.is_proc(node->m_tail[0].head()) || env.is_lambda(node->m_tail[0].head()) || node->m_tail[0].is_slot_lambda()) && (node->m_tail[0].m_tail.empty())))
+		{
+			throw SemanticError("Error: first argument to map not a procedure");
+		}
+		maps.push_back(node);
+		const Expression & source = node->m_tail[1];
+		if ((source.dispatch() != Dispatch::Map) || (source.m_tail.size() < 2))
 		{
+			break;
+		}
+		node = &source;
+	}
 
-			
-			std::size_t listL = list.m_tail.size();
-			for (std::size_t i = 0; i < listL; i++)
-			{
-				Expression expr(m_tail[0].head());
-				Expression result1;
-				Expression temp = list.m_tail[i].eval(env);
+	Expression list = maps.back()->m_tail[1].eval(env);
+	if (!list.isLList())
+	{
+		throw SemanticError("Error: second argument to map not a list");
+	}
+
+	// the procedures, innermost first
+	std::size_t stages = maps.size();
+	std::vector<const Builtin *> builtins;
+	for (std::size_t s = stages; s-- > 0; )
+	{
+		builtins.push_back(env.find_builtin(maps[s]->m_tail[0].head()));
+	}
+
+	double num = 0, step = 0;
+	bool pending = list.m_tail.pending(num, step);
+	std::size_t listL = list.m_tail.size();
+	resultf.rTail().reserve(listL);
+
+	// the innermost map that failed, and its first error
+	std::size_t failed = stages;
+	std::string error;
+	for (std::size_t i = 0; (i < listL) && (failed > 0); i++)
+	{
+		Atom input;
+		if (pending)
+		{
+			input = Atom(num);
+			num += step;
+		}
+		else if (list.m_tail.packed())
+		{
+			// packed elements are plain numbers, they evaluate to themselves
+			input = list.m_tail.headAt(i);
+		}
+		else
+		{
+			input = list.m_tail[i].eval(env).head();
+		}
 
-				expr.append(temp.head());
+		Expression result1;
+		for (std::size_t s = 0; s < failed; s++)
+		{
+			if (s > 0)
+			{
+				// a map reads the elements of its list before calling its procedure
 				try
 				{
-					 result1 = expr.eval(env);
+					input = map_input(result1, env);
 				}
-				catch (SemanticError e)
+				catch (const SemanticError & e)
 				{
-					std::string t = e.what();
-					std::string output = "Error: during map: " + t;
-					throw SemanticError(output);
+					error = e.what();
+					failed = s;
+					break;
 				}
-				resultf.rTail().emplace_back(result1);
-				resultf.setLList(true);
+			}
+			Expression expr = maps[stages - 1 - s]->make_callee_call(builtins[s], env);
+			expr.append(input);
+			try
+			{
+				result1 = expr.eval(env);
+			}
+			catch (const SemanticError & e)
+			{
+				std::string t = e.what();
+				error = "Error: during map: " + t;
+				failed = s;
 			}
 		}
-		else
+		if (failed == stages)
 		{
-			throw SemanticError("Error: second argument to map not a list");
+			resultf.rTail().push_back(std::move(result1));
 		}
 	}
-	else
+	if (failed < stages)
+	{
+		throw SemanticError(error);
+	}
+	if (listL > 0)
+	{
+		resultf.setLList(true);
+	}
+	resultf.rTail().pack();
+	return resultf;
+}
+
+// Maps a procedure over a list on the threads of the shared ThreadPool. The
+// procedure is looked up and the elements evaluated on the calling thread,
+// only the calls run in parallel. The result and any error are the ones map
+// gives: elements after one that fails are skipped, and the failure with the
+// lowest index is reported. The environment is only read meanwhile.
+Expression Expression::handle_pmap(Environment & env) const
+{
+	if ((m_tail.size() != 2) || !((env.is_proc(m_tail[0].head()) || env.is_lambda(m_tail[0].head()) || m_tail[0].is_slot_lambda()) && (m_tail[0].m_tail.empty())))
 	{
 		throw SemanticError("Error: first argument to map not a procedure");
 	}
+
+	Expression list = m_tail[1].eval(env);
+	if (!list.isLList())
+	{
+		throw SemanticError("Error: second argument to map not a list");
+	}
+
+	// the procedure: a lambda, copied so it outlives the caller's frame, or
+	// a builtin called through a call node the workers share
+	Expression call = make_callee_call(env.find_builtin(m_tail[0].head()), env);
+	Expression lambda;
+	if (const Expression * callee = call.lambda_callee(env))
+	{
+		lambda = *callee;
+	}
+	call.m_slot = -1;
+
+	// the arguments, up to the first element that fails to evaluate
+	std::size_t listL = list.m_tail.size();
+	std::vector<Atom> inputs;
+	inputs.reserve(listL);
+	std::string elementError;
+	double num = 0, step = 0;
+	bool pending = list.m_tail.pending(num, step);
+	for (std::size_t i = 0; i < listL; i++)
+	{
+		if (pending)
+		{
+			inputs.push_back(Atom(num));
+			num += step;
+		}
+		else if (list.m_tail.packed())
+		{
+			inputs.push_back(list.m_tail.headAt(i));
+		}
+		else
+		{
+			try
+			{
+				inputs.push_back(list.m_tail[i].eval(env).head());
+			}
+			catch (const SemanticError & e)
+			{
+				elementError = e.what();
+				break;
+			}
+		}
+	}
+
+	std::size_t count = inputs.size();
+	std::vector<Expression> results(count);
+	std::atomic<std::size_t> failed(count);
+	std::atomic<bool> cancelled(false);
+	std::mutex errorMutex;
+	std::string error;
+
+	ThreadPool & pool = ThreadPool::shared();
+	std::size_t grain = std::max<std::size_t>(4, count / (8 * (pool.workers() + 1)));
+	{
+		Environment::Sharing sharing(env);
+		pool.parallel_for(count, grain, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; (i < end) && (i < failed.load()) && !cancelled.load(); i++)
+			{
+				Expression expr(call);
+				expr.append(inputs[i]);
+				try
+				{
+					results[i] = lambda.isLLambda() ? expr.handle_lambda_call(lambda, env) : expr.eval(env);
+				}
+				catch (const SemanticError & e)
+				{
+					std::string t = e.what();
+					std::lock_guard<std::mutex> lock(errorMutex);
+					if (t == "Error: interpreter kernel interrupted")
+					{
+						// stop every thread, not just the one that saw it
+						cancelled.store(true);
+						error = "Error: during map: " + t;
+					}
+					else if ((i < failed.load()) && !cancelled.load())
+					{
+						failed.store(i);
+						error = "Error: during map: " + t;
+					}
+				}
+			}
+		});
+	}
+	if (cancelled.load() || (failed.load() < count))
+	{
+		throw SemanticError(error);
+	}
+	if (count < listL)
+	{
+		throw SemanticError(elementError);
+	}
+
+	Expression resultf;
+	resultf.rTail().reserve(count);
+	for (auto & result : results)
+	{
+		resultf.rTail().push_back(std::move(result));
+	}
+	if (count > 0)
+	{
+		resultf.setLList(true);
+	}
+	resultf.rTail().pack();
 	return resultf;
 }
 
-Expression Expression::handle_setprop(Environment & env)
+// Folds a list from the left with a procedure of two arguments: (reduce f l)
+// starts from the first element of l and (fold f init l) from init. The
+// elements are passed as they are, without copying the list. A builtin with
+// a reduce entry point, such as + or max, reduces a packed list of Numbers in
+// one call, in parallel for long lists, see realReduce in kernels.hpp.
+Expression Expression::handle_reduce(Environment & env) const
 {
-	if (m_tail.size() == 3)
+	bool isFold = (dispatch() == Dispatch::Fold);
+	std::string name = isFold ? "fold" : "reduce";
+	std::size_t arity = isFold ? 3 : 2;
+	if (m_tail.size() != arity)
+	{
+		throw SemanticError("Error: invalid number of arguments to " + name);
+	}
+	const Expression & procedure = m_tail[0];
+	if (!((env.is_proc(procedure.head()) || env.is_lambda(procedure.head()) || procedure.is_slot_lambda()) && (procedure.m_tail.empty())))
+	{
+		throw SemanticError("Error: first argument to " + name + " not a procedure");
+	}
+
+	Expression result;
+	if (isFold)
+	{
+		result = m_tail[1].eval(env);
+	}
+	Expression list = m_tail[arity - 1].eval(env);
+	if (!list.isLList())
+	{
+		throw SemanticError("Error: " + std::string(isFold ? "third" : "second") + " argument to " + name + " not a list");
+	}
+	const ExpressionList & items = list.m_tail;
+	std::size_t count = (!items.empty() && (items.packed() || !items.headAt(0).isSymbol())) ? items.size() : 0;
+	if (!isFold && (count == 0))
+	{
+		throw SemanticError("Error: reduce of an empty list");
+	}
+
+	Expression call = make_callee_call(env.find_builtin(procedure.head()), env);
+	const Expression * lambda = call.lambda_callee(env);
+	const Builtin * builtin = lambda ? nullptr : call.m_builtin;
+	try
 	{
-		for (int i = 0; i < 3; i++)
+		std::size_t first = 0;
+		if (builtin && builtin->reduce && items.reals() && (count > 0))
 		{
-			m_tail[i] = m_tail[i].eval(env);
+			Expression reduced = builtin->reduce(items);
+			first = count;
+			if (!isFold)
+			{
+				return reduced;
+			}
+			result = builtin->binary(result, reduced);
 		}
-		if (m_tail[0].head().isString())
+		else if (!isFold)
 		{
-			m_tail[2].add_prop(m_tail[0].head(), m_tail[1]);
+			result = items.packed() ? Expression(items.headAt(0)) : items[0];
+			first = 1;
+		}
+
+		if (lambda && (first < count))
+		{
+			const Expression & parameters = lambda->m_tail.front();
+			if (parameters.m_tail.size() != 2)
+			{
+				throw SemanticError("Error in call to procedure: invalid number of arguments.");
+			}
+			for (auto & parameter : parameters.m_tail)
+			{
+				check_parameter(parameter.head());
+			}
+		}
+
+		for (std::size_t i = first; i < count; i++)
+		{
+			if (interupt == true)
+			{
+				interupt = false;
+				throw SemanticError("Error: interpreter kernel interrupted");
+			}
+			Expression packedItem;
+			if (items.packed())
+			{
+				packedItem = Expression(items.headAt(i));
+			}
+			const Expression & item = items.packed() ? packedItem : items[i];
+			if (lambda)
+			{
+				ArgumentScope scope;
+				argumentStack.push_back(std::move(result));
+				argumentStack.push_back(item);
+				result = run_lambda(*lambda, env, scope.base);
+			}
+			else if (builtin->binary)
+			{
+				result = builtin->binary(result, item);
+			}
+			else
+			{
+				const Expression args[] = {std::move(result), item};
+				result = builtin->proc(Arguments(args, 2));
+			}
+		}
+	}
+	catch (const SemanticError & e)
+	{
+		std::string t = e.what();
+		throw SemanticError("Error: during " + name + ": " + t);
+	}
+	return result;
+}
+
+Expression Expression::handle_setprop(Environment & env) const
+{
+	Expression result;
+	if (m_tail.size() == 3)
+	{
+		Expression key = m_tail[0].eval(env);
+		Expression value = m_tail[1].eval(env);
+		result = m_tail[2].eval(env);
+		if (key.head().isString())
+		{
+			result.add_prop(key.head(), std::move(value));
 		}
 		else
 		{
@@ -450,22 +1481,20 @@ Expression Expression::handle_setprop(Environment & env)
 	{
 		throw SemanticError("Improper number of arguments in set-property");
 	}
-	return m_tail[2];
+	return result;
 }
 
-Expression Expression::handle_getprop(Environment & env)
+Expression Expression::handle_getprop(Environment & env) const
 {
 	Expression result;
 	if (m_tail.size() == 2)
 	{
-		for (int i = 0; i < 2; i++)
-		{
-			m_tail[i] = m_tail[i].eval(env);
-		}
+		Expression key = m_tail[0].eval(env);
+		Expression object = m_tail[1].eval(env);
 
-		if (m_tail[0].head().isString())
+		if (key.head().isString())
 		{
-			result = m_tail[1].get_prop(m_tail[0].head());
+			result = object.get_prop(key.head());
 		}
 		else
 		{
@@ -479,7 +1508,7 @@ Expression Expression::handle_getprop(Environment & env)
 	return result;
 }
 
-Expression Expression::handle_discplot(Environment & env)
+Expression Expression::handle_discplot(Environment & env) const
 {
 	double N = 20;
 	double A = 3;
@@ -502,13 +1531,15 @@ Expression Expression::handle_discplot(Environment & env)
 	Atom list("list");
 	Atom thickness("\"thickness\"");
 	thickness.setString();
-	m_head = list;
-	stage1 = eval(env);
+	Expression points(*this);
+	points.m_head = list;
+	points.m_dispatch = Dispatch::List;
+	stage1 = points.eval(env);
 	
 
 	if (stage1.rTail().size() > 0)
 	{
-		Expression points = stage1.rTail()[0];
+		const Expression & points = stage1.rTail()[0];
 		if (points.rTail().size() > 0)
 		{
 			double maxX = -10000;
@@ -517,7 +1548,7 @@ Expression Expression::handle_discplot(Environment & env)
 			double minY = 100000;
 			for (std::size_t i = 0; i < points.rTail().size(); i++)
 			{
-				Expression point = points.rTail()[i];
+				const Expression & point = points.rTail()[i];
 				if (point.rTail().size() == 2)
 				{
 					if (point.rTail()[0].isHeadNumber())
@@ -575,7 +1606,7 @@ Expression Expression::handle_discplot(Environment & env)
 
 			if (stage1.rTail().size() == 2)
 			{
-				Expression titles = stage1.rTail()[1];
+				const Expression & titles = stage1.rTail()[1];
 
 				if (titles.isLList())
 				{
@@ -617,8 +1648,8 @@ Expression Expression::handle_discplot(Environment & env)
 									if (titles.rTail()[i].rTail()[1].head().isString())
 									{
 										areTitles = true;
-										Expression textO = helper_make_text(env, titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, maxY * scaleY, 0, -A, scale);
-										stage2.rTail().push_back(textO);
+										Expression textO = helper_make_text(titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, maxY * scaleY, 0, -A, scale);
+										stage2.rTail().push_back(std::move(textO));
 									}
 								}
 								else if (titles.rTail()[i].rTail()[0].head().asString() == "\"abscissa-label\"")
@@ -626,8 +1657,8 @@ Expression Expression::handle_discplot(Environment & env)
 									if (titles.rTail()[i].rTail()[1].head().isString())
 									{
 										areTitles = true;
-										Expression textO = helper_make_text(env, titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, minY * scaleY, 0, A, scale);
-										stage2.rTail().push_back(textO);
+										Expression textO = helper_make_text(titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, minY * scaleY, 0, A, scale);
+										stage2.rTail().push_back(std::move(textO));
 									}
 								}
 								else if (titles.rTail()[i].rTail()[0].head().asString() == "\"ordinate-label\"")
@@ -635,11 +1666,11 @@ Expression Expression::handle_discplot(Environment & env)
 									if (titles.rTail()[i].rTail()[1].head().isString())
 									{
 										areTitles = true;
-										Expression textO = helper_make_text(env, titles.rTail()[i].rTail()[1].head().asString(), minX * scaleX, midY * scaleY, -B, 0, scale);
+										Expression textO = helper_make_text(titles.rTail()[i].rTail()[1].head().asString(), minX * scaleX, midY * scaleY, -B, 0, scale);
 										Atom rot("\"text-rotation\"");
 										rot.setString();
 										textO.add_prop(rot, Expression(Atom(std::atan2(0, -1) * -1 / 2)));
-										stage2.rTail().push_back(textO);
+										stage2.rTail().push_back(std::move(textO));
 									}
 								}
 							}
@@ -652,7 +1683,7 @@ Expression Expression::handle_discplot(Environment & env)
 					}
 					if (areTitles)
 					{
-						resultTitles = stage2.eval(env);
+						resultTitles = object_list(std::move(stage2));
 					}
 				}
 				else
@@ -661,9 +1692,9 @@ Expression Expression::handle_discplot(Environment & env)
 				}
 			}
 
-			resultb = make_box(env, minX * scaleX, minY * scaleY, maxX * scaleX, maxY * scaleY);
+			resultb = make_box(minX * scaleX, minY * scaleY, maxX * scaleX, maxY * scaleY);
 
-			resultTM = make_pos_labels(env, D, C, scale, minX, maxX, minY, maxY, scaleX, scaleY);
+			resultTM = make_pos_labels(D, C, scale, minX, maxX, minY, maxY, scaleX, scaleY);
 
 			double Xaxis = minY*scaleY;
 			double Yaxis = minX;
@@ -673,29 +1704,64 @@ Expression Expression::handle_discplot(Environment & env)
 			{
 			hasAxes = true;
 			Xaxis = 0;
-			Expression XA = helper_make_line(env, maxX * scaleX, Xaxis, minX * scaleX, Xaxis, 0);
-			stage2.rTail().push_back(XA);
+			Expression XA = helper_make_line(maxX * scaleX, Xaxis, minX * scaleX, Xaxis, 0);
+			stage2.rTail().push_back(std::move(XA));
 			}
 
 			if (minX < 0 && maxX > 0)
 			{
 			hasAxes = true;
 			Yaxis = 0;
-			Expression YA = helper_make_line(env, Yaxis, maxY * scaleY, Yaxis, minY * scaleY, 0);
-			stage2.rTail().push_back(YA);
+			Expression YA = helper_make_line(Yaxis, maxY * scaleY, Yaxis, minY * scaleY, 0);
+			stage2.rTail().push_back(std::move(YA));
 			}
 
 			if (hasAxes)
 			{
-			resultAxes = stage2.eval(env);
+			resultAxes = object_list(std::move(stage2));
+			}
+
+			// the points drawn, all of them unless decimated
+			Decimation decimation;
+			if (stage1.rTail().size() == 2)
+			{
+				decimation = discplot_options(stage1.rTail()[1]);
+			}
+			std::vector<std::size_t> shown;
+			if ((decimation.maxPoints > 0) && (points.rTail().size() > decimation.maxPoints))
+			{
+				std::vector<std::size_t> kept;
+				std::vector<double> xs, ys;
+				for (std::size_t i = 0; i < points.rTail().size(); i++)
+				{
+					const Expression & point = points.rTail()[i];
+					if ((point.rTail().size() == 2) && point.rTail()[0].isHeadNumber() && point.rTail()[1].isHeadNumber())
+					{
+						kept.push_back(i);
+						xs.push_back(point.rTail()[0].head().asNumber());
+						ys.push_back(point.rTail()[1].head().asNumber());
+					}
+				}
+				std::vector<std::size_t> chosen = decimation.minMax ?
+					minMaxIndices(xs, ys, decimation.maxPoints) : lttbIndices(xs, ys, decimation.maxPoints);
+				for (std::size_t c : chosen)
+				{
+					shown.push_back(kept[c]);
+				}
+			}
+			else
+			{
+				shown.resize(points.rTail().size());
+				std::iota(shown.begin(), shown.end(), 0);
 			}
 
 			Expression stage3(list);
-			for (size_t i = 0; i < points.rTail().size(); i++)
+			stage3.rTail().reserve(2 * shown.size());
+			for (std::size_t i : shown)
 			{
 			double x;
 			double y;
-			Expression point = points.rTail()[i];
+			const Expression & point = points.rTail()[i];
 			if (point.rTail().size() == 2)
 			{
 			if (point.rTail()[0].isHeadNumber())
@@ -716,12 +1782,12 @@ Expression Expression::handle_discplot(Environment & env)
 			//error
 			}
 			}
-			Expression dot = helper_make_point(env, x, y, P);
-			Expression line = helper_make_line(env, x, y, x, Xaxis, 0);
-			stage3.rTail().push_back(dot);
-			stage3.rTail().push_back(line);
+			Expression dot = helper_make_point(x, y, P);
+			Expression line = helper_make_line(x, y, x, Xaxis, 0);
+			stage3.rTail().push_back(std::move(dot));
+			stage3.rTail().push_back(std::move(line));
 			}
-			resultplot = stage3.eval(env);
+			resultplot = object_list(std::move(stage3));
 		}
 		else
 		{
@@ -738,8 +1804,8 @@ Expression Expression::handle_discplot(Environment & env)
 	}
 	
 	Expression join1(Atom("join"));
-	join1.rTail().emplace_back(resultb);
-	join1.rTail().emplace_back(resultTM);
+	join1.rTail().push_back(std::move(resultb));
+	join1.rTail().push_back(std::move(resultTM));
 	Expression result1 = join1.eval(env);
 	
 	//implement join2 here
@@ -747,14 +1813,14 @@ Expression Expression::handle_discplot(Environment & env)
 	if (hasAxes)
 	{
 		Expression join2(Atom("join"));
-		join2.rTail().push_back(result1);
-		join2.rTail().emplace_back(resultAxes);
+		join2.rTail().push_back(std::move(result1));
+		join2.rTail().push_back(std::move(resultAxes));
 		result1 = join2.eval(env);
 	}
 	//implement join3 here
 	Expression join3(Atom("join"));
-	join3.rTail().push_back(result1);
-	join3.rTail().emplace_back(resultplot);
+	join3.rTail().push_back(std::move(result1));
+	join3.rTail().push_back(std::move(resultplot));
 	Expression result2 = join3.eval(env);
 	if (!areTitles)
 	{
@@ -763,14 +1829,337 @@ Expression Expression::handle_discplot(Environment & env)
 	else
 	{
 		Expression join4(Atom("join"));
-		join4.rTail().emplace_back(result2);
-		join4.rTail().emplace_back(resultTitles);
+		join4.rTail().push_back(std::move(result2));
+		join4.rTail().push_back(std::move(resultTitles));
 		resultf = join4.eval(env);
 	}
 	return resultf;
 }
 
-Expression Expression::handle_contplot(Environment & env)
+// The values of (map func xs), as Numbers. They are computed as pmap does,
+// on the threads of the shared ThreadPool with the environment read only,
+// so the values and any error are the ones map gives.
+std::vector<double> Expression::contplot_samples(const Expression & func, const std::vector<double> & xs, Environment & env) const
+{
+	std::vector<double> ys(xs.size());
+	if (xs.empty())
+	{
+		return ys;
+	}
+	Expression points;
+	points.m_tail.reserve(xs.size());
+	for (double x : xs)
+	{
+		points.m_tail.push_back(Expression(x));
+	}
+	Expression call(Atom("pmap"));
+	call.m_tail.push_back(func);
+	call.m_tail.push_back(object_list(std::move(points)));
+	Expression values = call.eval(env);
+	for (std::size_t i = 0; i < ys.size(); i++)
+	{
+		ys[i] = values.m_tail.numberAt(i);
+	}
+	return ys;
+}
+
+// true if two x coordinates of a plot are the same Number
+static bool same_x(double left, double right)
+{
+	return Atom(left) == Atom(right);
+}
+
+// Parse the sampling options of a continuous plot from its list of options,
+// the other options are left to the plot
+Expression::Sampling Expression::contplot_options(const Expression & options)
+{
+	Sampling sampling;
+	if (!options.isLList())
+	{
+		return sampling;
+	}
+	for (auto & option : options.m_tail)
+	{
+		if ((option.m_tail.size() != 2) || !option.m_tail[0].head().isString())
+		{
+			continue;
+		}
+		std::string name = option.m_tail[0].head().asString();
+		const Expression & value = option.m_tail[1];
+		double number = value.head().asNumber();
+		bool whole = value.isHeadNumber() && value.m_tail.empty() && (number == std::floor(number)) && (number < 1e9);
+		if (name == "\"samples\"")
+		{
+			if (!whole || (number < 1))
+			{
+				throw SemanticError("Error: samples option to continuous-plot is not a positive integer");
+			}
+			sampling.samples = static_cast<std::size_t>(number);
+		}
+		else if (name == "\"max-depth\"")
+		{
+			if (!whole || (number < 0))
+			{
+				throw SemanticError("Error: max-depth option to continuous-plot is not a non-negative integer");
+			}
+			sampling.maxDepth = static_cast<std::size_t>(number);
+		}
+		else if (name == "\"max-evaluations\"")
+		{
+			if (!whole || (number < 1))
+			{
+				throw SemanticError("Error: max-evaluations option to continuous-plot is not a positive integer");
+			}
+			sampling.maxEvaluations = static_cast<std::size_t>(number);
+		}
+		else if (name == "\"tolerance\"")
+		{
+			if (!value.isHeadNumber() || !(number > 0) || !(number < 180))
+			{
+				throw SemanticError("Error: tolerance option to continuous-plot is not an angle between 0 and 180");
+			}
+			sampling.tolerance = number;
+		}
+		else if (name == "\"pixel-tolerance\"")
+		{
+			if (!value.isHeadNumber() || !(number > 0) || std::isinf(number))
+			{
+				throw SemanticError("Error: pixel-tolerance option to continuous-plot is not a positive number");
+			}
+			sampling.pixelTolerance = number;
+		}
+	}
+	return sampling;
+}
+
+// Parse the decimation options of a discrete plot from its list of options,
+// the other options are left to the plot
+Expression::Decimation Expression::discplot_options(const Expression & options)
+{
+	Decimation decimation;
+	if (!options.isLList())
+	{
+		return decimation;
+	}
+	for (auto & option : options.m_tail)
+	{
+		if ((option.m_tail.size() != 2) || !option.m_tail[0].head().isString())
+		{
+			continue;
+		}
+		std::string name = option.m_tail[0].head().asString();
+		const Expression & value = option.m_tail[1];
+		if (name == "\"max-points\"")
+		{
+			double number = value.head().asNumber();
+			if (!value.isHeadNumber() || !value.m_tail.empty() || (number != std::floor(number)) || (number < 2) || (number >= 1e9))
+			{
+				throw SemanticError("Error: max-points option to discrete-plot is not an integer of at least 2");
+			}
+			decimation.maxPoints = static_cast<std::size_t>(number);
+		}
+		else if (name == "\"decimation\"")
+		{
+			std::string method = value.head().isString() ? value.head().asString() : "";
+			if (method == "\"min-max\"")
+			{
+				decimation.minMax = true;
+			}
+			else if (method == "\"lttb\"")
+			{
+				decimation.minMax = false;
+			}
+			else
+			{
+				throw SemanticError("Error: decimation option to discrete-plot is not \"lttb\" or \"min-max\"");
+			}
+		}
+	}
+	return decimation;
+}
+
+// true if (x2, y2) is at most tolerance from the line through (x1, y1) and
+// (x3, y3), with x and y scaled by sx and sy
+static bool near_line(double x1, double y1, double x2, double y2, double x3, double y3,
+	double sx, double sy, double tolerance)
+{
+	double dx = (x3 - x1) * sx;
+	double dy = (y3 - y1) * sy;
+	double cross = std::fabs(dx * (y2 - y1) * sy - dy * (x2 - x1) * sx);
+	return cross <= tolerance * std::sqrt(dx * dx + dy * dy);
+}
+
+// Refines the samples (xs, ys) of func in up to sampling.maxDepth passes. A
+// pass keeps every sample and inserts the midpoints on both sides of each
+// one where the curve bends by more than the tolerance, see checkline, or
+// with a pixel tolerance is further than that off the line between its
+// neighbours in plot units, and evaluates func at the midpoints only. The
+// test at a sample whose neighbours are the ones it had in the pass before
+// gives the result it gave then, so it only runs next to inserted
+// midpoints. Refinement stops at the first pass that inserts no points, and
+// before a pass that would call func more than sampling.maxEvaluations
+// times in all.
+void Expression::refine_contplot(const Expression & func, const Sampling & sampling, std::vector<double> & xs, std::vector<double> & ys, Environment & env) const
+{
+	// the plot is 20 units wide and high, see handle_contplot
+	const double size = 20;
+	std::size_t evaluations = xs.size();
+	double scaleX = size / (xs.back() - xs.front());
+	double scaleY = 0;
+
+	// the index each sample had in the pass before, or npos for a midpoint,
+	// and the bends found at the samples of the pass before
+	const std::size_t npos = static_cast<std::size_t>(-1);
+	std::vector<std::size_t> previous;
+	std::vector<char> bent;
+
+	for (std::size_t pass = 0; pass < sampling.maxDepth; pass++)
+	{
+		std::size_t max = xs.size();
+
+		// the distance test depends on the range of the samples
+		bool rescaled = false;
+		if (sampling.pixelTolerance > 0)
+		{
+			auto range = std::minmax_element(ys.begin(), ys.end());
+			double scale = (*range.second > *range.first) ? size / (*range.second - *range.first) : 0;
+			rescaled = (scale != scaleY);
+			scaleY = scale;
+		}
+		std::vector<double> nextX;
+		std::vector<double> nextY;
+		std::vector<std::size_t> from;
+		std::vector<char> nextBent(max, 0);
+		nextX.reserve(2 * max);
+		nextY.reserve(2 * max);
+		from.reserve(2 * max);
+
+		// a sample of this pass, and a midpoint whose value is not known yet
+		auto keep = [&](std::size_t k)
+		{
+			nextX.push_back(xs[k]);
+			nextY.push_back(ys[k]);
+			from.push_back(k);
+		};
+		auto insert = [&](double x)
+		{
+			nextX.push_back(x);
+			nextY.push_back(0);
+			from.push_back(npos);
+		};
+		// true if the last but one x so far is x
+		auto before_last = [&](double x)
+		{
+			return (nextX.size() >= 2) && same_x(nextX[nextX.size() - 2], x);
+		};
+
+		for (std::size_t j = 1; j + 1 < max; j++)
+		{
+			bool unchanged = (pass > 0) && !rescaled && (previous[j] != npos) && (previous[j - 1] != npos) &&
+				(previous[j + 1] != npos) && (previous[j - 1] + 1 == previous[j]) &&
+				(previous[j] + 1 == previous[j + 1]);
+			bool flat;
+			if (unchanged)
+			{
+				flat = !bent[previous[j]];
+			}
+			else if (sampling.pixelTolerance > 0)
+			{
+				flat = near_line(xs[j - 1], ys[j - 1], xs[j], ys[j], xs[j + 1], ys[j + 1],
+					scaleX, scaleY, sampling.pixelTolerance);
+			}
+			else
+			{
+				flat = checkline(xs[j - 1], ys[j - 1], xs[j], ys[j], xs[j + 1], ys[j + 1], sampling.tolerance);
+			}
+			nextBent[j] = !flat;
+
+			if (flat)
+			{
+				if (nextX.size() < 2)
+				{
+					keep(j - 1);
+				}
+				else
+				{
+					if (!before_last(xs[j - 1]))
+					{
+						keep(j - 1);
+					}
+					if (j == max - 2)
+					{
+						keep(j);
+						keep(j + 1);
+					}
+				}
+			}
+			else
+			{
+				double midx1 = (xs[j] + xs[j - 1]) / 2;
+				double midx2 = (xs[j + 1] + xs[j]) / 2;
+				if (nextX.empty())
+				{
+					keep(j - 1);
+					insert(midx1);
+					keep(j);
+					insert(midx2);
+				}
+				else
+				{
+					if (!before_last(xs[j - 1]))
+					{
+						keep(j - 1);
+						insert(midx1);
+						keep(j);
+						insert(midx2);
+					}
+					else if (!before_last(xs[j]))
+					{
+						keep(j);
+						insert(midx2);
+					}
+					if (j == max - 2)
+					{
+						keep(j + 1);
+					}
+				}
+			}
+		}
+		if (nextX.size() <= max)
+		{
+			break;
+		}
+
+		std::vector<double> inserted;
+		for (std::size_t k = 0; k < nextX.size(); k++)
+		{
+			if (from[k] == npos)
+			{
+				inserted.push_back(nextX[k]);
+			}
+		}
+		if ((sampling.maxEvaluations > 0) && (evaluations + inserted.size() > sampling.maxEvaluations))
+		{
+			break;
+		}
+		evaluations += inserted.size();
+		std::vector<double> values = contplot_samples(func, inserted, env);
+		for (std::size_t k = 0, n = 0; k < nextX.size(); k++)
+		{
+			if (from[k] == npos)
+			{
+				nextY[k] = values[n++];
+			}
+		}
+
+		xs = std::move(nextX);
+		ys = std::move(nextY);
+		previous = std::move(from);
+		bent = std::move(nextBent);
+	}
+}
+
+Expression Expression::handle_contplot(Environment & env) const
 {
 	double N = 20;
 	double A = 3;
@@ -796,9 +2185,6 @@ Expression Expression::handle_contplot(Environment & env)
 	Atom range("range");
 	Expression stage2(range);
 
-	Atom map("map");
-	Expression stage3(map);
-
 	Atom list("list");
 
 
@@ -806,123 +2192,50 @@ Expression Expression::handle_contplot(Environment & env)
 	{
 		func = rTail()[0];
 		stage1 = rTail()[1].eval(env);
+
+		// the options, titles and labels and how the function is sampled
+		Expression titles;
+		if (rTail().size() == 3)
+		{
+			Expression t1(list);
+			for (std::size_t i = 0; i < rTail()[2].rTail().size(); i++)
+			{
+				t1.rTail().push_back(rTail()[2].rTail()[i]);
+			}
+			titles = t1.eval(env);
+		}
+		Sampling sampling = contplot_options(titles);
+
 			if (stage1.rTail()[0].isHeadNumber() && stage1.rTail()[1].isHeadNumber())
 			{
 				double b1 = stage1.rTail()[0].head().asNumber();
 				double b2 = stage1.rTail()[1].head().asNumber();
 				double dist = b2 - b1;
-				double seg = dist / 50;
+				double seg = dist / sampling.samples;
 
 				stage2.append(Atom(b1));
 				stage2.append(Atom(b2));
 				stage2.append(Atom(seg));
 
-				stage3.rTail().emplace_back(func);
-
 				Expression Xcord = stage2.eval(env);
-				if (!(Xcord.rTail().back() == Expression(b2)))
+				if (!(Xcord.rTail().headAt(Xcord.rTail().size() - 1) == Atom(b2)))
 				{
 					Xcord.rTail().emplace_back(Expression(b2));
 				}
 
-				stage3.rTail().emplace_back(Xcord);
-				Expression Ycord = stage3.eval(env);
-				
-				for (int i = 0; i < 9; i++)
+				std::vector<double> xs(Xcord.rTail().size());
+				for (std::size_t i = 0; i < xs.size(); i++)
 				{
-					Expression nextX(list);
-					Expression nextY(map);
-					nextY.rTail().push_back(func);
-					int z = 0;
-					std::size_t max = Xcord.rTail().size();
-					for (size_t j = 1; j < Xcord.rTail().size() - 1; j++)
-					{
-						z++;
-						double x1 = Xcord.rTail()[j-1].head().asNumber();
-						double y1 = Ycord.rTail()[j-1].head().asNumber();
-
-						double x2 = Xcord.rTail()[j].head().asNumber();
-						double y2 = Ycord.rTail()[j].head().asNumber();
-
-						double x3 = Xcord.rTail()[j+1].head().asNumber();
-						double y3 = Ycord.rTail()[j+1].head().asNumber();
-
-						if (checkline(x1, y1, x2, y2, x3, y3))
-						{
-							if (nextX.rTail().empty())
-							{
-								nextX.rTail().emplace_back(Expression(x1));
-							}
-							else
-							{
-								if (nextX.rTail().size() == 1)
-								{
-									nextX.rTail().emplace_back(Expression(x1));
-								}
-								else
-								{
-									if (!(nextX.rTail()[nextX.rTail().size() - 2] == Expression(x1)))
-									{
-										nextX.rTail().emplace_back(Expression(x1));
-									}
-									if (j == max - 2)
-									{
-										nextX.rTail().emplace_back(Expression(x2));
-										nextX.rTail().emplace_back(Expression(x3));
-									}
-								}
-								
-							}
-						}
-						else
-						{
-							double midx1 = (x2 + x1) / 2;
-							double midx2 = (x3 + x2) / 2;
-							if (nextX.rTail().empty())
-							{
-								nextX.rTail().emplace_back(Expression(x1));
-								nextX.rTail().emplace_back(Expression(midx1));
-								nextX.rTail().emplace_back(Expression(x2));
-								nextX.rTail().emplace_back(Expression(midx2));
-							}
-							else
-							{
-								if (!(nextX.rTail()[nextX.rTail().size() - 2] == Expression(x1)))
-								{
-									nextX.rTail().emplace_back(Expression(x1));
-									nextX.rTail().emplace_back(Expression(midx1));
-									nextX.rTail().emplace_back(Expression(x2));
-									nextX.rTail().emplace_back(Expression(midx2));
-								}
-								else if (!(nextX.rTail()[nextX.rTail().size() - 2] == Expression(x2)))
-								{
-									nextX.rTail().emplace_back(Expression(x2));
-									nextX.rTail().emplace_back(Expression(midx2));
-								}
-
-								if (j == max - 2)
-								{
-									nextX.rTail().emplace_back(Expression(x3));
-								}
-							}
-							
-							
-						}
-					}
-					nextX = nextX.eval(env);
-					if (nextX.rTail().size() > Xcord.rTail().size())
-					{
-						Xcord = nextX;
-						nextY.rTail().push_back(Xcord);
-						Ycord = nextY.eval(env);
-					}
-					else
-					{
-						break;
-					}
+					xs[i] = Xcord.rTail().numberAt(i);
+				}
+				if ((sampling.maxEvaluations > 0) && (xs.size() > sampling.maxEvaluations))
+				{
+					throw SemanticError("Error: max-evaluations option to continuous-plot is less than the initial samples");
 				}
+				std::vector<double> ys = contplot_samples(func, xs, env);
+				refine_contplot(func, sampling, xs, ys, env);
 
-				std::size_t numpoints = Xcord.rTail().size();
+				std::size_t numpoints = xs.size();
 
 				double maxX = b2;
 				double minX = b1;
@@ -931,13 +2244,13 @@ Expression Expression::handle_contplot(Environment & env)
 
 				for (size_t i = 0; i < numpoints; i++)
 				{
-					if (Ycord.rTail()[i].head().asNumber() > maxY)
+					if (ys[i] > maxY)
 					{
-						maxY = Ycord.rTail()[i].head().asNumber();
+						maxY = ys[i];
 					}
-					if (Ycord.rTail()[i].head().asNumber() < minY)
+					if (ys[i] < minY)
 					{
-						minY = Ycord.rTail()[i].head().asNumber();
+						minY = ys[i];
 					}
 				}
 
@@ -947,19 +2260,12 @@ Expression Expression::handle_contplot(Environment & env)
 				double scaleX = (N / (maxX - minX));
 				double scaleY = -1 * (N / (maxY - minY));
 
-				resultb = make_box(env, minX * scaleX, minY * scaleY, maxX * scaleX, maxY * scaleY);
+				resultb = make_box(minX * scaleX, minY * scaleY, maxX * scaleX, maxY * scaleY);
 
 				
 
 				if (rTail().size() == 3)
 				{
-					Expression t1(list);
-					for (std::size_t i = 0; i < rTail()[2].rTail().size(); i++)
-					{
-						t1.rTail().push_back(rTail()[2].rTail()[i]);
-					}
-					Expression titles = t1.eval(env);
-
 					if (titles.isLList())
 					{
 						//find text scale if applicable;
@@ -1000,8 +2306,8 @@ Expression Expression::handle_contplot(Environment & env)
 										if (titles.rTail()[i].rTail()[1].head().isString())
 										{
 											areTitles = true;
-											Expression textO = helper_make_text(env, titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, maxY * scaleY, 0, -A, scale);
-											stage4.rTail().push_back(textO);
+											Expression textO = helper_make_text(titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, maxY * scaleY, 0, -A, scale);
+											stage4.rTail().push_back(std::move(textO));
 										}
 									}
 									else if (titles.rTail()[i].rTail()[0].head().asString() == "\"abscissa-label\"")
@@ -1009,8 +2315,8 @@ Expression Expression::handle_contplot(Environment & env)
 										if (titles.rTail()[i].rTail()[1].head().isString())
 										{
 											areTitles = true;
-											Expression textO = helper_make_text(env, titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, minY * scaleY, 0, A, scale);
-											stage4.rTail().push_back(textO);
+											Expression textO = helper_make_text(titles.rTail()[i].rTail()[1].head().asString(), midX * scaleX, minY * scaleY, 0, A, scale);
+											stage4.rTail().push_back(std::move(textO));
 										}
 									}
 									else if (titles.rTail()[i].rTail()[0].head().asString() == "\"ordinate-label\"")
@@ -1018,11 +2324,11 @@ Expression Expression::handle_contplot(Environment & env)
 										if (titles.rTail()[i].rTail()[1].head().isString())
 										{
 											areTitles = true;
-											Expression textO = helper_make_text(env, titles.rTail()[i].rTail()[1].head().asString(), minX * scaleX, midY * scaleY, -B, 0, scale);
+											Expression textO = helper_make_text(titles.rTail()[i].rTail()[1].head().asString(), minX * scaleX, midY * scaleY, -B, 0, scale);
 											Atom rot("\"text-rotation\"");
 											rot.setString();
 											textO.add_prop(rot, Expression(Atom(std::atan2(0, -1) * -1 / 2)));
-											stage4.rTail().push_back(textO);
+											stage4.rTail().push_back(std::move(textO));
 										}
 									}
 								}
@@ -1035,7 +2341,7 @@ Expression Expression::handle_contplot(Environment & env)
 						}
 						if (areTitles)
 						{
-							resultTitles = stage4.eval(env);
+							resultTitles = object_list(std::move(stage4));
 						}
 					}
 					else
@@ -1044,7 +2350,7 @@ Expression Expression::handle_contplot(Environment & env)
 					}
 				}
 
-				resultTM = make_pos_labels(env, D, C, scale, minX, maxX, minY, maxY, scaleX, scaleY);
+				resultTM = make_pos_labels(D, C, scale, minX, maxX, minY, maxY, scaleX, scaleY);
 
 				double Xaxis = minY*scaleY;
 				double Yaxis = minX;
@@ -1054,34 +2360,35 @@ Expression Expression::handle_contplot(Environment & env)
 				{
 					hasAxes = true;
 					Xaxis = 0;
-					Expression XA = helper_make_line(env, maxX * scaleX, Xaxis, minX * scaleX, Xaxis, 0);
-					stage5.rTail().push_back(XA);
+					Expression XA = helper_make_line(maxX * scaleX, Xaxis, minX * scaleX, Xaxis, 0);
+					stage5.rTail().push_back(std::move(XA));
 				}
 
 				if (minX < 0 && maxX > 0)
 				{
 					hasAxes = true;
 					Yaxis = 0;
-					Expression YA = helper_make_line(env, Yaxis, maxY * scaleY, Yaxis, minY * scaleY, 0);
-					stage5.rTail().push_back(YA);
+					Expression YA = helper_make_line(Yaxis, maxY * scaleY, Yaxis, minY * scaleY, 0);
+					stage5.rTail().push_back(std::move(YA));
 				}
 
 				if (hasAxes)
 				{
-					resultAxes = stage5.eval(env);
+					resultAxes = object_list(std::move(stage5));
 				}
 
 				Expression stage6(list);
+				stage6.rTail().reserve(numpoints);
 				for (size_t i = 1; i < numpoints; i++)
 				{
-					double x1 = Xcord.rTail()[i-1].head().asNumber() * scaleX;
-					double y1 = Ycord.rTail()[i-1].head().asNumber() * scaleY;
-					double x2 = Xcord.rTail()[i].head().asNumber() * scaleX;
-					double y2 = Ycord.rTail()[i].head().asNumber() * scaleY;
-					Expression line = helper_make_line(env, x1, y1, x2, y2, 0);
-					stage6.rTail().push_back(line);
+					double x1 = xs[i-1] * scaleX;
+					double y1 = ys[i-1] * scaleY;
+					double x2 = xs[i] * scaleX;
+					double y2 = ys[i] * scaleY;
+					Expression line = helper_make_line(x1, y1, x2, y2, 0);
+					stage6.rTail().push_back(std::move(line));
 				}
-				resultplot = stage6.eval(env);
+				resultplot = object_list(std::move(stage6));
 			}
 			else
 			{
@@ -1094,22 +2401,22 @@ Expression Expression::handle_contplot(Environment & env)
 	}
 
 	Expression join1(Atom("join"));
-	join1.rTail().emplace_back(resultb);
-	join1.rTail().emplace_back(resultTM);
+	join1.rTail().push_back(std::move(resultb));
+	join1.rTail().push_back(std::move(resultTM));
 	Expression result1 = join1.eval(env);
 
 	//implement join2 here
 	if (hasAxes)
 	{
 		Expression join2(Atom("join"));
-		join2.rTail().push_back(result1);
-		join2.rTail().emplace_back(resultAxes);
+		join2.rTail().push_back(std::move(result1));
+		join2.rTail().push_back(std::move(resultAxes));
 		result1 = join2.eval(env);
 	}
 	//implement join3 here
 	Expression join3(Atom("join"));
-	join3.rTail().push_back(result1);
-	join3.rTail().emplace_back(resultplot);
+	join3.rTail().push_back(std::move(result1));
+	join3.rTail().push_back(std::move(resultplot));
 	Expression result2 = join3.eval(env);
 	if (!areTitles)
 	{
@@ -1118,15 +2425,17 @@ Expression Expression::handle_contplot(Environment & env)
 	else
 	{
 		Expression join4(Atom("join"));
-		join4.rTail().emplace_back(result2);
-		join4.rTail().emplace_back(resultTitles);
+		join4.rTail().push_back(std::move(result2));
+		join4.rTail().push_back(std::move(resultTitles));
 		resultf = join4.eval(env);
 	}
 	return resultf;
 
 }
 
-bool Expression::checkline(const double x1, const double y1, const double x2, const double y2, const double x3, const double y3)
+// true if the curve through the three points bends by less than tolerance
+// degrees at the middle one
+bool Expression::checkline(const double x1, const double y1, const double x2, const double y2, const double x3, const double y3, const double tolerance) const
 {
 	double b = sqrt(((x3 - x2)*(x3 - x2) + (y3 - y2)*(y3 - y2)));
 	double a = sqrt(((x1 - x2)*(x1 - x2) + (y1 - y2)*(y1 - y2)));
@@ -1139,188 +2448,269 @@ bool Expression::checkline(const double x1, const double y1, const double x2, co
 	}
 	double angle = acos(nat);
 
-	double check1 = 185 * (std::atan2(0, -1) / 180.0);
-	double check2 = 175 * (std::atan2(0, -1) / 180.0);
+	double check1 = (180 + tolerance) * (std::atan2(0, -1) / 180.0);
+	double check2 = (180 - tolerance) * (std::atan2(0, -1) / 180.0);
 	return (angle > check2 && angle < check1);
 }
 
-Expression Expression::make_box(Environment & env, const double minX, const double minY, const double maxX, const double maxY)
+Expression Expression::make_box(const double minX, const double minY, const double maxX, const double maxY) const
 {
-	Expression resultb;
-	Atom list("list");
-	
-	Expression stage2(list);
-	Expression boxu = helper_make_line(env, minX, maxY, maxX, maxY, 0);
-	stage2.rTail().push_back(boxu);
-
-	Expression boxd = helper_make_line(env, minX, minY, maxX, minY, 0);
-	stage2.rTail().push_back(boxd);
-
-	Expression boxr = helper_make_line(env, maxX, maxY, maxX, minY, 0);
-	stage2.rTail().push_back(boxr);
-
-	Expression boxl = helper_make_line(env, minX, minY, minX, maxY, 0);
-	stage2.rTail().push_back(boxl);
-
-	resultb = stage2.eval(env);
-	return resultb;
+	Expression stage2;
+	stage2.m_tail.reserve(4);
+	stage2.m_tail.push_back(helper_make_line(minX, maxY, maxX, maxY, 0));
+	stage2.m_tail.push_back(helper_make_line(minX, minY, maxX, minY, 0));
+	stage2.m_tail.push_back(helper_make_line(maxX, maxY, maxX, minY, 0));
+	stage2.m_tail.push_back(helper_make_line(minX, minY, minX, maxY, 0));
+	return object_list(std::move(stage2));
 }
 
-Expression Expression::make_pos_labels(Environment & env, const double C, const double D, const double scale, const double minX, const double maxX, const double minY, const double maxY, const double Xscale, const double Yscale)
+Expression Expression::make_pos_labels(const double C, const double D, const double scale, const double minX, const double maxX, const double minY, const double maxY, const double Xscale, const double Yscale) const
 {
-	Atom list("list");
-	Expression stage2(list);
+	Expression stage2;
+	stage2.m_tail.reserve(4);
 	std::string textConOU;
 	std::stringstream stream;
 	stream << "\"" << std::setprecision(2) << maxY << "\"";
 	stream >> textConOU;
-	Expression OUF = helper_make_text(env, textConOU, minX * Xscale, maxY * Yscale, -D, 0, scale);
-	stage2.rTail().push_back(OUF);
+	stage2.m_tail.push_back(helper_make_text(textConOU, minX * Xscale, maxY * Yscale, -D, 0, scale));
 
 	stream.clear();
 	std::string textConOL;
 	stream << "\"" << std::setprecision(2) << minY << "\"";
 	stream >> textConOL;
-	Expression OLF = helper_make_text(env, textConOL, minX * Xscale, minY * Yscale, -D, 0, scale);	
-	stage2.rTail().push_back(OLF);
+	stage2.m_tail.push_back(helper_make_text(textConOL, minX * Xscale, minY * Yscale, -D, 0, scale));
 
 	stream.clear();
 	std::string textConAL;
 	stream << "\"" << std::setprecision(2) << minX << "\"";
 	stream >> textConAL;
-	Expression ALF = helper_make_text(env, textConAL, minX * Xscale, minY * Yscale, 0, C, scale);
-	stage2.rTail().push_back(ALF);
+	stage2.m_tail.push_back(helper_make_text(textConAL, minX * Xscale, minY * Yscale, 0, C, scale));
 
 	stream.clear();
 	std::string textConAU;
 	stream << "\"" << std::setprecision(2) << maxX << "\"";
 	stream >> textConAU;
-	Expression AUF = helper_make_text(env, textConAU, maxX * Xscale, minY * Yscale, 0, C, scale);
-	stage2.rTail().push_back(AUF);
-	Expression resultTM = stage2.eval(env);
-	return resultTM;
+	stage2.m_tail.push_back(helper_make_text(textConAU, maxX * Xscale, minY * Yscale, 0, C, scale));
+	return object_list(std::move(stage2));
 }
 
-Expression Expression::helper_make_text(Environment & env, const std::string cont, const double XN, const double YN, const double X, const double Y, const double scale)
-{
-	
-
-	Atom text("make-text");
-	Atom position("\"position\"");
-	position.setString();
-
-	Expression OU(text);
-
-	Atom OUCon(cont);
-	OUCon.setString();
-	OU.append(OUCon);
-
-	Expression OUF = OU.eval(env);
+// The plot objects are built directly, without calling the lambdas of the
+// startup file. They are the values (make-text cont), (make-line p1 p2) and
+// (make-point x y) evaluate to, with the properties the plots add.
 
-	Expression OUpos = helper_make_point(env, ((XN)+X), ((YN)+Y), 0);
+Expression Expression::helper_make_text(const std::string cont, const double XN, const double YN, const double X, const double Y, const double scale) const
+{
+	Expression text(string_atom(cont));
+	text.propMap[OBJECT_NAME_KEY.symbolId()] = Expression(TEXT_NAME);
+	text.propMap[POSITION_KEY.symbolId()] = helper_make_point(((XN)+X), ((YN)+Y), 0);
+	text.propMap[TEXT_SCALE_KEY.symbolId()] = Expression(Atom(scale));
+	return text;
+}
 
-	Atom scaleT("\"text-scale\"");
-	scaleT.setString();
+Expression Expression::helper_make_line(const double x1, const double y1, const double x2, const double y2, const double thickness) const
+{
+	Expression line;
+	line.isList = true;
+	line.m_tail.reserve(2);
+	line.m_tail.push_back(helper_make_point(x1, y1, 0));
+	line.m_tail.push_back(helper_make_point(x2, y2, 0));
+	line.propMap[OBJECT_NAME_KEY.symbolId()] = Expression(LINE_NAME);
+	line.propMap[THICKNESS_KEY.symbolId()] = Expression(Atom(thickness));
+	return line;
+}
 
-	OUF.add_prop(position, OUpos);
-	OUF.add_prop(scaleT, Expression(Atom(scale)));
-	return OUF;
+Expression Expression::helper_make_point(const double x, const double y, const double size) const
+{
+	Expression point;
+	point.isList = true;
+	point.m_tail.reserve(2);
+	point.m_tail.push_back(Expression(Atom(x)));
+	point.m_tail.push_back(Expression(Atom(y)));
+	point.m_tail.pack();
+	point.propMap[OBJECT_NAME_KEY.symbolId()] = Expression(POINT_NAME);
+	point.propMap[SIZE_KEY.symbolId()] = Expression(Atom(size));
+	return point;
 }
 
-Expression Expression::helper_make_line(Environment & env, const double x1, const double y1, const double x2, const double y2, const double thickness)
+// the list (list ...) evaluates to when the elements of stage are values
+Expression Expression::object_list(Expression && stage)
 {
-	Atom thicknessA("\"thickness\"");
-	thicknessA.setString();
-	Expression boxu(Atom("make-line"));
-	Expression fpu = helper_make_point(env, x1, y1, 0);
-	Expression spu = helper_make_point(env, x2, y2, 0);
-	boxu.rTail().push_back(fpu);
-	boxu.rTail().push_back(spu);
-	boxu = boxu.eval(env);
+	Expression result;
+	result.isList = true;
+	if (stage.m_tail.empty())
+	{
+		result.m_tail.push_back(Atom(""));
+	}
+	else
+	{
+		result.m_tail = std::move(stage.m_tail);
+		result.m_tail.pack();
+	}
+	return result;
+}
 
-	boxu.add_prop(thicknessA, Expression(thickness));
-	return boxu;
+Expression::Dispatch Expression::classify() const noexcept{
+  SymbolId s = m_head.isSymbol() ? m_head.symbolId() : 0;
+
+  // list is checked before the terminal case, (list) is the empty list
+  if(s == LIST_ID) return Dispatch::List;
+  if(m_tail.empty()) return Dispatch::Terminal;
+  if(s == BEGIN_ID) return Dispatch::Begin;
+  if(s == DEFINE_ID) return Dispatch::Define;
+  if(s == APPLY_ID) return Dispatch::Apply;
+  if(s == MAP_ID) return Dispatch::Map;
+  if(s == PMAP_ID) return Dispatch::PMap;
+  if(s == REDUCE_ID) return Dispatch::Reduce;
+  if(s == FOLD_ID) return Dispatch::Fold;
+  if(s == SETPROP_ID) return Dispatch::SetProp;
+  if(s == GETPROP_ID) return Dispatch::GetProp;
+  if(s == DISCPLOT_ID) return Dispatch::DiscPlot;
+  if(s == CONTPLOT_ID) return Dispatch::ContPlot;
+  if(s == LAMBDA_ID) return Dispatch::Lambda;
+  if(s == IF_ID) return Dispatch::If;
+  if(s == COND_ID) return Dispatch::Cond;
+  if(s == AND_ID) return Dispatch::And;
+  if(s == OR_ID) return Dispatch::Or;
+  if(s == DO_ID) return Dispatch::Do;
+  if(s == WHILE_ID) return Dispatch::While;
+  if(s == FOREACH_ID) return Dispatch::ForEach;
+  return Dispatch::Call;
 }
 
-Expression Expression::helper_make_point(Environment & env, const double x, const double y, const double size)
-{
-	Atom sizeA("\"size\"");
-	sizeA.setString();
-	Expression fpu(Atom("make-point"));
-	fpu.append(Atom(x));
-	fpu.append(Atom(y));
-	fpu = fpu.eval(env);
-	fpu.add_prop(sizeA, Expression(Atom(size)));
-	return fpu;
+Expression::Dispatch Expression::dispatch() const noexcept{
+  return (m_dispatch == Dispatch::Unresolved) ? classify() : m_dispatch;
+}
+
+void Expression::resolve(const Environment & env){
+  m_dispatch = classify();
+  if(m_dispatch == Dispatch::Call){
+    m_builtin = env.find_builtin(m_head);
+    m_epoch = env.epoch();
+  }
+
+  // packed elements are plain numbers, mutable access would unpack them
+  if(m_tail.packed()) return;
+  for(auto & e : m_tail){
+    e.resolve(env);
+  }
 }
 
 // this is a simple recursive version. the iterative version is more
 // difficult with the ast data structure used (no parent pointer).
 // this limits the practical depth of our AST
-Expression Expression::eval(Environment & env){
+Expression Expression::eval(Environment & env) const{
 	if (interupt == true)
 	{
 		interupt = false;
 		throw SemanticError("Error: interpreter kernel interrupted");
 	}
-  if (m_head.isSymbol() && m_head.asSymbol() == "list") {
-	  return handle_list(env);
-  }
-  else if (m_tail.empty() && env.is_lambda(m_head)) {
-	  //fix this as errors are occuring
-	  return env.get_lambda(m_head.asSymbol());
-  }
-  else if(m_tail.empty()){
-	  Expression test = handle_lookup(m_head, env);
-	  return test;
-  }
-  // handle begin special-form
-  else if(m_head.isSymbol() && m_head.asSymbol() == "begin"){
+  switch(dispatch()){
+  case Dispatch::List:
+    return handle_list(env);
+  case Dispatch::Terminal:
+    if((m_slot >= 0) && Frame::current() &&
+       (static_cast<std::size_t>(m_slot) < Frame::current()->size()) &&
+       Frame::current()->bound(m_slot)){
+      return (*Frame::current())[m_slot];
+    }
+    else if(const Expression * value = cached_binding(env, false)){
+      return *value;
+    }
+    return handle_lookup(m_head, env);
+  case Dispatch::Begin:
     return handle_begin(env);
-  }
-  // handle define special-form
-  else if(m_head.isSymbol() && m_head.asSymbol() == "define"){
+  case Dispatch::Define:
     return handle_define(env);
+  case Dispatch::Apply:
+    return handle_apply(env);
+  case Dispatch::Map:
+    return handle_map(env);
+  case Dispatch::PMap:
+    return handle_pmap(env);
+  case Dispatch::Reduce:
+  case Dispatch::Fold:
+    return handle_reduce(env);
+  case Dispatch::SetProp:
+    return handle_setprop(env);
+  case Dispatch::GetProp:
+    return handle_getprop(env);
+  case Dispatch::DiscPlot:
+    return handle_discplot(env);
+  case Dispatch::ContPlot:
+    return handle_contplot(env);
+  case Dispatch::Lambda:
+    return handle_lambda();
+  case Dispatch::Do:
+  case Dispatch::While:
+  case Dispatch::ForEach:
+    return handle_loop(env);
+  case Dispatch::If:
+    return if_branch(env).eval(env);
+  case Dispatch::Cond:
+    return cond_branch(env)->eval(env);
+  case Dispatch::And:
+  case Dispatch::Or:{
+    Expression result;
+    const Expression * last = logic_operands(env, result);
+    return last ? last->eval(env) : result;
   }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "apply") {
-	  return handle_apply(env);
-  }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "map") {
-	  return handle_map(env);
+  default:
+    return handle_call(env);
   }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "set-property") {
-	  Expression test = handle_setprop(env);
-	  return test;
-  }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "get-property") {
-	  return handle_getprop(env);
+}
+
+// the binding of a symbol head, found through the inline cache. The values
+// of the environment never move, so the pointer stays valid during the call.
+const Expression * Expression::cached_binding(const Environment & env, bool lambdas) const{
+  const Expression * value = env.value_at(m_cache.load(std::memory_order_relaxed));
+  if(!value && m_head.isSymbol()){
+    std::uint64_t key = lambdas ? env.lambda_key(m_head) : env.value_key(m_head);
+    value = env.value_at(key);
+    if(value){
+      m_cache.store(key, std::memory_order_relaxed);
+    }
   }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "discrete-plot") {
-	  return handle_discplot(env);
+  return value;
+}
+
+Expression Expression::argument(std::size_t index, Environment & env) const{
+  // packed elements are plain numbers, they evaluate to themselves
+  return m_tail.packed() ? Expression(m_tail.headAt(index)) : m_tail[index].eval(env);
+}
+
+Expression Expression::handle_call(Environment & env) const{
+  if(const Expression * lambda = lambda_callee(env)){
+    return handle_lambda_call(*lambda, env);
   }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "continuous-plot") {
-	  return handle_contplot(env);
+
+  // a procedure resolved in an earlier epoch may no longer exist
+  const Builtin * builtin = (m_epoch == env.epoch()) ? m_builtin : nullptr;
+
+  if(isList){
+    if(!m_tail.packed()){
+      for(Expression::ConstIteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
+	it->eval(env);
+      }
+    }
+    return *this;
   }
-  else if (m_head.isSymbol() && m_head.asSymbol() == "lambda") {
-	  islambda = true;
-	  return handle_lambda();
+
+  std::size_t n = m_tail.size();
+  if(builtin && (n == 1) && builtin->unary){
+    return builtin->unary(argument(0, env));
   }
-  else if (m_head.isSymbol() && env.is_lambda(m_head))
-  {
-	  return handle_lambda_lookup(m_head, env);
+  if(builtin && (n == 2) && builtin->binary){
+    Expression left = argument(0, env);
+    return builtin->binary(left, argument(1, env));
   }
-  // else attempt to treat as procedure
-  else{ 
-    std::vector<Expression> results;
-    for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-      results.push_back(it->eval(env));
-    }
-	if (!isList)
-	{
-		return apply(m_head, results, env);
-	}
-	return *this;
+
+  // else gather the arguments and attempt to treat as procedure
+  ArgumentScope scope;
+  for(std::size_t i = 0; i < n; ++i){
+    argumentStack.push_back(argument(i, env));
   }
+  Arguments args(argumentStack.data() + scope.base, n);
+  return builtin ? builtin->proc(args) : apply(m_head, args, env);
 }
 
 
@@ -1345,8 +2735,20 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp){
 	  out << " ";
   }
 
-  for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
-	  if (e->head().isSymbol() && e->head().asSymbol() == "")
+  if (exp.rTail().packed())
+  {
+	  // print packed numbers without building their Expressions
+	  for (std::size_t k = 0; k < tailL; ++k)
+	  {
+		  out << Expression(exp.rTail().headAt(k));
+		  if (k < tailL - 1)
+		  {
+			  out << " ";
+		  }
+	  }
+  }
+  else for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
+	  if (e->head().isSymbol() && e->head().symbolId() == 0)
 	  {
 
 	  }
@@ -1378,7 +2780,16 @@ bool Expression::operator==(const Expression & exp) const noexcept{
 
   result = result && (m_tail.size() == exp.m_tail.size());
 
-  if(result){
+  if(result && (m_tail.packed() || exp.m_tail.packed())){
+    // packed elements are plain, equal to an element with the same head
+    // and no tail
+    for(std::size_t i = 0; result && (i < m_tail.size()); ++i){
+      result = (m_tail.headAt(i) == exp.m_tail.headAt(i)) &&
+	(m_tail.packed() || m_tail[i].m_tail.empty()) &&
+	(exp.m_tail.packed() || exp.m_tail[i].m_tail.empty());
+    }
+  }
+  else if(result){
     for(auto lefte = m_tail.begin(), righte = exp.m_tail.begin();
 	(lefte != m_tail.end()) && (righte != exp.m_tail.end());
 	++lefte, ++righte){
@@ -1397,7 +2808,7 @@ bool operator!=(const Expression & left, const Expression & right) noexcept{
 
 bool Expression::is_prop(const Atom & key) const {
 	if (!key.isString()) return false;
-	auto result = propMap.find(key.asString());
+	auto result = propMap.find(key.symbolId());
 	return (result != propMap.end());
 }
 
@@ -1405,9 +2816,9 @@ bool Expression::is_prop(const Atom & key) const {
 Expression Expression::get_prop(const Atom & key) const {
 	Expression exp;
 	if (key.isString()) {
-		auto result = propMap.find(key.asString());
+		auto result = propMap.find(key.symbolId());
 		if ((result != propMap.end())) {
-			exp = Expression(result->second);
+			exp = result->second;
 		}
 	}
 	return exp;
@@ -1419,11 +2830,17 @@ void Expression::add_prop(const Atom & key, const Expression & prop) {
 	if (!key.isString()) {
 		throw SemanticError("Attempt to add non-string to the property list.");
 	}
-	if (propMap.find(key.asString()) != propMap.end()) {
-		propMap.erase(key.asString());
+
+	propMap[key.symbolId()] = prop;
+}
+
+void Expression::add_prop(const Atom & key, Expression && prop) {
+
+	if (!key.isString()) {
+		throw SemanticError("Attempt to add non-string to the property list.");
 	}
 
-	propMap.emplace(key.asString(), prop);
+	propMap[key.symbolId()] = std::move(prop);
 }
 
 void Expression::setError()
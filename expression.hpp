@@ -7,30 +7,96 @@ Defines the Expression type and assiciated functions.
 #ifndef EXPRESSION_HPP
 #define EXPRESSION_HPP
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "token.hpp"
 #include "atom.hpp"
+#include "list.hpp"
 
 
 #include <atomic>
+#include <cstdint>
 
 extern volatile std::atomic_bool interupt;
 
 // forward declare Environment
 class Environment;
 
+class Expression;
+
+/*! \class Arguments
+\brief A read-only view of the evaluated arguments of a procedure call.
+
+The arguments are held by the caller, on its stack or in a reused buffer,
+so calling a procedure does not allocate. A std::vector of Expressions
+converts implicitly. The interface mirrors the subset of std::vector the
+procedures use.
+*/
+class Arguments {
+public:
+
+  /// view count Expressions starting at first
+  Arguments(const Expression * first, std::size_t count) noexcept;
+
+  /// view the elements of a vector
+  Arguments(const std::vector<Expression> & args) noexcept;
+
+  /// number of arguments
+  std::size_t size() const noexcept;
+
+  /// true if there are no arguments
+  bool empty() const noexcept;
+
+  /// the argument at index
+  const Expression & operator[](std::size_t index) const noexcept;
+
+  /// iterator to the first argument
+  const Expression * begin() const noexcept;
+
+  /// iterator past the last argument
+  const Expression * end() const noexcept;
+
+private:
+  const Expression * first;
+  std::size_t count;
+};
+
+// the entry points of a built-in procedure, see environment.hpp
+typedef Expression (*Procedure)(Arguments args);
+typedef Expression (*UnaryProcedure)(const Expression & arg);
+typedef Expression (*BinaryProcedure)(const Expression & left, const Expression & right);
+typedef Expression (*ReduceProcedure)(const ExpressionList & list);
+struct Builtin;
+
+// forward declare Closure, see frame.hpp
+struct Closure;
+
+// forward declare MemoKey, see memo.hpp
+struct MemoKey;
+
 /*! \class Expression
 \brief An expression is a tree of Atoms.
 
 An expression is an atom called the head followed by a (possibly empty) 
-list of expressions called the tail.
+list of expressions called the tail. The tail is an ExpressionList, so
+copying an Expression shares its children instead of copying them.
  */
 class Expression {
 public:
 
-  typedef std::vector<Expression>::const_iterator ConstIteratorType;
+  typedef ExpressionList::const_iterator ConstIteratorType;
+
+  /*! \enum Dispatch
+    \brief How eval handles a node: a special form, a terminal lookup or a
+    call. Decided once per node by resolve(), nodes built during evaluation
+    are Unresolved and classified when they are evaluated.
+   */
+  enum class Dispatch : std::uint8_t {
+    Unresolved, Terminal, List, Begin, Define, Apply, Map, PMap, Reduce, Fold, SetProp, GetProp,
+    DiscPlot, ContPlot, Lambda, If, Cond, And, Or, Do, While, ForEach, Call
+  };
 
   /// Default construct and Expression, whose type in NoneType
   Expression();
@@ -40,26 +106,45 @@ public:
   */
   Expression(const Atom & a);
 
-  /// deep-copy construct an expression (recursive)
+  /// copy construct an expression, the tail is shared until modified
   Expression(const Expression & a);
 
-  /// deep-copy assign an expression  (recursive)
+  /// move construct an expression, the tail, properties and closure are moved and the head is copied
+  Expression(Expression && a) noexcept;
+
+  /// copy assign an expression, the tail is shared until modified
   Expression & operator=(const Expression & a);
 
+  /// move assign an expression, the tail, properties and closure are moved and the head is copied
+  Expression & operator=(Expression && a) noexcept;
+
+  /*! number of Expression copies (construction or assignment) made so far.
+    Only the library the unit tests link, built with EXPRESSION_COUNT_COPIES,
+    counts them; elsewhere it is always 0.
+   */
+  static std::size_t copyCount() noexcept;
+
   /// return a reference to the head Atom
   Atom & head();
 
   /// return a const-reference to the head Atom
   const Atom & head() const;
 
-  std::vector<Expression>& rTail();
+  /// return a reference to the tail
+  ExpressionList& rTail();
 
-  /// return a const-reference to the head Atom
-  const std::vector<Expression>& rTail() const;
+  /// return a const-reference to the tail
+  const ExpressionList& rTail() const;
 
   /// append Atom to tail of the expression
   void append(const Atom & a);
 
+  /// append a copy of an Expression to the tail of the expression
+  void append(const Expression & e);
+
+  /// move an Expression onto the tail of the expression
+  void append(Expression && e);
+
   /// return a pointer to the last expression in the tail, or nullptr
   Expression * tail();
 
@@ -87,62 +172,156 @@ public:
   void setLLambda(bool set);
 
   /// Evaluate expression using a post-order traversal (recursive)
-  Expression eval(Environment & env);
+  Expression eval(Environment & env) const;
+
+  /*! Tag this expression and its children with their Dispatch, and resolve
+    the heads of calls to built-in procedures in env. Run once after parsing,
+    and again if the head or tail of a resolved expression is changed.
+    \param env the environment the procedures are resolved in
+   */
+  void resolve(const Environment & env);
+
+  /// how eval handles this expression
+  Dispatch dispatch() const noexcept;
 
   /// equality comparison for two expressions (recursive)
   bool operator==(const Expression & exp) const noexcept;
+
+  /*! Make a memoized copy of a lambda value. Calls of the copy, and of
+    copies of it, whose arguments are all Numbers look up their result in a
+    MemoTable of the given capacity first. The results are dropped whenever
+    the environment changes, see Environment::generation.
+    \param capacity the most results kept
+    \return the memoized lambda
+    \throws SemanticError if this is not a lambda or its body may define a
+    symbol in the environment
+   */
+  Expression memoized(std::size_t capacity) const;
   
   bool inLambda = false;
-  void helperinL(Expression & oper);
 
   bool is_prop(const Atom &key) const;
   Expression get_prop(const Atom &key) const;
   void add_prop(const Atom &key, const Expression &prop);
+  void add_prop(const Atom &key, Expression &&prop);
   
 
   void setError();
   bool isError();
 
 private:
+  // the bytecode machine binds defines and falls back to the tree walker
+  friend class VirtualMachine;
+
+  // packed lists inspect elements to decide whether they can be packed
+  friend class ExpressionList;
+
   // the head of the expression
   Atom m_head;
-  std::map<std::string, Expression> propMap;
+  std::map<SymbolId, Expression> propMap;
   
   bool error = false;
   bool isList = false;
   bool islambda = false;
   bool islambdaexp = false;
-  // the tail list is expressed as a vector for access efficiency
-  // and cache coherence, at the cost of wasted memory.
-  std::vector<Expression> m_tail;
+  // the tail list is a contiguous slice of a shared buffer for access
+  // efficiency and cache coherence, copies share it until modified.
+  ExpressionList m_tail;
+
+  // the slot of the current Frame this symbol refers to, or -1. Set when
+  // the body of a lambda is resolved.
+  int m_slot = -1;
+
+  // the slot layout of a lambda value, see frame.hpp
+  std::shared_ptr<const Closure> m_closure;
+
+  // set by resolve()
+  Dispatch m_dispatch = Dispatch::Unresolved;
+
+  // the built-in procedure the head of a Call resolved to, valid while the
+  // environment is at epoch m_epoch, see Environment::epoch
+  const Builtin * m_builtin = nullptr;
+  std::uint32_t m_epoch = 0;
+
+  // inline cache of the binding a Terminal or a Call to a lambda found on
+  // its last evaluation, see Environment::value_at. Bodies are shared
+  // between threads, so it is atomic.
+  mutable std::atomic<std::uint64_t> m_cache{0};
 
   // convenience typedef
-  typedef std::vector<Expression>::iterator IteratorType;
+  typedef ExpressionList::iterator IteratorType;
   
   // internal helper methods
-  Expression handle_lookup(const Atom & head, const Environment & env);
-  Expression handle_define(Environment & env);
-  Expression handle_begin(Environment & env);
-  Expression handle_list(Environment & env);
-
-  Expression handle_lambda();
-  Expression handle_lambda_lookup(const Atom & head, Environment & env);
+  Dispatch classify() const noexcept;
+  const Expression * cached_binding(const Environment & env, bool lambdas) const;
+  Expression handle_lookup(const Atom & head, const Environment & env) const;
+  Expression handle_define(Environment & env) const;
+  Expression bind_define(Environment & env, const Expression & result) const;
+  Expression handle_begin(Environment & env) const;
+  Expression handle_list(Environment & env) const;
+
+  Expression handle_lambda() const;
+  Expression handle_lambda_call(const Expression & lambda, Environment & env) const;
+  Expression run_lambda(const Expression & lambda, Environment & env, std::size_t base) const;
+  Expression run_body(const Expression & lambda, Environment & env, std::size_t base) const;
+  static bool memo_key(std::size_t base, MemoKey & key);
+  bool writes_environment() const;
+  void push_arguments(const Expression & lambda, Environment & env) const;
+  const Expression * lambda_callee(const Environment & env) const;
+  const Expression & if_branch(Environment & env) const;
+  const Expression * cond_branch(Environment & env) const;
+  const Expression * logic_operands(Environment & env, Expression & result) const;
+  Expression handle_loop(Environment & env) const;
+  bool is_slot_lambda() const;
+  void collect_locals(std::vector<SymbolId> & names) const;
+  void collect_symbols(std::vector<SymbolId> & names) const;
+  Expression resolved(const Closure & closure) const;
   
 
-  Expression handle_apply(Environment & env);
-  Expression handle_map(Environment & env);
-  Expression handle_setprop(Environment & env);
-  Expression handle_getprop(Environment & env);
-  Expression handle_discplot(Environment & env);
-  Expression handle_contplot(Environment & env);
-
-  bool checkline(const double x1, const double y1, const double x2, const double y2, const double x3, const double y3);
-
-  Expression make_box(Environment & env, const double minX, const double minY, const double maxX, const double maxY);
-  Expression make_pos_labels(Environment & env, const double C, const double D, const double scale, const double minX, const double maxX, const double minY, const double maxY, const double Xscale, const double Yscale);
-  Expression helper_make_text(Environment & env, const std::string cont, const double XN, const double YN, const double X, const double Y, const double scale);
-  Expression helper_make_line(Environment & env, const double x1, const double y1, const double x2, const double y2, const double thickness);
-  Expression helper_make_point(Environment & env, const double x, const double y, const double size);
+  Expression handle_call(Environment & env) const;
+  Expression make_callee_call(const Builtin * builtin, const Environment & env) const;
+  Expression argument(std::size_t index, Environment & env) const;
+
+  Expression handle_apply(Environment & env) const;
+  Expression handle_map(Environment & env) const;
+  Expression handle_pmap(Environment & env) const;
+  Expression handle_reduce(Environment & env) const;
+  Expression handle_setprop(Environment & env) const;
+  Expression handle_getprop(Environment & env) const;
+  Expression handle_discplot(Environment & env) const;
+  // the decimation options of a discrete plot, see handle_discplot
+  struct Decimation {
+    // the most points drawn, 0 if unbounded
+    std::size_t maxPoints = 0;
+    // min-max per column instead of largest-triangle-three-buckets
+    bool minMax = false;
+  };
+  static Decimation discplot_options(const Expression & options);
+  Expression handle_contplot(Environment & env) const;
+  // the sampling options of a continuous plot, see handle_contplot
+  struct Sampling {
+    // initial segments, and passes of refinement
+    std::size_t samples = 50;
+    std::size_t maxDepth = 9;
+    // calls of the function, 0 if unbounded
+    std::size_t maxEvaluations = 0;
+    // the bend in degrees a sample may have, or the distance in plot units
+    // it may be off the line between its neighbours if not 0
+    double tolerance = 5;
+    double pixelTolerance = 0;
+  };
+  static Sampling contplot_options(const Expression & options);
+  std::vector<double> contplot_samples(const Expression & func, const std::vector<double> & xs, Environment & env) const;
+  void refine_contplot(const Expression & func, const Sampling & sampling, std::vector<double> & xs, std::vector<double> & ys, Environment & env) const;
+
+  bool checkline(const double x1, const double y1, const double x2, const double y2, const double x3, const double y3, const double tolerance = 5) const;
+
+  Expression make_box(const double minX, const double minY, const double maxX, const double maxY) const;
+  Expression make_pos_labels(const double C, const double D, const double scale, const double minX, const double maxX, const double minY, const double maxY, const double Xscale, const double Yscale) const;
+  Expression helper_make_text(const std::string cont, const double XN, const double YN, const double X, const double Y, const double scale) const;
+  Expression helper_make_line(const double x1, const double y1, const double x2, const double y2, const double thickness) const;
+  Expression helper_make_point(const double x, const double y, const double size) const;
+  static Expression object_list(Expression && stage);
 };
 
 /// Render expression to output stream
@@ -150,5 +329,33 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp);
 
 /// inequality comparison for two expressions (recursive)
 bool operator!=(const Expression & left, const Expression & right) noexcept;
-  
+
+#include "list.tpp"
+
+inline Arguments::Arguments(const Expression * first, std::size_t count) noexcept:
+  first(first), count(count){}
+
+inline Arguments::Arguments(const std::vector<Expression> & args) noexcept:
+  first(args.data()), count(args.size()){}
+
+inline std::size_t Arguments::size() const noexcept{
+  return count;
+}
+
+inline bool Arguments::empty() const noexcept{
+  return count == 0;
+}
+
+inline const Expression & Arguments::operator[](std::size_t index) const noexcept{
+  return first[index];
+}
+
+inline const Expression * Arguments::begin() const noexcept{
+  return first;
+}
+
+inline const Expression * Arguments::end() const noexcept{
+  return first + count;
+}
+
 #endif
@@ -0,0 +1,110 @@
+#include "frame.hpp"
+
+#include <new>
+
+// the innermost running frame of each thread
+static thread_local Frame * active = nullptr;
+
+int Closure::find(SymbolId sym) const noexcept{
+  for(std::size_t i = 0; i < names.size(); ++i){
+    if(names[i] == sym){
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+Frame::Frame(const Closure & closure){
+  build(closure);
+}
+
+Frame::~Frame(){
+  destroy();
+}
+
+void Frame::build(const Closure & closure){
+
+  std::size_t n = closure.names.size();
+  if(n <= InlineSlots){
+    slots = reinterpret_cast<Expression *>(inlineStorage);
+  }
+  else{
+    slots = static_cast<Expression *>(::operator new(n * sizeof(Expression)));
+  }
+  count = n;
+  m_closure = &closure;
+  unbound = 0;
+
+  std::size_t first = count - closure.captured.size();
+  for(std::size_t i = 0; i < first; ++i){
+    new (slots + i) Expression();
+  }
+  for(std::size_t i = first; i < count; ++i){
+    new (slots + i) Expression(closure.captured[i - first]);
+  }
+  std::size_t end = closure.params + closure.locals;
+  for(std::size_t i = closure.params; (i < end) && (i < 64); ++i){
+    unbound |= (std::uint64_t(1) << i);
+  }
+  unboundHigh.assign((end > 64) ? end - 64 : 0, true);
+}
+
+void Frame::destroy() noexcept{
+  for(std::size_t i = 0; i < count; ++i){
+    slots[i].~Expression();
+  }
+  if(count > InlineSlots){
+    ::operator delete(slots);
+  }
+  count = 0;
+}
+
+void Frame::reset(const Closure & closure){
+  destroy();
+  build(closure);
+}
+
+std::size_t Frame::size() const noexcept{
+  return count;
+}
+
+Expression & Frame::operator[](std::size_t i) noexcept{
+  return slots[i];
+}
+
+const Expression & Frame::operator[](std::size_t i) const noexcept{
+  return slots[i];
+}
+
+bool Frame::bound(std::size_t i) const noexcept{
+  if(i >= 64){
+    return (i - 64 >= unboundHigh.size()) || !unboundHigh[i - 64];
+  }
+  return !(unbound & (std::uint64_t(1) << i));
+}
+
+void Frame::bind(std::size_t i, const Expression & value){
+  slots[i] = value;
+  if(i < 64){
+    unbound &= ~(std::uint64_t(1) << i);
+  }
+  else if(i - 64 < unboundHigh.size()){
+    unboundHigh[i - 64] = false;
+  }
+}
+
+const Closure & Frame::closure() const noexcept{
+  return *m_closure;
+}
+
+Frame * Frame::current() noexcept{
+  return active;
+}
+
+Frame::Activation::Activation(Frame & frame) noexcept: previous(active){
+  active = &frame;
+}
+
+Frame::Activation::~Activation(){
+  active = previous;
+}
@@ -0,0 +1,140 @@
+/*! \file frame.hpp
+Defines the Closure and Frame types used to call user lambdas.
+
+When a lambda is created its body is resolved once: every reference to a
+parameter, to a symbol defined in the body, or to a value captured from the
+enclosing call is annotated with the index of a slot. A call then evaluates
+its arguments into a Frame, a small slot array on the C++ stack, and makes it
+the current frame while the body runs. Lookups of annotated symbols read the
+slot directly, so calls do not touch the Environment and recursive or nested
+calls cannot see each other's bindings.
+ */
+
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// module includes
+#include "symbol.hpp"
+#include "expression.hpp"
+#include "memo.hpp"
+
+/*! \struct Closure
+\brief The slot layout of a lambda, shared by every copy of the lambda value.
+
+The slots hold, in order, the parameters, the symbols defined in the body and
+the values captured from the frame the lambda was created in.
+ */
+struct Closure {
+  /// the symbol naming each slot
+  std::vector<SymbolId> names;
+
+  /// number of parameters, the first slots
+  std::size_t params = 0;
+
+  /// number of symbols defined in the body, the slots after the parameters
+  std::size_t locals = 0;
+
+  /// the captured values, copied into the last slots of every frame
+  std::vector<Expression> captured;
+
+  /*! false if the body may define a symbol in the Environment. Only the
+    calls of a pure lambda can be memoized, see Expression::memoized.
+   */
+  bool pure = true;
+
+  /// the results of earlier calls of a memoized lambda, or nullptr
+  std::shared_ptr<MemoTable> memo;
+
+  /// the slot named sym, or -1 if there is none
+  int find(SymbolId sym) const noexcept;
+};
+
+/*! \class Frame
+\brief The activation record of one call to a user lambda.
+
+Frames with up to InlineSlots slots keep them inside the Frame object, larger
+frames allocate. Frames are made current with a Frame::Activation, the
+current frame is tracked per thread.
+ */
+class Frame {
+public:
+
+  /// slots stored inside the frame itself
+  static const std::size_t InlineSlots = 4;
+
+  /// construct a frame with a default slot for each name of the closure
+  explicit Frame(const Closure & closure);
+
+  ~Frame();
+
+  Frame(const Frame &) = delete;
+  Frame & operator=(const Frame &) = delete;
+
+  /// number of slots
+  std::size_t size() const noexcept;
+
+  /// slot access, no bounds checking
+  Expression & operator[](std::size_t i) noexcept;
+  const Expression & operator[](std::size_t i) const noexcept;
+
+  /*! Determine if a slot holds a value. The slots of symbols defined in the
+    body hold none until the define is evaluated, lookups then fall back to
+    the Environment.
+   */
+  bool bound(std::size_t i) const noexcept;
+
+  /// give the slot of a symbol defined in the body its value
+  void bind(std::size_t i, const Expression & value);
+
+  /// the closure the frame was built for
+  const Closure & closure() const noexcept;
+
+  /*! Rebuild the frame for a call of another closure, reusing its storage.
+    A call in tail position replaces the frame of the running call this way.
+   */
+  void reset(const Closure & closure);
+
+  /// the frame of the innermost running call on this thread, or nullptr
+  static Frame * current() noexcept;
+
+  /*! \class Activation
+  \brief Makes a frame current for its lifetime, restoring the previous one.
+   */
+  class Activation {
+  public:
+    explicit Activation(Frame & frame) noexcept;
+    ~Activation();
+
+    Activation(const Activation &) = delete;
+    Activation & operator=(const Activation &) = delete;
+
+  private:
+    Frame * previous;
+  };
+
+private:
+  typedef std::aligned_storage<sizeof(Expression), alignof(Expression)>::type Storage;
+
+  Storage inlineStorage[InlineSlots];
+  Expression * slots;
+  std::size_t count;
+  const Closure * m_closure;
+
+  // one bit per unbound local slot among the first 64, and a flag per slot
+  // past them; only frames with that many slots allocate the flags
+  std::uint64_t unbound;
+  std::vector<bool> unboundHigh;
+
+  // construct the slots for closure, and destroy them
+  void build(const Closure & closure);
+  void destroy() noexcept;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#include "frame.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "test_programs.hpp"
+
+TEST_CASE( "Test frame slots", "[frame]" ) {
+
+  Closure closure;
+  closure.names = {intern("x"), intern("y"), intern("z"), intern("w"), intern("v")};
+  closure.params = 2;
+  closure.locals = 2;
+  closure.captured.push_back(Expression(5.));
+  REQUIRE(closure.find(intern("z")) == 2);
+  REQUIRE(closure.find(intern("nope")) == -1);
+
+  REQUIRE(Frame::current() == nullptr);
+  {
+    Frame frame(closure);
+    REQUIRE(frame.size() == 5);
+    REQUIRE(frame.bound(0));
+    REQUIRE(!frame.bound(2));
+    REQUIRE(!frame.bound(3));
+    REQUIRE(frame[4] == Expression(5.));
+
+    frame.bind(2, Expression(1.));
+    REQUIRE(frame.bound(2));
+    REQUIRE(frame[2] == Expression(1.));
+
+    Frame::Activation activation(frame);
+    REQUIRE(Frame::current() == &frame);
+  }
+  REQUIRE(Frame::current() == nullptr);
+}
+
+TEST_CASE( "Test lambda calls use frames", "[frame]" ) {
+
+  INFO("a call does not clobber the caller's arguments");
+  REQUIRE(run("(begin (define f (lambda (x) (+ x 1))) (define g (lambda (x) (+ (f 10) x))) (g 3))") ==
+	  Expression(14.));
+
+  INFO("arguments are not visible after the call");
+  REQUIRE_THROWS_AS(run("(begin (define f (lambda (x) (+ x 1))) (f 5) x)"), SemanticError);
+
+  INFO("symbols defined in the body are local to each call");
+  REQUIRE(run("(begin (define f (lambda (x) (begin (define b (* x 2)) (define h (lambda (y) (+ y b))) (h 1)))) "
+	      "(+ (f 1) (f 10)))") == Expression(24.));
+
+  INFO("lambdas capture the values of the enclosing call");
+  REQUIRE(run("(begin (define make-adder (lambda (n) (lambda (x) (+ x n)))) (define add5 (make-adder 5)) "
+	      "(define add7 (make-adder 7)) (+ (add5 1) (add7 1)))") == Expression(14.));
+  REQUIRE(run("(begin (define f (lambda (a) (lambda (b) (lambda (c) (list a b c))))) "
+	      "(define g (f 1)) (define h (g 2)) (h 3))") == run("(list 1 2 3)"));
+
+  INFO("lambdas can be passed as arguments and called through a parameter");
+  REQUIRE(run("(begin (define twice (lambda (f x) (f (f x)))) (define inc (lambda (x) (+ x 1))) (twice inc 5))") ==
+	  Expression(7.));
+  REQUIRE(run("(begin (define mapper (lambda (f l) (map f l))) (define inc (lambda (x) (+ x 1))) "
+	      "(mapper inc (list 1 2)))") == run("(list 2 3)"));
+  REQUIRE(run("(begin (define add (lambda (a b) (+ a b))) (define caller (lambda (f) (apply f (list 4 5)))) "
+	      "(caller add))") == Expression(9.));
+
+  INFO("many parameters spill out of the inline slots");
+  REQUIRE(run("(begin (define f (lambda (a b c d e g) (+ a b c d e g))) (f 1 2 3 4 5 6))") == Expression(21.));
+
+  INFO("a local read before its define is the global, also past the 64th slot");
+  for(int locals : {4, 71}){
+    std::string body;
+    for(int i = 0; i < locals; ++i){
+      body += " (define v" + std::to_string(i) + " " + std::to_string(i) + ")";
+    }
+    REQUIRE(run("(begin (define w 7) (define f (lambda (x) (begin" + body +
+		" (define r w) (define w 1) (+ r w)))) (f 0))") == Expression(8.));
+  }
+
+  INFO("parameters must be symbols");
+  REQUIRE_THROWS_AS(run("(begin (define x (lambda (1) (+ x 1))) (x 2))"), SemanticError);
+}
+
+TEST_CASE( "Test lambda bodies are shared by every call", "[frame]" ) {
+
+  std::istringstream iss("(begin (define f (lambda (x) (begin (define y (+ x 1)) (* (+ x 2) (- y 3) (/ x 4))))) "
+			 "(map f (range 0 99 1)))");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+
+  // copying and re-annotating the body on every call made 2330 copies
+  std::size_t before = Expression::copyCount();
+  Expression result = interp.evaluate();
+  REQUIRE(result.rTail().size() == 100);
+  REQUIRE(Expression::copyCount() - before < 800);
+
+  INFO("evaluating a body does not modify it");
+  REQUIRE(run("(begin (define f (lambda (x) (set-property \"k\" x (list 1)))) (f 1) (get-property \"k\" (f 2)))") ==
+	  Expression(2.));
+}
+
+TEST_CASE( "Test calls in tail position reuse the frame", "[frame]" ) {
+
+  INFO("deep enough to overflow the C++ stack if each call recursed");
+  REQUIRE(run("(begin (define loop (lambda (i acc) (if (= i 0) acc (loop (- i 1) (+ acc 1))))) "
+	      "(loop 200000 0))") == Expression(200000.));
+
+  INFO("through begin, cond, and, or and mutual recursion");
+  REQUIRE(run("(begin (define count (lambda (i) (begin (define j (- i 1)) (cond (< j 0) i (count j))))) "
+	      "(count 200000))") == Expression(0.));
+  REQUIRE(run("(begin (define even (lambda (n) (or (= n 0) (odd (- n 1))))) "
+	      "(define odd (lambda (n) (and (not (= n 0)) (even (- n 1))))) "
+	      "(list (even 100001) (odd 100001)))") == run("(list 0 1)"));
+
+  INFO("a tail call to a lambda with more slots and captures");
+  REQUIRE(run("(begin (define make (lambda (n) (lambda (a b c d e) (+ a b c d e n)))) (define g (make 10)) "
+	      "(define f (lambda (x) (g x 1 2 3 4))) (f 5))") == Expression(25.));
+  REQUIRE(run("(begin (define twice (lambda (f x) (f (f x)))) (define inc (lambda (x) (+ x 1))) (twice inc 5))") ==
+	  Expression(7.));
+
+  INFO("errors in tail position");
+  REQUIRE_THROWS_AS(run("(begin (define f (lambda (x) (g x))) (define g (lambda (x y) x)) (f 1))"), SemanticError);
+
+  Closure small, large;
+  small.names = {intern("x")};
+  small.params = 1;
+  large.names = {intern("a"), intern("b"), intern("c"), intern("d"), intern("e"), intern("n")};
+  large.params = 5;
+  large.captured.push_back(Expression(10.));
+  Frame frame(small);
+  frame[0] = Expression(1.);
+  frame.reset(large);
+  REQUIRE(frame.size() == 6);
+  REQUIRE(&frame.closure() == &large);
+  REQUIRE(frame[0] == Expression());
+  REQUIRE(frame[5] == Expression(10.));
+  frame.reset(small);
+  REQUIRE(frame.size() == 1);
+}
+
+TEST_CASE( "Test deep recursion that is not a tail call", "[frame]" ) {
+
+  std::string down = "(define d (lambda (n) (if (= n 0) 0 (+ 1 (d (- n 1))))))";
+  REQUIRE(run("(begin " + down + " (d 1000))") == Expression(1000.));
+
+  INFO("too deep to run on the C++ stack");
+  try{
+    run("(begin " + down + " (d 3000))");
+    FAIL("the recursion did not throw");
+  }
+  catch(const SemanticError & ex){
+    REQUIRE(std::string(ex.what()) == "Error during evaluation: maximum recursion depth exceeded");
+  }
+}
+
+#if defined(__linux__)
+// evaluates program on a thread with a small stack, for the recursion limit
+static void * runOnSmallStack(void * program){
+  std::string & text = *static_cast<std::string *>(program);
+  text = outcome(text);
+  return nullptr;
+}
+
+TEST_CASE( "Test the recursion limit follows the size of the stack", "[frame]" ) {
+
+  std::string program = "(begin (define d (lambda (n) (if (= n 0) 0 (+ 1 (d (- n 1)))))) (d 1000))";
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 512 * 1024);
+  pthread_t thread;
+  REQUIRE(pthread_create(&thread, &attr, runOnSmallStack, &program) == 0);
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+  REQUIRE(program == "Error during evaluation: maximum recursion depth exceeded");
+}
+#endif
+
+TEST_CASE( "Test frames are released when the recursion limit is reached", "[frame]" ) {
+
+  std::istringstream iss("(define d (lambda (n) (if (= n 0) 0 (+ 1 (d (- n 1))))))");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+  interp.evaluate();
+
+  auto evaluate = [&interp](const std::string & program){
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    return interp.evaluate();
+  };
+
+  INFO("the error unwinds every frame, so the same depth runs again");
+  REQUIRE_THROWS_AS(evaluate("(d 5000)"), SemanticError);
+  REQUIRE(evaluate("(d 1000)") == Expression(1000.));
+  REQUIRE_THROWS_AS(evaluate("(begin (define f (lambda (k) (d (* k 1000)))) (pmap f (list 1 2 3 4)))"), SemanticError);
+  REQUIRE(evaluate("(d 1000)") == Expression(1000.));
+}
@@ -8,12 +8,14 @@
 #include "parse.hpp"
 #include "expression.hpp"
 #include "environment.hpp"
+#include "bytecode.hpp"
 #include "semantic_error.hpp"
 bool Interpreter::parseStream(std::istream & expression) noexcept{
 
   TokenSequenceType tokens = tokenize(expression);
 
-  ast = parse(tokens);
+  ast = fold_constants(parse(tokens));
+  ast.resolve(env);
 
   return (ast != Expression());
 };
@@ -21,6 +23,19 @@ bool Interpreter::parseStream(std::istream & expression) noexcept{
 
 Expression Interpreter::evaluate(){
 
-  return ast.eval(env);
+  if(evalMode == TreeWalk){
+    return ast.eval(env);
+  }
+
+  Chunk chunk = compile(ast, env);
+  return vm.run(chunk, env);
+}
+
+void Interpreter::setMode(Mode m) noexcept{
+  evalMode = m;
+}
+
+Interpreter::Mode Interpreter::mode() const noexcept{
+  return evalMode;
 }
 
@@ -14,6 +14,7 @@ It maintains an environment during evaluation.
 // module includes
 #include "environment.hpp"
 #include "expression.hpp"
+#include "bytecode.hpp"
 
 /*! \class Interpreter
 \brief Class to parse and evaluate an expression (program)
@@ -25,18 +26,32 @@ The eval method updates Environment and returns last result.
 class Interpreter {
 public:
 
+  /*! \enum Mode
+    \brief how evaluate() runs the parsed program.
+
+    Bytecode compiles the AST and runs it on the VirtualMachine. TreeWalk is
+    the reference mode, it calls Expression::eval directly.
+   */
+  enum Mode { Bytecode, TreeWalk };
+
   /*! Parse into an internal Expression from a stream
     \param expression the raw text stream repreenting the candidate expression
     \return true on successful parsing 
    */
   bool parseStream(std::istream &expression) noexcept;
 
-  /*! Evaluate the Expression by walking the tree, returning the result.
+  /*! Evaluate the Expression in the current mode, returning the result.
     \return the Expression resulting from the evaluation in the current environment
     \throws SemanticError when a semantic error is encountered
    */
   Expression evaluate();
 
+  /// select the evaluation mode, Bytecode by default
+  void setMode(Mode m) noexcept;
+
+  /// the current evaluation mode
+  Mode mode() const noexcept;
+
 
 private:
 
@@ -46,6 +61,12 @@ private:
   // the AST
   Expression ast;
 
+  // the evaluation mode
+  Mode evalMode = Bytecode;
+
+  // the machine used in Bytecode mode
+  VirtualMachine vm;
+
 };
 
 #endif
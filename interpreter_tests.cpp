@@ -1,32 +1,18 @@
 #include "catch.hpp"
 
+#include <cmath>
+#include <functional>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "semantic_error.hpp"
 #include "interpreter.hpp"
 #include "expression.hpp"
 #include "startup_config.hpp"
-
-Expression run(const std::string & program){
-  
-  std::istringstream iss(program);
-    
-  Interpreter interp;
-    
-  bool ok = interp.parseStream(iss);
-  if(!ok){
-    std::cerr << "Failed to parse: " << program << std::endl; 
-  }
-  REQUIRE(ok == true);
-
-  Expression result;
-  REQUIRE_NOTHROW(result = interp.evaluate());
-
-  return result;
-}
+#include "test_programs.hpp"
 
 TEST_CASE( "Test Interpreter parser with expected input", "[interpreter]" ) {
 
@@ -293,6 +279,43 @@ TEST_CASE( "Test for exceptions from semantically incorrect input", "[interprete
   REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
 }
 
+TEST_CASE( "Test comparisons and conditionals", "[interpreter]" ) {
+
+  REQUIRE(run("(< 1 2)") == Expression(1.));
+  REQUIRE(run("(> 1 2)") == Expression(0.));
+  REQUIRE(run("(<= 2 2)") == Expression(1.));
+  REQUIRE(run("(>= 1 2)") == Expression(0.));
+  REQUIRE(run("(= 2 2)") == Expression(1.));
+  REQUIRE(run("(not 0)") == Expression(1.));
+  REQUIRE(run("(not 3)") == Expression(0.));
+
+  REQUIRE(run("(begin (define a 1) (define b pi) (if (< a b) b a))") == Expression(std::atan2(0, -1)));
+
+  INFO("only the selected branch is evaluated");
+  REQUIRE(run("(if 0 (undefined) 2)") == Expression(2.));
+  REQUIRE(run("(cond (> 1 2) (undefined) (< 1 2) 5 (undefined))") == Expression(5.));
+  REQUIRE(run("(cond 0 1 7)") == Expression(7.));
+  REQUIRE(run("(and 1 0 (undefined))") == Expression(0.));
+  REQUIRE(run("(and 1 2)") == Expression(2.));
+  REQUIRE(run("(or 0 3 (undefined))") == Expression(3.));
+  REQUIRE(run("(or 0 0)") == Expression(0.));
+
+  std::vector<std::string> programs = {"(< 1 I)", // not a real number
+				       "(< 1 2 3)", // too many arguments
+				       "(if (list 1) 1 2)", // condition not a number
+				       "(if 1 2)", // missing branch
+				       "(cond 0 1)", // no true condition
+				       "(and \"a\" 1)"};
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
 TEST_CASE( "Test malformed define", "[interpreter]" ) {
 
     std::string input = R"(
@@ -1810,3 +1833,225 @@ TEST_CASE("Test Prersonal 98", "[interpreter]") {
 	Expression result = interp.evaluate();
 	REQUIRE(result.rTail().size() == 78);
 }
+
+TEST_CASE( "Test loops", "[interpreter]" ) {
+
+  REQUIRE(run("(do (i 0 (+ i 1)) (acc 0 (+ acc i)) (= i 5) acc)") == Expression(10.));
+  REQUIRE(run("(while (i 0 (+ i 1)) (acc 1 (* acc 2)) (< i 10) acc)") == Expression(1024.));
+  REQUIRE(run("(for-each (x (range 1 4 1)) (acc 0 (+ acc x)) acc)") == Expression(10.));
+  REQUIRE(run("(for-each (x (list)) (acc 5 (+ acc x)) acc)") == Expression(5.));
+  REQUIRE(run("(for-each (x (list (list 1 2) (list 3))) (n 0 (+ n (length x))) n)") == Expression(3.));
+
+  INFO("steps are evaluated with the values of the previous iteration");
+  REQUIRE(run("(do (i 0 (+ i 1)) (a 0 b) (b 1 (+ a b)) (= i 10) a)") == Expression(55.));
+
+  INFO("loop variables shadow and capture the enclosing bindings");
+  REQUIRE(run("(begin (define n 4) (do (i 0 (+ i 1)) (= i n) (* i pi)))") == Expression(4 * std::atan2(0, -1)));
+  REQUIRE(run("(begin (define f (lambda (x n) (do (i 0 (+ i 1)) (x x (* x 2)) (= i n) x))) (f 3 2))") ==
+	  Expression(12.));
+  REQUIRE(run("(do (e 0 (+ e 1)) (= e 3) e)") == Expression(3.));
+  REQUIRE(run("(for-each (x (range 1 3 1)) (acc 0 (+ acc (do (j 0 (+ j 1)) (= j x) j))) acc)") == Expression(6.));
+
+  std::vector<std::string> programs = {"(do (i 0 (+ i 1)))", // missing result
+				       "(do (i 0 (+ i 1) 2) (= i 1) i)", // too many parts
+				       "(do (1 0) 0 1)", // not a symbol
+				       "(for-each (x 1) 0)", // not a list
+				       "(while (i 0) (list) i)"}; // condition not a number
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE( "Test reduce and fold", "[interpreter]" ) {
+
+  REQUIRE(run("(reduce + (list 1 2 3))") == Expression(6.));
+  REQUIRE(run("(reduce - (list 10 1 2))") == Expression(7.));
+  REQUIRE(run("(fold - 10 (list 1 2))") == Expression(7.));
+  REQUIRE(run("(fold + 5 (list))") == Expression(5.));
+  REQUIRE(run("(reduce + (list 1 I))") == Expression(std::complex<double>(1, 1)));
+  REQUIRE(run("(reduce join (list (list 1) (list 2 3) (list 4)))") == run("(list 1 2 3 4)"));
+  REQUIRE(run("(min 3 1 2)") == Expression(1.));
+  REQUIRE(run("(max 3 1 2)") == Expression(3.));
+  REQUIRE(run("(max 2)") == Expression(2.));
+
+  INFO("lambdas, also from a frame");
+  REQUIRE(run("(begin (define f (lambda (acc x) (+ (* acc 10) x))) (reduce f (list 1 2 3)))") == Expression(123.));
+  REQUIRE(run("(begin (define f (lambda (acc x) (join acc (list x x)))) (fold f (list 0) (list 1 2)))") ==
+	  run("(list 0 1 1 2 2)"));
+  REQUIRE(run("(begin (define g (lambda (n) (begin (define f (lambda (a x) (+ a (* n x)))) (fold f 0 (range 1 3 1))))) (g 2))") ==
+	  Expression(12.));
+
+  std::vector<std::string> programs = {"(reduce + (list))", // empty
+				       "(reduce + 1)", // not a list
+				       "(reduce 1 (list 1 2))", // not a procedure
+				       "(fold + (list 1 2))", // missing init
+				       "(reduce + (list 1 \"a\"))", // procedure fails
+				       "(begin (define f (lambda (x) x)) (reduce f (list 1 2)))", // arity
+				       "(max 1 I)",
+				       "(min)"};
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+
+  std::istringstream iss("(fold + 1 (list 1 \"a\"))");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+  try{
+    interp.evaluate();
+    FAIL("fold did not throw");
+  }
+  catch(const SemanticError & ex){
+    REQUIRE(std::string(ex.what()).find("Error: during fold: ") == 0);
+  }
+}
+
+TEST_CASE( "Test indexed list access", "[interpreter]" ) {
+
+  REQUIRE(run("(nth (list 4 5 6) 0)") == Expression(4.));
+  REQUIRE(run("(nth (list 4 5 6) 2)") == Expression(6.));
+  REQUIRE(run("(last (list 4 5 6))") == Expression(6.));
+  REQUIRE(run("(slice (list 4 5 6 7) 1 3)") == run("(list 5 6)"));
+  REQUIRE(run("(slice (list 4 5 6 7) 0 4)") == run("(list 4 5 6 7)"));
+  REQUIRE(run("(slice (list 4 5 6 7) 2 2)") == run("(list)"));
+  REQUIRE(run("(append (slice (list 4 5 6 7) 0 2) 8)") == run("(list 4 5 8)"));
+  REQUIRE(run("(begin (define l (list 4 5 6 7)) (define s (append (slice l 0 2) 8)) l)") == run("(list 4 5 6 7)"));
+
+  std::vector<std::string> programs = {"(nth (list 1 2) 2)", // out of range
+				       "(nth (list 1 2) -1)",
+				       "(nth (list 1 2) 0.5)", // not an integer
+				       "(nth (list) 0)",
+				       "(nth 1 0)", // not a list
+				       "(nth (list 1))",
+				       "(last (list))",
+				       "(last 1)",
+				       "(slice (list 1 2) 1 3)",
+				       "(slice (list 1 2) 2 1)",
+				       "(slice (list 1 2) 0)"};
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE( "Test plot objects", "[interpreter]" ) {
+
+  // the objects the startup lambdas build, with the properties plots add
+  std::string program = R"(
+(begin
+  (define p (set-property "size" 0 (make-point -10 -10)))
+  (define q (set-property "size" 0 (make-point 10 -10)))
+  (list (set-property "thickness" 0 (make-line p q))
+        (set-property "text-scale" 2 (set-property "position" (set-property "size" 0 (make-point -12 -10)) (make-text "1")))))
+)";
+  Interpreter interp;
+  std::ifstream ifs(STARTUP_FILE);
+  interp.parseStream(ifs);
+  interp.evaluate();
+  std::istringstream iss(program);
+  REQUIRE(interp.parseStream(iss));
+  Expression expected = interp.evaluate();
+
+  INFO("plots build the same objects without the startup file");
+  Expression plot = run(R"((discrete-plot (list (list -1 -1) (list 1 1)) (list (list "text-scale" 2))))");
+  REQUIRE(plot.rTail().size() > 4);
+
+  std::vector<std::string> keys = {"\"object-name\"", "\"size\"", "\"thickness\"", "\"position\"", "\"text-scale\""};
+  std::function<void(const Expression &, const Expression &)> same =
+    [&](const Expression & left, const Expression & right){
+    REQUIRE(left == right);
+    for(auto & spelling : keys){
+      Atom key(spelling);
+      key.setString();
+      REQUIRE(left.is_prop(key) == right.is_prop(key));
+      if(left.is_prop(key)){
+	same(left.get_prop(key), right.get_prop(key));
+      }
+    }
+    for(std::size_t i = 0; i < left.rTail().size(); ++i){
+      same(left.rTail()[i], right.rTail()[i]);
+    }
+  };
+  same(plot.rTail()[0], expected.rTail()[0]);
+  same(plot.rTail()[4], expected.rTail()[1]);
+}
+
+TEST_CASE( "Test continuous plot sampling options", "[interpreter]" ) {
+
+  // the plot of a fast sine: a box, 4 labels, 2 axes and the lines
+  auto items = [](const std::string & options){
+    Expression plot = run("(begin (define f (lambda (x) (sin (* 40 x)))) (continuous-plot f (list -3 3) " + options + "))");
+    return plot.rTail().size();
+  };
+  std::size_t plain = items("(list)");
+  REQUIRE(items("(list (list \"samples\" 50) (list \"max-depth\" 9) (list \"tolerance\" 5))") == plain);
+
+  INFO("without refinement there is a line per initial segment");
+  REQUIRE(items("(list (list \"samples\" 10) (list \"max-depth\" 0))") == 20);
+  REQUIRE(items("(list (list \"max-depth\" 0) (list \"title\" \"t\"))") == 61);
+
+  INFO("a looser tolerance or a budget samples fewer points");
+  REQUIRE(items("(list (list \"tolerance\" 30))") < plain);
+  REQUIRE(items("(list (list \"pixel-tolerance\" 0.5))") < plain);
+  REQUIRE(items("(list (list \"max-evaluations\" 200))") <= 200 + 10);
+  REQUIRE(items("(list (list \"max-evaluations\" 51))") == 60);
+
+  std::vector<std::string> options = {"(list (list \"samples\" 0))",
+				      "(list (list \"samples\" 2.5))",
+				      "(list (list \"max-depth\" -1))",
+				      "(list (list \"max-evaluations\" 50))", // below the initial samples
+				      "(list (list \"tolerance\" 0))",
+				      "(list (list \"tolerance\" 180))",
+				      "(list (list \"pixel-tolerance\" \"a\"))"};
+  for(auto & o : options){
+    Interpreter interp;
+    std::istringstream iss("(begin (define f (lambda (x) x)) (continuous-plot f (list -1 1) " + o + "))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE( "Test discrete plot decimation", "[interpreter]" ) {
+
+  // the plot of 201 samples of a sine: a box, 4 labels, 2 axes and a dot
+  // and a stem per point drawn
+  auto items = [](const std::string & options){
+    Expression plot = run("(begin (define f (lambda (x) (list x (sin x))))"
+			  " (discrete-plot (map f (range -10 10 0.1)) " + options + "))");
+    return plot.rTail().size();
+  };
+  std::size_t plain = items("(list)");
+  REQUIRE(items("(list (list \"max-points\" 201))") == plain);
+  REQUIRE(items("(list (list \"decimation\" \"min-max\"))") == plain);
+
+  INFO("more points than the most drawn are decimated");
+  REQUIRE(items("(list (list \"max-points\" 50))") == plain - 2 * (201 - 50));
+  REQUIRE(items("(list (list \"max-points\" 50) (list \"decimation\" \"lttb\"))") == plain - 2 * (201 - 50));
+  REQUIRE(items("(list (list \"max-points\" 50) (list \"decimation\" \"min-max\"))") <= plain - 2 * (201 - 50));
+  REQUIRE(items("(list (list \"max-points\" 2))") == plain - 2 * 199);
+
+  std::vector<std::string> options = {"(list (list \"max-points\" 1))",
+				      "(list (list \"max-points\" 10.5))",
+				      "(list (list \"max-points\" \"a\"))",
+				      "(list (list \"decimation\" \"average\"))",
+				      "(list (list \"decimation\" 1))"};
+  for(auto & o : options){
+    Interpreter interp;
+    std::istringstream iss("(discrete-plot (list (list 0 0) (list 1 1)) " + o + ")");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
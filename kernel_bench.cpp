@@ -0,0 +1,82 @@
+// Microbenchmarks for the elementwise numeric kernels. Each case times a
+// builtin called on a whole list against the same work done through map,
+// or a reduce against the same apply, and checks that both give the same
+// result. Build with optimization, e.g.
+// -DCMAKE_BUILD_TYPE=Release, for meaningful numbers.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+struct BenchCase {
+  std::string name;
+  std::string vectorized;
+  std::string mapped;
+};
+
+// best of several runs, in milliseconds
+static double timeProgram(const std::string & program, Expression & result, int runs){
+  double best = 0;
+  for(int r = 0; r < runs; ++r){
+    std::istringstream iss(program);
+    Interpreter interp;
+    if(!interp.parseStream(iss)){
+      throw SemanticError("Error: benchmark program did not parse");
+    }
+    auto start = std::chrono::steady_clock::now();
+    result = interp.evaluate();
+    auto stop = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if((r == 0) || (ms < best)){
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]){
+
+  std::string n = (argc > 1) ? argv[1] : "100000";
+  // the bound is a definition, so the range is not folded when parsing
+  std::string prelude = "(begin (define n " + n + ") ";
+  std::string range = "(range 1 n 1)";
+
+  std::vector<BenchCase> cases = {
+    {"add", "(+ " + range + " 3)", "(begin (define f (lambda (x) (+ x 3))) (map f " + range + "))"},
+    {"mul", "(* " + range + " 3)", "(begin (define f (lambda (x) (* x 3))) (map f " + range + "))"},
+    {"div", "(/ " + range + " 3)", "(begin (define f (lambda (x) (/ x 3))) (map f " + range + "))"},
+    {"sqrt", "(sqrt " + range + ")", "(map sqrt " + range + ")"},
+    {"sin", "(sin " + range + ")", "(map sin " + range + ")"},
+    {"ln", "(ln " + range + ")", "(map ln " + range + ")"},
+    {"pow", "(^ " + range + " 2)", "(begin (define f (lambda (x) (^ x 2))) (map f " + range + "))"},
+    {"complex mul", "(* " + range + " I)", "(begin (define f (lambda (x) (* x I))) (map f " + range + "))"},
+    {"reduce +", "(reduce + " + range + ")", "(apply + " + range + ")"},
+    {"reduce max", "(reduce max (sin " + range + "))", "(apply max (sin " + range + "))"},
+  };
+
+  std::cout << std::left << std::setw(14) << "case" << std::right
+	    << std::setw(14) << "list (ms)" << std::setw(14) << "map (ms)"
+	    << std::setw(10) << "speedup" << "  result" << std::endl;
+
+  bool ok = true;
+  for(auto & c : cases){
+    Expression vec, mapped;
+    double tv = timeProgram(prelude + c.vectorized + ")", vec, 5);
+    double tm = timeProgram(prelude + c.mapped + ")", mapped, 3);
+    bool same = (vec == mapped);
+    ok = ok && same;
+    std::cout << std::left << std::setw(14) << c.name << std::right << std::fixed << std::setprecision(3)
+	      << std::setw(14) << tv << std::setw(14) << tm
+	      << std::setw(9) << std::setprecision(1) << (tm / tv) << "x"
+	      << "  " << (same ? "same" : "DIFFERENT") << std::endl;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
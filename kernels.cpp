@@ -0,0 +1,307 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define KERNELS_SIMD
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNELS_SIMD
+#endif
+
+Operand realOperand(const double * data, bool broadcast){
+  return Operand{data, nullptr, broadcast};
+}
+
+Operand complexOperand(const std::complex<double> * data, bool broadcast){
+  return Operand{nullptr, data, broadcast};
+}
+
+namespace {
+
+/***********************************************************************
+SIMD primitives, one register holds Width doubles
+**********************************************************************/
+
+#if defined(__AVX__)
+
+typedef __m256d Pack;
+const std::size_t Width = 4;
+
+inline Pack load(const Operand & a, std::size_t i){
+  return a.broadcast ? _mm256_set1_pd(a.reals[0]) : _mm256_loadu_pd(a.reals + i);
+}
+inline Pack load(const double * a, std::size_t i){ return _mm256_loadu_pd(a + i); }
+inline Pack splat(double x){ return _mm256_set1_pd(x); }
+inline void store(double * out, std::size_t i, Pack v){ _mm256_storeu_pd(out + i, v); }
+inline Pack padd(Pack a, Pack b){ return _mm256_add_pd(a, b); }
+inline Pack psub(Pack a, Pack b){ return _mm256_sub_pd(a, b); }
+inline Pack pmul(Pack a, Pack b){ return _mm256_mul_pd(a, b); }
+inline Pack pdiv(Pack a, Pack b){ return _mm256_div_pd(a, b); }
+inline Pack psqrt(Pack a){ return _mm256_sqrt_pd(a); }
+inline Pack pneg(Pack a){ return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+
+#elif defined(__SSE2__)
+
+typedef __m128d Pack;
+const std::size_t Width = 2;
+
+inline Pack load(const Operand & a, std::size_t i){
+  return a.broadcast ? _mm_set1_pd(a.reals[0]) : _mm_loadu_pd(a.reals + i);
+}
+inline Pack load(const double * a, std::size_t i){ return _mm_loadu_pd(a + i); }
+inline Pack splat(double x){ return _mm_set1_pd(x); }
+inline void store(double * out, std::size_t i, Pack v){ _mm_storeu_pd(out + i, v); }
+inline Pack padd(Pack a, Pack b){ return _mm_add_pd(a, b); }
+inline Pack psub(Pack a, Pack b){ return _mm_sub_pd(a, b); }
+inline Pack pmul(Pack a, Pack b){ return _mm_mul_pd(a, b); }
+inline Pack pdiv(Pack a, Pack b){ return _mm_div_pd(a, b); }
+inline Pack psqrt(Pack a){ return _mm_sqrt_pd(a); }
+inline Pack pneg(Pack a){ return _mm_xor_pd(a, _mm_set1_pd(-0.0)); }
+
+#endif
+
+/***********************************************************************
+Real kernels, each operation has a scalar and (if available) a SIMD form
+computing the same IEEE operation
+**********************************************************************/
+
+struct AddOp {
+  static double scalar(double a, double b){ return a + b; }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a, Pack b){ return padd(a, b); }
+#endif
+};
+
+struct SubOp {
+  static double scalar(double a, double b){ return a - b; }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a, Pack b){ return psub(a, b); }
+#endif
+};
+
+struct MulOp {
+  static double scalar(double a, double b){ return a * b; }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a, Pack b){ return pmul(a, b); }
+#endif
+};
+
+struct DivOp {
+  static double scalar(double a, double b){ return a / b; }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a, Pack b){ return pdiv(a, b); }
+#endif
+};
+
+template<typename Op>
+void binaryLoop(const Operand & a, const Operand & b, double * out, std::size_t n){
+  std::size_t i = 0;
+#ifdef KERNELS_SIMD
+  for(; i + Width <= n; i += Width){
+    store(out, i, Op::simd(load(a, i), load(b, i)));
+  }
+#endif
+  for(; i < n; ++i){
+    out[i] = Op::scalar(a.real(i), b.real(i));
+  }
+}
+
+struct NegOp {
+  static double scalar(double a){ return -a; }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a){ return pneg(a); }
+#endif
+};
+
+struct RecipOp {
+  static double scalar(double a){ return 1.0 / a; }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a){ return pdiv(splat(1.0), a); }
+#endif
+};
+
+struct SqrtOp {
+  static double scalar(double a){ return std::sqrt(a); }
+#ifdef KERNELS_SIMD
+  static Pack simd(Pack a){ return psqrt(a); }
+#endif
+};
+
+template<typename Op>
+void unaryLoop(const double * a, double * out, std::size_t n){
+  std::size_t i = 0;
+#ifdef KERNELS_SIMD
+  for(; i + Width <= n; i += Width){
+    store(out, i, Op::simd(load(a, i)));
+  }
+#endif
+  for(; i < n; ++i){
+    out[i] = Op::scalar(a[i]);
+  }
+}
+
+// the transcendental functions have no SIMD form in the standard library
+template<double (*F)(double)>
+void libmLoop(const double * a, double * out, std::size_t n){
+  for(std::size_t i = 0; i < n; ++i){
+    out[i] = F(a[i]);
+  }
+}
+
+double libmLog(double x){ return std::log(x); }
+double libmSin(double x){ return std::sin(x); }
+double libmCos(double x){ return std::cos(x); }
+double libmTan(double x){ return std::tan(x); }
+
+/***********************************************************************
+Complex kernels, the operand types select the same std::complex overloads
+the scalar built-ins use
+**********************************************************************/
+
+template<typename T> T element(const Operand & a, std::size_t i);
+template<> double element<double>(const Operand & a, std::size_t i){ return a.real(i); }
+template<> std::complex<double> element<std::complex<double>>(const Operand & a, std::size_t i){ return a.complex(i); }
+
+/***********************************************************************
+Reductions, each folds a block from the left
+**********************************************************************/
+
+struct MinOp {
+  static double scalar(double a, double b){ return (b < a) ? b : a; }
+};
+
+struct MaxOp {
+  static double scalar(double a, double b){ return (a < b) ? b : a; }
+};
+
+template<typename Op>
+double foldLoop(double result, const double * a, std::size_t n){
+  for(std::size_t i = 0; i < n; ++i){
+    result = Op::scalar(result, a[i]);
+  }
+  return result;
+}
+
+double fold(ReduceOp op, const double * a, std::size_t n){
+  switch(op){
+  case ReduceOp::Add: return foldLoop<AddOp>(0.0, a, n);
+  case ReduceOp::Mul: return foldLoop<MulOp>(1.0, a, n);
+  case ReduceOp::Min: return foldLoop<MinOp>(a[0], a + 1, n - 1);
+  case ReduceOp::Max: return foldLoop<MaxOp>(a[0], a + 1, n - 1);
+  }
+  return 0;
+}
+
+template<typename L, typename R>
+std::complex<double> combine(BinaryOp op, L x, R y){
+  switch(op){
+  case BinaryOp::Add: return x + y;
+  case BinaryOp::Sub: return x - y;
+  case BinaryOp::Mul: return x * y;
+  case BinaryOp::Div: return x / y;
+  case BinaryOp::Pow: return std::pow(x, y);
+  }
+  return std::complex<double>();
+}
+
+template<typename L, typename R>
+void complexLoop(BinaryOp op, const Operand & a, const Operand & b, std::complex<double> * out, std::size_t n){
+  for(std::size_t i = 0; i < n; ++i){
+    out[i] = combine(op, element<L>(a, i), element<R>(b, i));
+  }
+}
+
+}
+
+void realBinary(BinaryOp op, const Operand & a, const Operand & b, double * out, std::size_t n){
+  switch(op){
+  case BinaryOp::Add: binaryLoop<AddOp>(a, b, out, n); break;
+  case BinaryOp::Sub: binaryLoop<SubOp>(a, b, out, n); break;
+  case BinaryOp::Mul: binaryLoop<MulOp>(a, b, out, n); break;
+  case BinaryOp::Div: binaryLoop<DivOp>(a, b, out, n); break;
+  case BinaryOp::Pow:
+    for(std::size_t i = 0; i < n; ++i){
+      out[i] = std::pow(a.real(i), b.real(i));
+    }
+    break;
+  }
+}
+
+void complexBinary(BinaryOp op, const Operand & a, const Operand & b, std::complex<double> * out, std::size_t n){
+  typedef std::complex<double> C;
+  if(a.isComplex() && b.isComplex()){
+    complexLoop<C, C>(op, a, b, out, n);
+  }
+  else if(a.isComplex()){
+    complexLoop<C, double>(op, a, b, out, n);
+  }
+  else if(b.isComplex()){
+    complexLoop<double, C>(op, a, b, out, n);
+  }
+  else{
+    complexLoop<double, double>(op, a, b, out, n);
+  }
+}
+
+bool realDomain(UnaryOp op, const double * a, std::size_t n){
+  if((op != UnaryOp::Sqrt) && (op != UnaryOp::Log)){
+    return true;
+  }
+  for(std::size_t i = 0; i < n; ++i){
+    if((op == UnaryOp::Sqrt) && !(a[i] >= 0)){
+      return false;
+    }
+    if((op == UnaryOp::Log) && !(a[i] > 0)){
+      return false;
+    }
+  }
+  return true;
+}
+
+void realUnary(UnaryOp op, const double * a, double * out, std::size_t n){
+  switch(op){
+  case UnaryOp::Neg: unaryLoop<NegOp>(a, out, n); break;
+  case UnaryOp::Recip: unaryLoop<RecipOp>(a, out, n); break;
+  case UnaryOp::Sqrt: unaryLoop<SqrtOp>(a, out, n); break;
+  case UnaryOp::Log: libmLoop<libmLog>(a, out, n); break;
+  case UnaryOp::Sin: libmLoop<libmSin>(a, out, n); break;
+  case UnaryOp::Cos: libmLoop<libmCos>(a, out, n); break;
+  case UnaryOp::Tan: libmLoop<libmTan>(a, out, n); break;
+  }
+}
+
+bool complexDomain(UnaryOp op){
+  return (op == UnaryOp::Neg) || (op == UnaryOp::Recip) || (op == UnaryOp::Sqrt);
+}
+
+void complexUnary(UnaryOp op, const std::complex<double> * a, std::complex<double> * out, std::size_t n){
+  for(std::size_t i = 0; i < n; ++i){
+    switch(op){
+    case UnaryOp::Neg: out[i] = -a[i]; break;
+    case UnaryOp::Recip: out[i] = 1.0 / a[i]; break;
+    case UnaryOp::Sqrt: out[i] = std::sqrt(a[i]); break;
+    default: out[i] = a[i]; break;
+    }
+  }
+}
+
+double realReduce(ReduceOp op, const double * a, std::size_t n){
+  std::size_t blocks = (n + ReduceBlock - 1) / ReduceBlock;
+  if(blocks <= 1){
+    return fold(op, a, n);
+  }
+  std::vector<double> partial(blocks);
+  ThreadPool::shared().parallel_for(blocks, 1, [&](std::size_t begin, std::size_t end){
+      for(std::size_t b = begin; b < end; ++b){
+	std::size_t first = b * ReduceBlock;
+	partial[b] = fold(op, a + first, std::min(ReduceBlock, n - first));
+      }
+    });
+  return fold(op, partial.data(), blocks);
+}
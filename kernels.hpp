@@ -0,0 +1,109 @@
+/*! \file kernels.hpp
+Defines the elementwise numeric kernels used by the arithmetic and math
+built-in procedures when they are called with packed numeric lists.
+
+The real kernels run over contiguous double buffers using AVX or SSE2 when
+the compiler targets them, with a scalar loop for the remainder and for
+other targets. Every kernel computes exactly the same IEEE operation as the
+scalar built-in, so results are bit-identical. The complex kernels are
+scalar loops over the packed buffers, using the same std::complex overloads
+as the scalar built-ins.
+ */
+
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+// system includes
+#include <complex>
+#include <cstddef>
+
+/*! \struct Operand
+\brief One argument of a kernel: a packed buffer, or a scalar broadcast over
+every element. Exactly one of reals and complexes is set.
+ */
+struct Operand {
+  const double * reals;
+  const std::complex<double> * complexes;
+  bool broadcast;
+
+  /// true if the operand holds Complex values
+  bool isComplex() const noexcept { return complexes != nullptr; }
+
+  /// element i as a Number
+  double real(std::size_t i) const noexcept { return reals[broadcast ? 0 : i]; }
+
+  /// element i as a Complex
+  std::complex<double> complex(std::size_t i) const noexcept { return complexes[broadcast ? 0 : i]; }
+};
+
+/// make an Operand over packed Numbers, or a Number to broadcast
+Operand realOperand(const double * data, bool broadcast = false);
+
+/// make an Operand over packed Complex, or a Complex to broadcast
+Operand complexOperand(const std::complex<double> * data, bool broadcast = false);
+
+/*! \enum BinaryOp
+\brief The binary operations, matching +, -, *, / and ^.
+ */
+enum class BinaryOp { Add, Sub, Mul, Div, Pow };
+
+/*! \enum UnaryOp
+\brief The unary operations, matching -, / (reciprocal), sqrt, ln, sin, cos
+and tan with one argument.
+ */
+enum class UnaryOp { Neg, Recip, Sqrt, Log, Sin, Cos, Tan };
+
+/*! Compute out[i] = a[i] op b[i] for Numbers.
+  \param op the operation
+  \param a the left operand, must be real
+  \param b the right operand, must be real
+  \param out the result buffer, may alias a or b
+  \param n the number of elements
+ */
+void realBinary(BinaryOp op, const Operand & a, const Operand & b, double * out, std::size_t n);
+
+/*! Compute out[i] = a[i] op b[i] where at least one operand is Complex.
+  \param op the operation
+  \param a the left operand, real or complex
+  \param b the right operand, real or complex
+  \param out the result buffer, may alias a or b
+  \param n the number of elements
+ */
+void complexBinary(BinaryOp op, const Operand & a, const Operand & b, std::complex<double> * out, std::size_t n);
+
+/*! Determine if the real kernel for op gives a Number for every element,
+  sqrt of a negative Number is Complex and ln is an error outside (0, inf).
+ */
+bool realDomain(UnaryOp op, const double * a, std::size_t n);
+
+/// compute out[i] = op(a[i]) for Numbers in the real domain of op
+void realUnary(UnaryOp op, const double * a, double * out, std::size_t n);
+
+/// determine if op is defined for Complex (negation, reciprocal and sqrt)
+bool complexDomain(UnaryOp op);
+
+/// compute out[i] = op(a[i]) for Complex, op must be in the complex domain
+void complexUnary(UnaryOp op, const std::complex<double> * a, std::complex<double> * out, std::size_t n);
+
+/*! \enum ReduceOp
+\brief The associative operations a list can be reduced with, matching +, *,
+min and max.
+ */
+enum class ReduceOp { Add, Mul, Min, Max };
+
+/// elements reduced in order by one task of realReduce
+const std::size_t ReduceBlock = 4096;
+
+/*! Reduce a[0..n) with op. Each block of ReduceBlock elements is folded from
+  the left, in parallel on the shared ThreadPool, then the block results are
+  folded in order. The grouping depends only on n, so the result is the same
+  on every run and with any number of threads. Sums and products start from
+  0 and 1, as + and * do, so up to ReduceBlock elements the result is
+  exactly that of the procedure.
+  \param op the operation
+  \param a the Numbers
+  \param n the number of elements, at least 1
+ */
+double realReduce(ReduceOp op, const double * a, std::size_t n);
+
+#endif
@@ -0,0 +1,178 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "kernels.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "test_programs.hpp"
+
+// the two lists hold bit-identical packed numbers
+static bool identical(const Expression & a, const Expression & b){
+  const ExpressionList & x = a.rTail();
+  const ExpressionList & y = b.rTail();
+  if(x.size() != y.size()) return false;
+  if(x.reals() && y.reals()){
+    return std::memcmp(x.reals(), y.reals(), x.size() * sizeof(double)) == 0;
+  }
+  if(x.complexes() && y.complexes()){
+    return std::memcmp(x.complexes(), y.complexes(), x.size() * sizeof(std::complex<double>)) == 0;
+  }
+  return false;
+}
+
+TEST_CASE( "Test real kernels", "[kernels]" ) {
+
+  // odd length so the scalar remainder loop runs too
+  std::vector<double> a = {1, -2, 3.5, 0, -0.0, 1e300, 7, 2.25, 9};
+  std::vector<double> b = {2, 4, -1, 3, 1, 1e300, 0.5, 1.5, -3};
+  std::vector<double> out(a.size());
+  double two = 2.0;
+
+  realBinary(BinaryOp::Add, realOperand(a.data()), realOperand(b.data()), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == a[i] + b[i]);
+
+  realBinary(BinaryOp::Sub, realOperand(a.data()), realOperand(&two, true), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == a[i] - 2.0);
+
+  realBinary(BinaryOp::Mul, realOperand(&two, true), realOperand(b.data()), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == 2.0 * b[i]);
+
+  realBinary(BinaryOp::Div, realOperand(a.data()), realOperand(b.data()), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == a[i] / b[i]);
+
+  realBinary(BinaryOp::Pow, realOperand(b.data()), realOperand(&two, true), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == std::pow(b[i], 2.0));
+
+  realUnary(UnaryOp::Neg, a.data(), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(std::signbit(out[i]) != std::signbit(a[i]));
+
+  REQUIRE(!realDomain(UnaryOp::Sqrt, a.data(), a.size()));
+  REQUIRE(realDomain(UnaryOp::Sqrt, a.data() + 2, 1));
+  REQUIRE(!realDomain(UnaryOp::Log, a.data() + 3, 1));
+  REQUIRE(realDomain(UnaryOp::Sin, a.data(), a.size()));
+
+  INFO("the output may alias an input");
+  realBinary(BinaryOp::Add, realOperand(a.data()), realOperand(a.data()), a.data(), a.size());
+  REQUIRE(a[2] == 7.0);
+}
+
+TEST_CASE( "Test complex kernels", "[kernels]" ) {
+
+  std::vector<std::complex<double>> a = {{1, 2}, {-1, 0.5}, {0, -3}};
+  std::vector<std::complex<double>> out(a.size());
+  double two = 2.0;
+
+  complexBinary(BinaryOp::Sub, realOperand(&two, true), complexOperand(a.data()), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == 2.0 - a[i]);
+
+  complexBinary(BinaryOp::Pow, complexOperand(a.data()), realOperand(&two, true), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == std::pow(a[i], 2.0));
+
+  REQUIRE(complexDomain(UnaryOp::Sqrt));
+  REQUIRE(!complexDomain(UnaryOp::Log));
+  complexUnary(UnaryOp::Recip, a.data(), out.data(), a.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(out[i] == 1.0 / a[i]);
+}
+
+TEST_CASE( "Test arithmetic over lists", "[kernels]" ) {
+
+  REQUIRE(runToString("(+ (list 1 2 3) 10)") == "((11) (12) (13))");
+  REQUIRE(runToString("(+ 1 (list 1 2) (list 10 20))") == "((12) (23))");
+  REQUIRE(runToString("(* (range 1 3 1) (range 1 3 1))") == "((1) (4) (9))");
+  REQUIRE(runToString("(- (range 1 3 1))") == "((-1) (-2) (-3))");
+  REQUIRE(runToString("(- 10 (range 1 3 1))") == "((9) (8) (7))");
+  REQUIRE(runToString("(/ (range 1 2 1))") == "((1) (0.5))");
+  REQUIRE(runToString("(^ (range 1 3 1) 2)") == "((1) (4) (9))");
+  REQUIRE(runToString("(+ (range 1 3 1) I)") == "((1,1) (2,1) (3,1))");
+  REQUIRE(runToString("(sqrt (list 4 -4))") == "((2) (0,2))");
+  REQUIRE(runToString("(+ (list) (list))") == "()");
+
+  INFO("nested lists are broadcast recursively");
+  REQUIRE(runToString("(* 2 (list 1 (list 2 3)))") == "((2) ((4) (6)))");
+
+  INFO("errors");
+  REQUIRE_THROWS_AS(run("(+ (list 1 2) (list 1 2 3))"), SemanticError);
+  REQUIRE_THROWS_AS(run("(ln (range 0 3 1))"), SemanticError);
+  REQUIRE_THROWS_AS(run("(sin (list 1 \"a\"))"), SemanticError);
+}
+
+TEST_CASE( "Test list arithmetic matches map", "[kernels]" ) {
+
+  std::vector<std::string> procs = {"sqrt", "ln", "sin", "cos", "tan", "-", "/"};
+  for(auto & p : procs){
+    INFO(p);
+    Expression vec = run("(" + p + " (range 0.5 100 0.25))");
+    Expression map = run("(map " + p + " (range 0.5 100 0.25))");
+    REQUIRE(identical(vec, map));
+  }
+
+  std::vector<std::string> lambdas = {"+ 3", "- 3", "* 3", "/ 3", "^ 3", "+ I", "* I", "^ I"};
+  for(auto & l : lambdas){
+    INFO(l);
+    Expression vec = run("(" + l + " (range -50 50 0.25))");
+    Expression map = run("(begin (define f (lambda (x) (" + l + " x))) (map f (range -50 50 0.25)))");
+    REQUIRE(identical(vec, map));
+  }
+
+  Expression vec = run("(sqrt (* I (range 0 50 0.5)))");
+  Expression map = run("(begin (define f (lambda (x) (* I x))) (map sqrt (map f (range 0 50 0.5))))");
+  REQUIRE(identical(vec, map));
+}
+
+TEST_CASE( "Test reductions", "[kernels]" ) {
+
+  std::vector<double> a;
+  for(int i = 0; i < 3 * int(ReduceBlock) + 17; ++i){
+    a.push_back(std::sin(i) * 1e3);
+  }
+
+  INFO("up to a block the reduction is the fold of the procedure");
+  double sum = 0, product = 1, low = a[0], high = a[0];
+  for(std::size_t i = 0; i < 100; ++i){
+    sum += a[i];
+    product *= a[i] / 500;
+    low = std::min(low, a[i]);
+    high = std::max(high, a[i]);
+  }
+  std::vector<double> scaled;
+  for(std::size_t i = 0; i < 100; ++i){
+    scaled.push_back(a[i] / 500);
+  }
+  REQUIRE(realReduce(ReduceOp::Add, a.data(), 100) == sum);
+  REQUIRE(realReduce(ReduceOp::Mul, scaled.data(), 100) == product);
+  REQUIRE(realReduce(ReduceOp::Min, a.data(), 100) == low);
+  REQUIRE(realReduce(ReduceOp::Max, a.data(), 100) == high);
+
+  INFO("longer lists sum the blocks, then the block sums, in order");
+  double blocks = 0;
+  for(std::size_t b = 0; b < a.size(); b += ReduceBlock){
+    double block = 0;
+    for(std::size_t i = b; i < std::min(a.size(), b + ReduceBlock); ++i){
+      block += a[i];
+    }
+    blocks += block;
+  }
+  REQUIRE(realReduce(ReduceOp::Add, a.data(), a.size()) == blocks);
+  REQUIRE(realReduce(ReduceOp::Min, a.data(), a.size()) == *std::min_element(a.begin(), a.end()));
+  REQUIRE(realReduce(ReduceOp::Max, a.data(), a.size()) == *std::max_element(a.begin(), a.end()));
+}
+
+TEST_CASE( "Test reduce and fold over packed lists", "[kernels]" ) {
+
+  REQUIRE(run("(reduce + (range 1 100000 1))") == Expression(5000050000.));
+  REQUIRE(run("(fold + 10 (range 1 100 1))") == Expression(5060.));
+  REQUIRE(run("(reduce max (map sin (range 1 10000 1)))") == run("(apply max (map sin (range 1 10000 1)))"));
+  REQUIRE(run("(reduce min (range 5 10 0.5))") == Expression(5.));
+  REQUIRE(run("(reduce * (list 1 2 3 4 5 6 7 8 9 10))") == run("(apply * (list 1 2 3 4 5 6 7 8 9 10))"));
+
+  INFO("a short sum is exactly the one apply computes");
+  std::string values = "(map sin (range 1 1000 1))";
+  REQUIRE(run("(reduce + " + values + ")") == run("(apply + " + values + ")"));
+  REQUIRE(runToString("(reduce + " + values + ")") == runToString("(apply + " + values + ")"));
+}
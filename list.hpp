@@ -0,0 +1,196 @@
+/*! \file list.hpp
+Defines the ExpressionList type used to hold the tail of an Expression.
+ */
+
+#ifndef LIST_HPP
+#define LIST_HPP
+
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "atom.hpp"
+
+// forward declare Expression
+class Expression;
+
+/*! \class ExpressionList
+\brief A persistent, structurally shared sequence of Expressions.
+
+An ExpressionList is a slice (offset, length) of a reference-counted buffer.
+Copying a list only shares the buffer, so copies are O(1). Lists are
+immutable once shared:
+
+- drop(n) (used by rest) and slice(begin, count) (used by slice) return
+  a slice of the same buffer, O(1).
+- push_back claims the next free slot of the buffer when this list ends
+  exactly at the last used slot, so appending to a shared list is amortized
+  O(1) and never disturbs the lists it shares with. The claim is atomic, so
+  shared buffers may be read and appended to from several threads.
+- any mutable access (non-const operator[], begin, back, ...) first copies
+  the slice into a private buffer when the buffer is shared.
+
+A list whose elements are all plain Numbers, or all plain Complex, may be
+packed: the buffer then holds a contiguous array of double or
+complex<double> instead of Expressions. Packing is transparent, const
+element access builds (once) the Expression for each element it touches,
+and inserting a value of another kind, or any mutable access, unpacks the
+list into the generic representation. Hot paths use headAt(), numberAt()
+and reals() to read packed lists without building Expressions.
+
+The interface mirrors the subset of std::vector used by the interpreter.
+Iterators are plain pointers into the buffer.
+*/
+class ExpressionList {
+public:
+
+  typedef Expression * iterator;
+  typedef const Expression * const_iterator;
+
+  /// lists shorter than this are not worth packing, see pack()
+  static const std::size_t PackThreshold = 8;
+
+  /// construct an empty list
+  ExpressionList() noexcept;
+
+  /// construct a packed list of Numbers
+  explicit ExpressionList(const std::vector<double> & values);
+
+  /// construct a packed list of Complex
+  explicit ExpressionList(const std::vector<std::complex<double>> & values);
+
+  /*! Construct a packed list of count Numbers start, start + step, ...
+    added up one step at a time. The Numbers are only generated when the
+    list is first read, until then the list is pending.
+   */
+  static ExpressionList sequence(double start, double step, std::size_t count);
+
+  /// share the buffer of another list
+  ExpressionList(const ExpressionList & other) noexcept;
+
+  /// take over the buffer of another list, leaving it empty
+  ExpressionList(ExpressionList && other) noexcept;
+
+  /// share the buffer of another list
+  ExpressionList & operator=(const ExpressionList & other) noexcept;
+
+  /// take over the buffer of another list, leaving it empty
+  ExpressionList & operator=(ExpressionList && other) noexcept;
+
+  /// number of elements
+  std::size_t size() const noexcept;
+
+  /// true if there are no elements
+  bool empty() const noexcept;
+
+  /// true if the buffer is also used by another list
+  bool shared() const noexcept;
+
+  /// true if the elements are stored as a packed numeric array
+  bool packed() const noexcept;
+
+  /// pointer to the packed Numbers, or nullptr if not packed as Numbers
+  const double * reals() const;
+
+  /// pointer to the packed Complex, or nullptr if not packed as Complex
+  const std::complex<double> * complexes() const noexcept;
+
+  /// the head of element i, without building the element of a packed list
+  Atom headAt(std::size_t i) const;
+
+  /// the head of element i as a Number, as Atom::asNumber
+  double numberAt(std::size_t i) const;
+
+  /*! Determine if the list is a sequence whose Numbers have not been
+    generated, see sequence(). Element i is then start plus step added i
+    times, so the list can be walked without generating it.
+    \return true and set start and step if the list is pending
+   */
+  bool pending(double & start, double & step) const noexcept;
+
+  /*! Pack the list if it has at least PackThreshold elements and all are
+    plain Numbers or all are plain Complex.
+    \return true if the list is packed afterwards
+  */
+  bool pack();
+
+  /// element access, no bounds checking
+  const Expression & operator[](std::size_t i) const;
+  Expression & operator[](std::size_t i);
+
+  /// element access, throws std::out_of_range
+  const Expression & at(std::size_t i) const;
+  Expression & at(std::size_t i);
+
+  /// first and last elements
+  const Expression & front() const;
+  const Expression & back() const;
+  Expression & back();
+
+  /// iteration, the mutable versions unshare the buffer first
+  const_iterator begin() const;
+  const_iterator end() const;
+  const_iterator cbegin() const;
+  const_iterator cend() const;
+  iterator begin();
+  iterator end();
+
+  /// append an element, amortized O(1) even when the buffer is shared
+  void push_back(const Expression & e);
+  void push_back(Expression && e);
+
+  /// construct an element in place at the end
+  template<typename... Args>
+  void emplace_back(Args &&... args);
+
+  /// append all elements of another list, packed lists stay packed
+  void extend(const ExpressionList & other);
+
+  /// ensure room for n elements without reallocation
+  void reserve(std::size_t n);
+
+  /// remove all elements
+  void clear() noexcept;
+
+  /// replace the contents with the range [first, last)
+  template<typename InputIt>
+  void assign(InputIt first, InputIt last);
+
+  /// the list without its first n elements, shares this list's buffer
+  ExpressionList drop(std::size_t n) const;
+
+  /// the count elements from index begin on, shares this list's buffer.
+  /// begin + count must not exceed size()
+  ExpressionList slice(std::size_t begin, std::size_t count) const;
+
+private:
+  enum Kind { Generic, Real, Complex };
+
+  struct Buffer;
+
+  std::shared_ptr<Buffer> buffer;
+  std::size_t offset;
+  std::size_t length;
+
+  // the representation of the buffer, Generic when there is none
+  Kind kind() const noexcept;
+
+  // the packed kind an element can be stored as, Generic if none
+  static Kind kindOf(const Expression & e) noexcept;
+
+  // make sure this list is the only user of a generic buffer
+  void unshare();
+
+  // move or copy the slice into a new private buffer with room for capacity
+  void reallocate(std::size_t capacity, Kind target);
+
+  // claim the slot after this slice, true on success
+  bool claimNext();
+
+  // append the head of a plain element to a packed list of the same kind
+  void push_packed(const Atom & a);
+};
+
+#endif
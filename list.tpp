@@ -0,0 +1,491 @@
+// inline definitions for ExpressionList, included at the end of
+// expression.hpp where Expression is a complete type
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+struct ExpressionList::Buffer {
+  Kind kind;
+  std::size_t capacity;
+  // number of claimed slots, slots are claimed with compare-exchange
+  std::atomic<std::size_t> used;
+  // the elements of a generic buffer. For a packed buffer the Expressions
+  // built on demand for the numbers, [0, boxed) are constructed.
+  Expression * data;
+  std::atomic<std::size_t> boxed;
+  std::mutex boxing;
+  // the numbers of a packed buffer, read Numbers through values()
+  double * reals;
+  std::complex<double> * complexes;
+  // false for a sequence whose numbers have not been generated yet, they are
+  // first, first + step, ... added up one step at a time
+  std::atomic<bool> generated;
+  double first;
+  double step;
+
+  Buffer(Kind k, std::size_t cap):
+    kind(k), capacity(cap), used(0), data(nullptr), boxed(0),
+    reals(nullptr), complexes(nullptr), generated(true), first(0), step(0){
+    if(kind == Real){
+      reals = static_cast<double *>(::operator new(cap * sizeof(double)));
+    }
+    else if(kind == Complex){
+      complexes = static_cast<std::complex<double> *>(::operator new(cap * sizeof(std::complex<double>)));
+    }
+    else{
+      data = static_cast<Expression *>(::operator new(cap * sizeof(Expression)));
+    }
+  }
+
+  // a sequence of count Numbers, generated on first use
+  Buffer(double start, double increment, std::size_t count):
+    kind(Real), capacity(count), used(count), data(nullptr), boxed(0),
+    reals(nullptr), complexes(nullptr), generated(false), first(start), step(increment){}
+
+  ~Buffer(){
+    std::size_t n = (kind == Generic) ? used.load() : boxed.load();
+    for(std::size_t i = 0; i < n; ++i){
+      data[i].~Expression();
+    }
+    ::operator delete(data);
+    ::operator delete(reals);
+    ::operator delete(complexes);
+  }
+
+  Atom number(std::size_t i){
+    return (kind == Real) ? Atom(values()[i]) : Atom(complexes[i]);
+  }
+
+  // the Numbers of a packed buffer, generating a sequence first
+  const double * values(){
+    if(!generated.load(std::memory_order_acquire)){
+      std::lock_guard<std::mutex> lock(boxing);
+      if(!generated.load(std::memory_order_relaxed)){
+	reals = static_cast<double *>(::operator new(capacity * sizeof(double)));
+	double num = first;
+	for(std::size_t i = 0; i < capacity; ++i){
+	  reals[i] = num;
+	  num += step;
+	}
+	generated.store(true, std::memory_order_release);
+      }
+    }
+    return reals;
+  }
+
+  // make sure the Expressions for slots [0, end) of a packed buffer exist
+  Expression * box(std::size_t end){
+    if(boxed.load(std::memory_order_acquire) < end){
+      // generating takes the lock too
+      if(kind == Real){
+	values();
+      }
+      std::lock_guard<std::mutex> lock(boxing);
+      if(!data){
+	data = static_cast<Expression *>(::operator new(capacity * sizeof(Expression)));
+      }
+      for(std::size_t i = boxed.load(std::memory_order_relaxed); i < end; ++i){
+	new (data + i) Expression(number(i));
+	boxed.store(i + 1, std::memory_order_release);
+      }
+    }
+    return data;
+  }
+
+  Buffer(const Buffer &) = delete;
+  Buffer & operator=(const Buffer &) = delete;
+};
+
+inline ExpressionList::ExpressionList() noexcept: offset(0), length(0) {}
+
+inline ExpressionList::ExpressionList(const std::vector<double> & values): offset(0), length(0){
+  if(!values.empty()){
+    buffer = std::make_shared<Buffer>(Real, values.size());
+    std::copy(values.begin(), values.end(), buffer->reals);
+    buffer->used.store(values.size());
+    length = values.size();
+  }
+}
+
+inline ExpressionList::ExpressionList(const std::vector<std::complex<double>> & values): offset(0), length(0){
+  if(!values.empty()){
+    buffer = std::make_shared<Buffer>(Complex, values.size());
+    std::copy(values.begin(), values.end(), buffer->complexes);
+    buffer->used.store(values.size());
+    length = values.size();
+  }
+}
+
+inline ExpressionList ExpressionList::sequence(double start, double step, std::size_t count){
+  ExpressionList result;
+  if(count > 0){
+    result.buffer = std::make_shared<Buffer>(start, step, count);
+    result.length = count;
+  }
+  return result;
+}
+
+inline ExpressionList::ExpressionList(const ExpressionList & other) noexcept:
+  buffer(other.buffer), offset(other.offset), length(other.length) {}
+
+inline ExpressionList::ExpressionList(ExpressionList && other) noexcept:
+  buffer(std::move(other.buffer)), offset(other.offset), length(other.length){
+  other.offset = 0;
+  other.length = 0;
+}
+
+inline ExpressionList & ExpressionList::operator=(const ExpressionList & other) noexcept{
+  buffer = other.buffer;
+  offset = other.offset;
+  length = other.length;
+  return *this;
+}
+
+inline ExpressionList & ExpressionList::operator=(ExpressionList && other) noexcept{
+  if(this != &other){
+    buffer = std::move(other.buffer);
+    offset = other.offset;
+    length = other.length;
+    other.offset = 0;
+    other.length = 0;
+  }
+  return *this;
+}
+
+inline std::size_t ExpressionList::size() const noexcept{
+  return length;
+}
+
+inline bool ExpressionList::empty() const noexcept{
+  return length == 0;
+}
+
+inline bool ExpressionList::shared() const noexcept{
+  return buffer && (buffer.use_count() > 1);
+}
+
+inline ExpressionList::Kind ExpressionList::kind() const noexcept{
+  return buffer ? buffer->kind : Generic;
+}
+
+inline bool ExpressionList::packed() const noexcept{
+  return kind() != Generic;
+}
+
+inline const double * ExpressionList::reals() const{
+  return (kind() == Real) ? buffer->values() + offset : nullptr;
+}
+
+inline const std::complex<double> * ExpressionList::complexes() const noexcept{
+  return (kind() == Complex) ? buffer->complexes + offset : nullptr;
+}
+
+inline Atom ExpressionList::headAt(std::size_t i) const{
+  if(packed()){
+    return buffer->number(offset + i);
+  }
+  return buffer->data[offset + i].head();
+}
+
+inline double ExpressionList::numberAt(std::size_t i) const{
+  if(kind() == Real){
+    return buffer->values()[offset + i];
+  }
+  return headAt(i).asNumber();
+}
+
+inline bool ExpressionList::pending(double & start, double & step) const noexcept{
+  if(!buffer || buffer->generated.load(std::memory_order_acquire)){
+    return false;
+  }
+  // the slice of a sequence starts offset steps in
+  start = buffer->first;
+  step = buffer->step;
+  for(std::size_t i = 0; i < offset; ++i){
+    start += step;
+  }
+  return true;
+}
+
+inline ExpressionList::Kind ExpressionList::kindOf(const Expression & e) noexcept{
+  // only values that round trip exactly through a packed slot
+  if(!e.m_tail.empty() || !e.propMap.empty() || e.error || e.isList ||
+     e.islambda || e.islambdaexp || e.inLambda || (e.m_slot >= 0) || e.m_closure){
+    return Generic;
+  }
+  if(e.m_head.isNumber()){
+    return Real;
+  }
+  if(e.m_head.isComplex()){
+    return Complex;
+  }
+  return Generic;
+}
+
+inline bool ExpressionList::pack(){
+  if(packed() || (length < PackThreshold)){
+    return packed();
+  }
+  Kind target = kindOf(buffer->data[offset]);
+  if(target == Generic){
+    return false;
+  }
+  for(std::size_t i = 1; i < length; ++i){
+    if(kindOf(buffer->data[offset + i]) != target){
+      return false;
+    }
+  }
+  reallocate(length, target);
+  return true;
+}
+
+inline const Expression & ExpressionList::operator[](std::size_t i) const{
+  if(packed()){
+    return buffer->box(offset + i + 1)[offset + i];
+  }
+  return buffer->data[offset + i];
+}
+
+inline Expression & ExpressionList::operator[](std::size_t i){
+  unshare();
+  return buffer->data[offset + i];
+}
+
+inline const Expression & ExpressionList::at(std::size_t i) const{
+  if(i >= length){
+    throw std::out_of_range("ExpressionList::at");
+  }
+  return (*this)[i];
+}
+
+inline Expression & ExpressionList::at(std::size_t i){
+  if(i >= length){
+    throw std::out_of_range("ExpressionList::at");
+  }
+  return (*this)[i];
+}
+
+inline const Expression & ExpressionList::front() const{
+  return (*this)[0];
+}
+
+inline const Expression & ExpressionList::back() const{
+  return (*this)[length - 1];
+}
+
+inline Expression & ExpressionList::back(){
+  return (*this)[length - 1];
+}
+
+inline ExpressionList::const_iterator ExpressionList::begin() const{
+  if(!buffer){
+    return nullptr;
+  }
+  if(packed()){
+    return buffer->box(offset + length) + offset;
+  }
+  return buffer->data + offset;
+}
+
+inline ExpressionList::const_iterator ExpressionList::end() const{
+  const_iterator first = begin();
+  return first ? first + length : nullptr;
+}
+
+inline ExpressionList::const_iterator ExpressionList::cbegin() const{
+  return begin();
+}
+
+inline ExpressionList::const_iterator ExpressionList::cend() const{
+  return end();
+}
+
+inline ExpressionList::iterator ExpressionList::begin(){
+  unshare();
+  return buffer ? buffer->data + offset : nullptr;
+}
+
+inline ExpressionList::iterator ExpressionList::end(){
+  unshare();
+  return buffer ? buffer->data + offset + length : nullptr;
+}
+
+inline bool ExpressionList::claimNext(){
+  if(!buffer){
+    return false;
+  }
+  std::size_t next = offset + length;
+  if(next >= buffer->capacity){
+    return false;
+  }
+  return buffer->used.compare_exchange_strong(next, next + 1);
+}
+
+inline void ExpressionList::push_back(const Expression & e){
+  emplace_back(e);
+}
+
+inline void ExpressionList::push_back(Expression && e){
+  emplace_back(std::move(e));
+}
+
+inline void ExpressionList::push_packed(const Atom & a){
+  if(!claimNext()){
+    reallocate(2 * length, kind());
+    claimNext();
+  }
+  std::size_t slot = offset + length;
+  if(kind() == Real){
+    buffer->reals[slot] = a.asNumber();
+  }
+  else{
+    buffer->complexes[slot] = a.asComplex();
+  }
+  ++length;
+}
+
+template<typename... Args>
+void ExpressionList::emplace_back(Args &&... args){
+
+  if(packed()){
+    Expression value(std::forward<Args>(args)...);
+    if(kindOf(value) == kind()){
+      push_packed(value.head());
+      return;
+    }
+    // a value of another kind falls back to the generic representation
+    reallocate(2 * length, Generic);
+    claimNext();
+    new (buffer->data + offset + length) Expression(std::move(value));
+    ++length;
+    return;
+  }
+
+  if(!claimNext()){
+    // build the value first, the arguments may refer into this list
+    Expression value(std::forward<Args>(args)...);
+    reallocate(length < 2 ? 4 : 2 * length, Generic);
+    claimNext();
+    new (buffer->data + offset + length) Expression(std::move(value));
+    ++length;
+    return;
+  }
+
+  std::size_t slot = offset + length;
+  try{
+    new (buffer->data + slot) Expression(std::forward<Args>(args)...);
+  }
+  catch(...){
+    // release the claimed slot, nobody else can have claimed past it
+    buffer->used.store(slot);
+    throw;
+  }
+  ++length;
+}
+
+inline void ExpressionList::extend(const ExpressionList & other){
+  if(packed() && (other.kind() == kind())){
+    reserve(length + other.length);
+    for(std::size_t i = 0; i < other.length; ++i){
+      push_packed(other.buffer->number(other.offset + i));
+    }
+  }
+  else if(other.packed()){
+    for(std::size_t i = 0; i < other.length; ++i){
+      emplace_back(other.headAt(i));
+    }
+  }
+  else{
+    for(std::size_t i = 0; i < other.length; ++i){
+      push_back(other.buffer->data[other.offset + i]);
+    }
+  }
+}
+
+inline void ExpressionList::reserve(std::size_t n){
+  if(!buffer || shared() || (buffer->capacity - offset < n)){
+    reallocate(n < length ? length : n, kind());
+  }
+}
+
+inline void ExpressionList::clear() noexcept{
+  buffer.reset();
+  offset = 0;
+  length = 0;
+}
+
+template<typename InputIt>
+void ExpressionList::assign(InputIt first, InputIt last){
+  clear();
+  for(; first != last; ++first){
+    emplace_back(*first);
+  }
+}
+
+inline ExpressionList ExpressionList::drop(std::size_t n) const{
+  ExpressionList result(*this);
+  if(n >= length){
+    result.clear();
+  }
+  else{
+    result.offset += n;
+    result.length -= n;
+  }
+  return result;
+}
+
+inline ExpressionList ExpressionList::slice(std::size_t begin, std::size_t count) const{
+  ExpressionList result(*this);
+  if(count == 0){
+    result.clear();
+  }
+  else{
+    result.offset += begin;
+    result.length = count;
+  }
+  return result;
+}
+
+inline void ExpressionList::unshare(){
+  if(packed() || shared()){
+    reallocate(length, Generic);
+  }
+}
+
+inline void ExpressionList::reallocate(std::size_t capacity, Kind target){
+
+  if(capacity == 0){
+    clear();
+    return;
+  }
+
+  std::shared_ptr<Buffer> fresh = std::make_shared<Buffer>(target, capacity);
+  Kind source = kind();
+  bool owner = buffer && !shared();
+  const double * numbers = (source == Real) ? buffer->values() : nullptr;
+  for(std::size_t i = 0; i < length; ++i){
+    std::size_t k = offset + i;
+    if(target == Real){
+      fresh->reals[i] = (source == Real) ? numbers[k] : buffer->data[k].head().asNumber();
+    }
+    else if(target == Complex){
+      fresh->complexes[i] = (source == Complex) ? buffer->complexes[k] : buffer->data[k].head().asComplex();
+    }
+    else if(source != Generic){
+      new (fresh->data + i) Expression(buffer->number(k));
+    }
+    else if(owner){
+      new (fresh->data + i) Expression(std::move(buffer->data[k]));
+    }
+    else{
+      new (fresh->data + i) Expression(buffer->data[k]);
+    }
+    fresh->used.store(i + 1);
+  }
+
+  buffer = std::move(fresh);
+  offset = 0;
+}
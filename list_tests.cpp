@@ -0,0 +1,274 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "expression.hpp"
+#include "interpreter.hpp"
+#include "test_programs.hpp"
+
+static ExpressionList numbers(int n){
+  ExpressionList list;
+  for(int i = 0; i < n; ++i){
+    list.push_back(Expression(double(i)));
+  }
+  return list;
+}
+
+TEST_CASE( "Test list copies share storage", "[list]" ) {
+
+  ExpressionList a = numbers(10);
+  REQUIRE(!a.shared());
+
+  ExpressionList b(a);
+  REQUIRE(a.shared());
+  REQUIRE(b.shared());
+  REQUIRE(a.cbegin() == b.cbegin());
+
+  INFO("mutable access copies the shared slice first");
+  b[0] = Expression(42.);
+  REQUIRE(a[0] == Expression(0.));
+  REQUIRE(b[0] == Expression(42.));
+  REQUIRE(!a.shared());
+}
+
+TEST_CASE( "Test drop shares storage", "[list]" ) {
+
+  const ExpressionList a = numbers(5);
+  const ExpressionList rest = a.drop(1);
+
+  REQUIRE(rest.size() == 4);
+  REQUIRE(rest[0] == Expression(1.));
+  REQUIRE(rest.cbegin() == a.cbegin() + 1);
+  REQUIRE(a.drop(5).empty());
+  REQUIRE(a.drop(9).empty());
+}
+
+TEST_CASE( "Test appending to shared lists", "[list]" ) {
+
+  ExpressionList a = numbers(3);
+  ExpressionList b(a);
+  ExpressionList c(a);
+
+  b.push_back(Expression(10.));
+  INFO("the first append claims the free slot in place");
+  REQUIRE(b.cbegin() == a.cbegin());
+
+  c.push_back(Expression(20.));
+  INFO("the second append to the same prefix must not clobber the first");
+  REQUIRE(c.cbegin() != a.cbegin());
+
+  REQUIRE(a.size() == 3);
+  REQUIRE(b.size() == 4);
+  REQUIRE(c.size() == 4);
+  REQUIRE(b[3] == Expression(10.));
+  REQUIRE(c[3] == Expression(20.));
+
+  INFO("appending to a list can refer to its own elements");
+  ExpressionList d = numbers(4);
+  for(int i = 0; i < 20; ++i){
+    d.push_back(d[0]);
+  }
+  REQUIRE(d.size() == 24);
+  REQUIRE(d.back() == Expression(0.));
+}
+
+TEST_CASE( "Test list builtins keep their semantics", "[list]" ) {
+
+  REQUIRE(runToString("(rest (rest (rest (list 1 2 3 4))))") == "((4))");
+  REQUIRE(runToString("(rest (list 1))") == "()");
+  REQUIRE(runToString("(append (append (append (list 1) 2) 3) 4)") == "((1) (2) (3) (4))");
+  REQUIRE(runToString("(join (list 1 2) (list 3 4))") == "((1) (2) (3) (4))");
+  REQUIRE(runToString("(begin (define a (list 1 2)) (define b (append a 3)) (define c (append a 4)) (list a b c))") ==
+	  "(((1) (2)) ((1) (2) (3)) ((1) (2) (4)))");
+  REQUIRE(runToString("(begin (define a (range 0 3 1)) (join (rest a) (rest (rest a))))") ==
+	  "((1) (2) (3) (2) (3))");
+}
+
+TEST_CASE( "Test rest does not copy the tail", "[list]" ) {
+
+  std::istringstream iss("(begin (define a (range 0 999 1)) (rest (rest (rest a))))");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+
+  std::size_t before = Expression::copyCount();
+  Expression result = interp.evaluate();
+  REQUIRE(result.rTail().size() == 997);
+  REQUIRE(Expression::copyCount() - before < 20);
+}
+
+TEST_CASE( "Test packed numeric lists", "[list]" ) {
+
+  ExpressionList a(std::vector<double>{0, 1, 2, 3});
+  REQUIRE(a.packed());
+  REQUIRE(a.size() == 4);
+  REQUIRE(a.reals()[2] == 2.);
+  REQUIRE(a.complexes() == nullptr);
+  REQUIRE(a.headAt(3) == Atom(3.));
+  REQUIRE(a.numberAt(1) == 1.);
+
+  INFO("const element access builds the elements on demand");
+  const ExpressionList & c = a;
+  REQUIRE(c[2] == Expression(2.));
+  REQUIRE((c.cend() - c.cbegin()) == 4);
+  REQUIRE(a.packed());
+
+  INFO("numbers stay packed, drop shares the packed buffer");
+  ExpressionList b(a);
+  b.push_back(Expression(4.));
+  REQUIRE(b.packed());
+  REQUIRE(b.size() == 5);
+  REQUIRE(a.size() == 4);
+  ExpressionList d = b.drop(2);
+  REQUIRE(d.reals() == b.reals() + 2);
+
+  INFO("a value of another kind falls back to the generic representation");
+  b.push_back(Expression(Atom("x")));
+  REQUIRE(!b.packed());
+  REQUIRE(b.size() == 6);
+  REQUIRE(b.headAt(4) == Atom(4.));
+  REQUIRE(b.headAt(5) == Atom("x"));
+  REQUIRE(a.packed());
+
+  INFO("mutable access unpacks");
+  ExpressionList e(std::vector<std::complex<double>>{{1, 1}, {0, 2}});
+  REQUIRE(e.complexes()[1] == std::complex<double>(0, 2));
+  e[0] = Expression(5.);
+  REQUIRE(!e.packed());
+  REQUIRE(e.headAt(0) == Atom(5.));
+
+  INFO("only long homogeneous lists are packed");
+  ExpressionList f = numbers(ExpressionList::PackThreshold - 1);
+  REQUIRE(!f.pack());
+  ExpressionList g = numbers(ExpressionList::PackThreshold);
+  REQUIRE(g.pack());
+  REQUIRE(g.numberAt(ExpressionList::PackThreshold - 1) == ExpressionList::PackThreshold - 1);
+  ExpressionList h = numbers(ExpressionList::PackThreshold);
+  h.push_back(Expression(Atom("x")));
+  REQUIRE(!h.pack());
+}
+
+TEST_CASE( "Test packed lists in the interpreter", "[list]" ) {
+
+  std::istringstream iss("(begin (define f (lambda (x) (* 2 x))) (map f (range 0 999 1)))");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+  Expression result = interp.evaluate();
+  REQUIRE(result.isLList());
+  REQUIRE(result.rTail().packed());
+  REQUIRE(result.rTail().numberAt(999) == 1998.);
+
+  REQUIRE(runToString("(range 0 3 1)") == "((0) (1) (2) (3))");
+  REQUIRE(runToString("(list 1 2 3 4 5 6 7 8)") == "((1) (2) (3) (4) (5) (6) (7) (8))");
+  REQUIRE(runToString("(append (range 0 7 1) I)") == "((0) (1) (2) (3) (4) (5) (6) (7) (0,1))");
+  REQUIRE(runToString("(join (range 0 7 1) (list \"a\"))") == "((0) (1) (2) (3) (4) (5) (6) (7) (\"a\"))");
+  REQUIRE(runToString("(first (rest (range 5 20 1)))") == "(6)");
+  REQUIRE(runToString("(length (range 0 99 1))") == "(100)");
+  REQUIRE(runToString("(apply + (range 1 10 1))") == "(55)");
+  REQUIRE(runToString("(map sqrt (list -1 -4 -9 -16 -25 -36 -49 -64))") ==
+	  "((0,1) (0,2) (0,3) (0,4) (0,5) (0,6) (0,7) (0,8))");
+}
+
+TEST_CASE( "Test pending sequences", "[list]" ) {
+
+  double start, step;
+  ExpressionList a = ExpressionList::sequence(1, 0.1, 50);
+  REQUIRE(a.size() == 50);
+  REQUIRE(a.packed());
+  REQUIRE(a.pending(start, step));
+  REQUIRE(start == 1.);
+  REQUIRE(step == 0.1);
+
+  INFO("a drop replays the skipped additions");
+  ExpressionList b = a.drop(3);
+  double num = 1;
+  for(int i = 0; i < 3; ++i){
+    num += 0.1;
+  }
+  REQUIRE(b.pending(start, step));
+  REQUIRE(start == num);
+
+  INFO("reading generates the numbers the same way range adds them");
+  const double * values = a.reals();
+  num = 1;
+  for(std::size_t i = 0; i < a.size(); ++i){
+    REQUIRE(values[i] == num);
+    num += 0.1;
+  }
+  REQUIRE(!a.pending(start, step));
+  REQUIRE(!b.pending(start, step));
+  REQUIRE(b.numberAt(0) == values[3]);
+}
+
+TEST_CASE( "Test lazy ranges in the interpreter", "[list]" ) {
+
+  double start, step;
+  std::istringstream iss("(range 0 99999 1)");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+  Expression result = interp.evaluate();
+  REQUIRE(result.rTail().pending(start, step));
+
+  REQUIRE(runToString("(length (range 0 99999 1))") == "(100000)");
+
+  INFO("length does not generate the range");
+  for(std::string program : {"(define r (range 0 99999 1))", "(length r)", "(begin r)"}){
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    result = interp.evaluate();
+  }
+  REQUIRE(result.rTail().pending(start, step));
+
+  INFO("nth and last add up their element the way the range generates it");
+  for(std::string program : {"(list (nth r 5) (last r) (nth (range 0 1 0.1) 7) (last (range 0 1 0.1)))", "(begin r)"}){
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    result = interp.evaluate();
+    if(result.rTail().size() == 4){
+      ExpressionList tenths = ExpressionList::sequence(0, 0.1, 11);
+      const double * values = tenths.reals();
+      REQUIRE(result.rTail().numberAt(0) == 5.);
+      REQUIRE(result.rTail().numberAt(1) == 99999.);
+      REQUIRE(result.rTail().numberAt(2) == values[7]);
+      REQUIRE(result.rTail().numberAt(3) == values[10]);
+    }
+  }
+  REQUIRE(result.rTail().pending(start, step));
+
+  REQUIRE(runToString("(first (map sqrt (range 4 99999 1)))") == "(2)");
+  REQUIRE(runToString("(for-each (x (range 1 100 1)) (s 0 (+ s x)) s)") == "(5050)");
+  REQUIRE(runToString("(range 0 1 0.25)") == "((0) (0.25) (0.5) (0.75) (1))");
+}
+
+TEST_CASE( "Test slices", "[list]" ) {
+
+  ExpressionList a = numbers(20);
+  a.pack();
+  ExpressionList b = a.slice(5, 10);
+  REQUIRE(b.size() == 10);
+  REQUIRE(b.reals() == a.reals() + 5);
+  REQUIRE(b.headAt(9) == Atom(14.));
+  REQUIRE(a.slice(3, 0).size() == 0);
+
+  INFO("appending to a slice in the middle of a buffer copies it");
+  b.push_back(Expression(-1.));
+  REQUIRE(b.size() == 11);
+  REQUIRE(b.headAt(10) == Atom(-1.));
+  REQUIRE(a.headAt(15) == Atom(15.));
+
+  INFO("nth, last and slice read the list in place");
+  REQUIRE(runToString("(nth (range 0 99999 1) 12345)") == "(12345)");
+  REQUIRE(runToString("(last (range 0 99999 1))") == "(99999)");
+  REQUIRE(runToString("(slice (range 0 99999 1) 10 13)") == "((10) (11) (12))");
+  REQUIRE(runToString("(slice (list 1 2 3) 3 3)") == "()");
+  REQUIRE(runToString("(length (slice (list 1 2 3) 1 1))") == "(0)");
+  REQUIRE(runToString("(nth (list 1 (list 2 3) \"x\") 1)") == "((2) (3))");
+  REQUIRE(runToString("(last (list 1 (list 2 3) \"x\"))") == "(\"x\")");
+
+  std::istringstream iss("(begin (define l (range 0 99999 1)) (define s (slice l 100 200)) (+ (nth s 0) (length s)))");
+  Interpreter interp;
+  REQUIRE(interp.parseStream(iss));
+  std::size_t before = Expression::copyCount();
+  REQUIRE(interp.evaluate() == Expression(200.));
+  REQUIRE(Expression::copyCount() - before < 100);
+}
@@ -0,0 +1,85 @@
+// Microbenchmarks for the loop special forms. Each case times a loop written
+// with do, while or for-each against the same computation done by mapping a
+// lambda over a range, and checks that both give the same result. Build with
+// optimization, e.g. -DCMAKE_BUILD_TYPE=Release, for meaningful numbers.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+struct BenchCase {
+  std::string name;
+  std::string loop;
+  std::string mapped;
+};
+
+// best of several runs, in milliseconds
+static double timeProgram(const std::string & program, Expression & result, int runs){
+  double best = 0;
+  for(int r = 0; r < runs; ++r){
+    std::istringstream iss(program);
+    Interpreter interp;
+    if(!interp.parseStream(iss)){
+      throw SemanticError("Error: benchmark program did not parse");
+    }
+    auto start = std::chrono::steady_clock::now();
+    result = interp.evaluate();
+    auto stop = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if((r == 0) || (ms < best)){
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]){
+
+  std::string n = (argc > 1) ? argv[1] : "100000";
+
+  // the bound is a definition, so the range is not folded when parsing
+  std::string prelude = "(begin (define n " + n + ") ";
+  std::string range = "(range 1 n 1)";
+
+  std::vector<BenchCase> cases = {
+    {"do sum",
+     "(do (i 1 (+ i 1)) (acc 0 (+ acc (* i i))) (> i n) acc)",
+     "(begin (define f (lambda (x) (* x x))) (apply + (map f " + range + ")))"},
+    {"while sum",
+     "(while (i 1 (+ i 1)) (acc 0 (+ acc (sin i))) (<= i n) acc)",
+     "(apply + (map sin " + range + "))"},
+    {"for-each sum",
+     "(for-each (x " + range + ") (acc 0 (+ acc (/ 1 x))) acc)",
+     "(begin (define f (lambda (x) (/ 1 x))) (apply + (map f " + range + ")))"},
+    {"for-each max",
+     "(for-each (x " + range + ") (m 0 (if (> (sin x) m) (sin x) m)) m)",
+     "(begin (define f (lambda (x) (sin x))) (define l (map f " + range + ")) "
+     "(for-each (y l) (m 0 (if (> y m) y m)) m))"},
+  };
+
+  std::cout << std::left << std::setw(14) << "case" << std::right
+	    << std::setw(14) << "loop (ms)" << std::setw(14) << "map (ms)"
+	    << std::setw(10) << "speedup" << "  result" << std::endl;
+
+  bool ok = true;
+  for(auto & c : cases){
+    Expression looped, mapped;
+    double tl = timeProgram(prelude + c.loop + ")", looped, 3);
+    double tm = timeProgram(prelude + c.mapped + ")", mapped, 3);
+    bool same = (looped == mapped);
+    ok = ok && same;
+    std::cout << std::left << std::setw(14) << c.name << std::right << std::fixed << std::setprecision(3)
+	      << std::setw(14) << tl << std::setw(14) << tm
+	      << std::setw(9) << std::setprecision(1) << (tm / tl) << "x"
+	      << "  " << (same ? "same" : "DIFFERENT") << std::endl;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,90 @@
+#include "memo.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// lookups over all tables, see MemoTable::totalHits
+static std::atomic<std::size_t> allHits(0);
+static std::atomic<std::size_t> allMisses(0);
+
+bool MemoKey::operator==(const MemoKey & other) const noexcept{
+  return (count == other.count) &&
+    (std::memcmp(values, other.values, count * sizeof(double)) == 0);
+}
+
+std::size_t MemoTable::KeyHash::operator()(const MemoKey & key) const noexcept{
+  std::uint64_t hash = key.count;
+  for(std::size_t i = 0; i < key.count; ++i){
+    std::uint64_t bits;
+    std::memcpy(&bits, &key.values[i], sizeof(bits));
+    hash = (hash ^ bits) * 0x100000001b3ull;
+    hash ^= hash >> 29;
+  }
+  return static_cast<std::size_t>(hash);
+}
+
+MemoTable::MemoTable(std::size_t capacity):
+  limit(std::max<std::size_t>(capacity, 1)), hitCount(0), missCount(0){}
+
+bool MemoTable::find(const MemoKey & key, std::uint32_t generation, Expression & result){
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if(generation != valid){
+    order.clear();
+    index.clear();
+    valid = generation;
+  }
+
+  auto found = index.find(key);
+  if(found == index.end()){
+    missCount.fetch_add(1, std::memory_order_relaxed);
+    allMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  order.splice(order.begin(), order, found->second);
+  result = found->second->result;
+  hitCount.fetch_add(1, std::memory_order_relaxed);
+  allHits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void MemoTable::insert(const MemoKey & key, std::uint32_t generation, const Expression & result){
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // computed before the environment changed, or by another thread meanwhile
+  if((generation != valid) || (index.find(key) != index.end())){
+    return;
+  }
+  if(order.size() == limit){
+    index.erase(order.back().key);
+    order.pop_back();
+  }
+  order.push_front(Entry{key, result});
+  index.emplace(key, order.begin());
+}
+
+std::size_t MemoTable::size() const{
+  std::lock_guard<std::mutex> lock(mutex);
+  return order.size();
+}
+
+std::size_t MemoTable::capacity() const noexcept{
+  return limit;
+}
+
+std::size_t MemoTable::hits() const noexcept{
+  return hitCount.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoTable::misses() const noexcept{
+  return missCount.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoTable::totalHits() noexcept{
+  return allHits.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoTable::totalMisses() noexcept{
+  return allMisses.load(std::memory_order_relaxed);
+}
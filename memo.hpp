@@ -0,0 +1,108 @@
+/*! \file memo.hpp
+Defines MemoTable, the bounded cache of results of a memoized lambda.
+ */
+
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+// system includes
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// module includes
+#include "expression.hpp"
+
+/*! \struct MemoKey
+\brief The arguments of a call, when they are all plain Numbers.
+
+Numbers compare by their bits, so 0 and -0 are different keys and a NaN
+argument finds its own result.
+ */
+struct MemoKey {
+  /// the most arguments a key holds, calls with more are not cached
+  static const std::size_t MaxArguments = 4;
+
+  double values[MaxArguments];
+  std::size_t count = 0;
+
+  /// true if both keys hold the same Numbers
+  bool operator==(const MemoKey & other) const noexcept;
+};
+
+/*! \class MemoTable
+\brief Results of calls to a lambda keyed on their arguments, at most
+capacity of them, evicting the least recently used.
+
+A result is only valid for the environment generation it was computed in,
+see Environment::generation; a lookup in another generation empties the
+table first. The table is locked, so calls from several threads may share
+it. Hits and misses are counted per table and over all tables.
+ */
+class MemoTable {
+public:
+
+  /// the capacity memoize gives a table by default
+  static const std::size_t DefaultCapacity = 4096;
+
+  /// construct an empty table holding at most capacity results
+  explicit MemoTable(std::size_t capacity);
+
+  MemoTable(const MemoTable &) = delete;
+  MemoTable & operator=(const MemoTable &) = delete;
+
+  /*! Find the result of an earlier call.
+    \param key the arguments
+    \param generation the generation of the environment
+    \param result set to the result on a hit
+    \return true on a hit
+   */
+  bool find(const MemoKey & key, std::uint32_t generation, Expression & result);
+
+  /// remember the result of a call, evicting the least recently used result if full
+  void insert(const MemoKey & key, std::uint32_t generation, const Expression & result);
+
+  /// number of results held
+  std::size_t size() const;
+
+  /// the most results held
+  std::size_t capacity() const noexcept;
+
+  /// number of lookups that found a result
+  std::size_t hits() const noexcept;
+
+  /// number of lookups that did not
+  std::size_t misses() const noexcept;
+
+  /// hits over all tables since the program started
+  static std::size_t totalHits() noexcept;
+
+  /// misses over all tables since the program started
+  static std::size_t totalMisses() noexcept;
+
+private:
+
+  struct KeyHash {
+    std::size_t operator()(const MemoKey & key) const noexcept;
+  };
+
+  struct Entry {
+    MemoKey key;
+    Expression result;
+  };
+
+  // most recently used first
+  std::list<Entry> order;
+  std::unordered_map<MemoKey, std::list<Entry>::iterator, KeyHash> index;
+
+  std::size_t limit;
+  std::uint32_t valid = 0;
+  std::atomic<std::size_t> hitCount;
+  std::atomic<std::size_t> missCount;
+  mutable std::mutex mutex;
+};
+
+#endif
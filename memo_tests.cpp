@@ -0,0 +1,107 @@
+#include "catch.hpp"
+
+#include <limits>
+#include <string>
+
+#include "interpreter.hpp"
+#include "memo.hpp"
+#include "semantic_error.hpp"
+#include "test_programs.hpp"
+
+static MemoKey key(double x, double y){
+  MemoKey k;
+  k.values[0] = x;
+  k.values[1] = y;
+  k.count = 2;
+  return k;
+}
+
+TEST_CASE( "Test memo table lookups", "[memo]" ) {
+
+  MemoTable table(2);
+  Expression result;
+
+  REQUIRE(!table.find(key(1, 2), 1, result));
+  table.insert(key(1, 2), 1, Expression(3.));
+  REQUIRE(table.find(key(1, 2), 1, result));
+  REQUIRE(result == Expression(3.));
+  REQUIRE(!table.find(key(2, 1), 1, result));
+  REQUIRE(table.hits() == 1);
+  REQUIRE(table.misses() == 2);
+
+  INFO("the least recently used result is evicted");
+  table.insert(key(2, 1), 1, Expression(4.));
+  REQUIRE(table.find(key(1, 2), 1, result));
+  table.insert(key(5, 5), 1, Expression(10.));
+  REQUIRE(table.size() == 2);
+  REQUIRE(table.find(key(1, 2), 1, result));
+  REQUIRE(!table.find(key(2, 1), 1, result));
+  REQUIRE(table.find(key(5, 5), 1, result));
+
+  INFO("keys compare by their bits");
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  table.insert(key(nan, 0.), 1, Expression(1.));
+  REQUIRE(table.find(key(nan, 0.), 1, result));
+  REQUIRE(!table.find(key(nan, -0.), 1, result));
+
+  INFO("a new generation drops every result");
+  REQUIRE(!table.find(key(nan, 0.), 2, result));
+  REQUIRE(table.size() == 0);
+  table.insert(key(1, 1), 1, Expression(2.));
+  REQUIRE(table.size() == 0);
+}
+
+TEST_CASE( "Test memoized lambdas", "[memo]" ) {
+
+  std::size_t hits = MemoTable::totalHits();
+  std::size_t misses = MemoTable::totalMisses();
+
+  INFO("recursion through the memoized lambda reuses its results");
+  REQUIRE(outcome("(begin (define fib (lambda (n) (if (< n 2) n (+ (fm (- n 1)) (fm (- n 2))))))"
+		  "(define fm (memoize fib)) (fm 60))") == "(1.54801e+12)");
+  REQUIRE(MemoTable::totalMisses() - misses == 61);
+  REQUIRE(MemoTable::totalHits() - hits == 58);
+
+  REQUIRE(outcome("(begin (define f (lambda (x y) (* x y))) (define g (memoize f 1))"
+		  "(list (g 2 3) (g 2 3) (g 3 4) (g 2 3)))") == "((6) (6) (12) (6))");
+  REQUIRE(outcome("(begin (define f (lambda (x) (list x x))) (define g (memoize f))"
+		  "(list (g 1) (g (list 1)) (g I)))") == "(((1) (1)) (((1)) ((1))) ((0,1) (0,1)))");
+
+  INFO("a lambda may call a symbol defined after it is memoized");
+  REQUIRE(outcome("(begin (define f (lambda (x) (+ x (h x)))) (define g (memoize f))"
+		  "(define h (lambda (x) 1)) (g 1))") == "(2)");
+
+  INFO("a define of another symbol keeps the results");
+  hits = MemoTable::totalHits();
+  REQUIRE(outcome("(begin (define f (lambda (x) (* x x))) (define g (memoize f))"
+		  "(define a (map g (range 0 1 0.1))) (define b (map g (range 0 1 0.1))) (length b))") == "(11)");
+  REQUIRE(MemoTable::totalHits() - hits == 11);
+
+  INFO("errors are not remembered");
+  REQUIRE(outcome("(begin (define f (lambda (x) (first x))) (define g (memoize f)) (g 1))") ==
+	  "Error: argument to first is not a list");
+
+  REQUIRE(outcome("(memoize 1)") == "Error: argument to memoize is not a procedure");
+  REQUIRE(outcome("(begin (define f (lambda (x) x)) (memoize f 0))") ==
+	  "Error: capacity in call to memoize is not a positive integer");
+  REQUIRE(outcome("(begin (define f (lambda (x) x)) (memoize f 1.5))") ==
+	  "Error: capacity in call to memoize is not a positive integer");
+  REQUIRE(outcome("(begin (define f (lambda (x) x)) (memoize f 1 2))") == "Error: invalid number of arguments in call to memoize");
+}
+
+TEST_CASE( "Test continuous plots evaluate each point once", "[memo]" ) {
+
+  // a memoized procedure counts the calls of the plot
+  std::string program = "(begin (define f (lambda (x) (sin (* 40 x)))) (define g (memoize f 100000))"
+    " (continuous-plot g (list -3 3)))";
+
+  std::size_t hits = MemoTable::totalHits();
+  std::size_t misses = MemoTable::totalMisses();
+  std::string plot = outcome(program, true);
+  REQUIRE(plot.find("Error") == std::string::npos);
+  REQUIRE(MemoTable::totalHits() == hits);
+  REQUIRE(MemoTable::totalMisses() - misses > 51);
+
+  INFO("a memoized procedure gives the same plot");
+  REQUIRE(outcome("(begin (define g (lambda (x) (sin (* 40 x)))) (continuous-plot g (list -3 3)))", true) == plot);
+}
@@ -1,6 +1,12 @@
 #include "parse.hpp"
 
+#include <algorithm>
+#include <iterator>
 #include <stack>
+#include <vector>
+
+#include "environment.hpp"
+#include "semantic_error.hpp"
 
 bool setHead(Expression &exp, const Token &token) {
 
@@ -95,3 +101,121 @@ Expression parse(const TokenSequenceType &tokens) noexcept {
 
   return Expression();
 };
+
+namespace {
+
+// the built-ins every program starts with. Procedures only see their
+// arguments, so calling one on constants always gives the same value.
+Environment & builtins() {
+  static thread_local Environment env;
+  return env;
+}
+
+// true if exp evaluates to itself: a number, complex or string, or a
+// nonempty list of those. The empty list holds the empty symbol.
+bool isConstant(const Expression & exp) {
+  if (exp.isLLambda()) {
+    return false;
+  }
+  if (exp.isLList()) {
+    // packed elements are plain numbers
+    if (exp.rTail().packed()) {
+      return true;
+    }
+    for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it) {
+      if (!isConstant(*it)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  const Atom &head = exp.head();
+  return (exp.tailConstBegin() == exp.tailConstEnd()) &&
+         (head.isNumber() || head.isComplex() || head.isString());
+}
+
+bool isSymbol(const Expression & exp, const char * name) {
+  return exp.isHeadSymbol() && (exp.head().asSymbol() == name);
+}
+
+void bind(std::vector<SymbolId> &bound, const Expression & exp) {
+  if (exp.isHeadSymbol()) {
+    bound.push_back(exp.head().symbolId());
+  }
+}
+
+// the symbols lambdas and loops in exp bind, parameters, loop variables and
+// defines, and the global defines
+void collectBound(const Expression & exp, std::vector<SymbolId> &bound) {
+  std::size_t n = std::distance(exp.tailConstBegin(), exp.tailConstEnd());
+  bool loop = isSymbol(exp, "do") || isSymbol(exp, "while");
+  if ((loop || isSymbol(exp, "for-each")) && (n >= 2)) {
+    std::size_t variables = n - (loop ? 2 : 1);
+    for (auto it = exp.tailConstBegin(); it != exp.tailConstBegin() + variables; ++it) {
+      bind(bound, *it);
+    }
+  }
+  else if (isSymbol(exp, "lambda") && (n == 2)) {
+    const Expression &params = *exp.tailConstBegin();
+    bind(bound, params);
+    for (auto it = params.tailConstBegin(); it != params.tailConstEnd(); ++it) {
+      bind(bound, *it);
+    }
+  }
+  else if (isSymbol(exp, "define") && (n == 2)) {
+    bind(bound, *exp.tailConstBegin());
+  }
+  for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it) {
+    collectBound(*it, bound);
+  }
+}
+
+Expression fold(const Expression & exp, const std::vector<SymbolId> &bound) {
+
+  const Atom &head = exp.head();
+  if (!head.isSymbol() || exp.isLList()) {
+    return exp;
+  }
+  bool rebound = std::find(bound.begin(), bound.end(), head.symbolId()) != bound.end();
+
+  if (exp.tailConstBegin() == exp.tailConstEnd()) {
+    return (!rebound && builtins().is_exp(head)) ? builtins().get_exp(head) : exp;
+  }
+
+  // the names define and lambda bind and the procedures map, pmap, reduce,
+  // fold and apply call are not evaluated
+  bool keepFirst = isSymbol(exp, "define") || isSymbol(exp, "lambda") ||
+                   isSymbol(exp, "map") || isSymbol(exp, "pmap") || isSymbol(exp, "apply") ||
+                   isSymbol(exp, "reduce") || isSymbol(exp, "fold");
+
+  Expression result(head);
+  bool constant = true;
+  for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it) {
+    if (keepFirst && (it == exp.tailConstBegin())) {
+      result.append(*it);
+      continue;
+    }
+    result.append(fold(*it, bound));
+    constant = constant && isConstant(*(result.tailConstEnd() - 1));
+  }
+
+  if (constant && !rebound && (isSymbol(exp, "list") || builtins().find_builtin(head))) {
+    try {
+      Expression value = result.eval(builtins());
+      if (isConstant(value)) {
+        return value;
+      }
+    } catch (const SemanticError &) {
+    }
+  }
+  return result;
+}
+
+}
+
+Expression fold_constants(const Expression & ast) {
+
+  std::vector<SymbolId> bound;
+  collectBound(ast, bound);
+  return fold(ast, bound);
+}
@@ -15,4 +15,19 @@ Defines the parse function.
  */
 Expression parse(const TokenSequenceType & tokens) noexcept;
 
+/*! \fn fold_constants
+\brief replace the parts of an expression that do not depend on the environment by their values
+
+Calls of built-in procedures and list on constant arguments are evaluated,
+and the built-in constants pi, e and I are replaced by their values.
+Built-ins cannot be redefined, but a lambda can bind their names as
+parameters or by define in its body, and a loop as loop variables; a symbol
+bound that way anywhere in the expression is left alone everywhere. A call
+that fails is kept, so the error is reported when it is evaluated.
+
+\param ast, an expression returned by parse
+\returns the folded expression
+ */
+Expression fold_constants(const Expression & ast);
+
 #endif
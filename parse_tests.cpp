@@ -1,6 +1,10 @@
 #include "catch.hpp"
 
 #include "parse.hpp"
+#include "environment.hpp"
+
+#include <cmath>
+#include <complex>
 
 TEST_CASE("Test parser with expected input", "[parse]") {
 
@@ -57,3 +61,64 @@ TEST_CASE( "Test empty parens", "[parse]" ) {
   REQUIRE(parse(tokens) == Expression());
 }
 
+
+static Expression folded(const std::string & program) {
+
+  std::istringstream iss(program);
+
+  return fold_constants(parse(tokenize(iss)));
+}
+
+static Expression parsed(const std::string & program) {
+
+  std::istringstream iss(program);
+
+  return parse(tokenize(iss));
+}
+
+TEST_CASE( "Test folding constant calls", "[parse]" ) {
+
+  const double pi = std::atan2(0, -1);
+
+  REQUIRE(folded("(* 2 pi)") == Expression(2 * pi));
+  REQUIRE(folded("(+ 1 (* 2 3) (- 4))") == Expression(3.));
+  REQUIRE(folded("(e)") == Expression(std::exp(1)));
+  REQUIRE(folded("(* 2 I)") == Expression(std::complex<double>(0, 2)));
+
+  // only the constant parts of a call are folded
+  REQUIRE(folded("(+ x (* 2 3))") == parsed("(+ x 6)"));
+  REQUIRE(folded("(begin (define r 10) (* pi (* r r)))") ==
+	  parsed("(begin (define r 10) (* 3.141592653589793 (* r r)))"));
+}
+
+TEST_CASE( "Test folding literal lists", "[parse]" ) {
+
+  Expression list = folded("(list 1 (list 2 \"two\") (+ 1 2))");
+
+  Environment env;
+  REQUIRE(list.isLList());
+  REQUIRE(list == parsed("(list 1 (list 2 \"two\") 3)").eval(env));
+  REQUIRE(list.eval(env) == list);
+
+  // the empty list is not a constant
+  REQUIRE(folded("(list)") == parsed("(list)"));
+}
+
+TEST_CASE( "Test folding keeps shadowed names and errors", "[parse]" ) {
+
+  std::vector<std::string> programs = {
+    "(lambda (pi) (* 2 pi))",
+    "(begin (define f (lambda (+) (+ 1 2))) (+ 3 4))",
+    "(lambda (x) (begin (define e 2) (* e 3)))",
+    "(define pi 3)",
+    "(map pi (list))",
+    "(+ 1 \"one\")",
+    "(sqrt)",
+    "(f 1 2)",
+  };
+
+  for(auto & program : programs){
+    INFO(program);
+    REQUIRE(folded(program) == parsed(program));
+  }
+}
@@ -9,6 +9,7 @@
 #include "semantic_error.hpp"
 #include "startup_config.hpp"
 #include "consumer.hpp"
+#include "memo.hpp"
 
 
 // *****************************************************************************
@@ -145,6 +146,13 @@ void repl(){
 
 		if (line.empty()) continue;
 
+		// the counters cover every memoized lambda, running kernel or not
+		if (line == "%memo")
+		{
+			info("memo hits " + std::to_string(MemoTable::totalHits()) +
+				", misses " + std::to_string(MemoTable::totalMisses()));
+			continue;
+		}
 		
 		Expression exp;
 		switch (currentS) {
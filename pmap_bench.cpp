@@ -0,0 +1,77 @@
+// Microbenchmark for pmap. Each case maps a lambda over a range with map and
+// with pmap and checks that both give the same list; the speedup is bounded
+// by the number of cores. Build with optimization, e.g.
+// -DCMAKE_BUILD_TYPE=Release, for meaningful numbers.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+struct BenchCase {
+  std::string name;
+  std::string lambda;
+};
+
+// best of several runs, in milliseconds
+static double timeProgram(const std::string & program, Expression & result, int runs){
+  double best = 0;
+  for(int r = 0; r < runs; ++r){
+    std::istringstream iss(program);
+    Interpreter interp;
+    if(!interp.parseStream(iss)){
+      throw SemanticError("Error: benchmark program did not parse");
+    }
+    auto start = std::chrono::steady_clock::now();
+    result = interp.evaluate();
+    auto stop = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if((r == 0) || (ms < best)){
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]){
+
+  std::string n = (argc > 1) ? argv[1] : "20000";
+
+  // the bound is a definition, so the range is not folded when parsing
+  std::string prelude = "(begin (define n " + n + ") ";
+  std::string range = "(range 1 n 1)";
+
+  std::vector<BenchCase> cases = {
+    {"cheap", "(lambda (x) (* x x))"},
+    {"polynomial", "(lambda (x) (+ (* 3 (^ x 3)) (* -2 (^ x 2)) (sin x) (cos x) 1))"},
+    {"series", "(lambda (x) (do (k 1 (+ k 1)) (s 0 (+ s (/ (sin (* k x)) k))) (> k 50) s))"},
+  };
+
+  std::cout << "threads: " << ThreadPool::shared().workers() + 1 << std::endl;
+  std::cout << std::left << std::setw(14) << "case" << std::right
+	    << std::setw(14) << "map (ms)" << std::setw(14) << "pmap (ms)"
+	    << std::setw(10) << "speedup" << "  result" << std::endl;
+
+  bool ok = true;
+  for(auto & c : cases){
+    Expression mapped, pmapped;
+    std::string define = "(define f " + c.lambda + ") ";
+    double tm = timeProgram(prelude + define + "(map f " + range + "))", mapped, 3);
+    double tp = timeProgram(prelude + define + "(pmap f " + range + "))", pmapped, 3);
+    bool same = (mapped == pmapped);
+    ok = ok && same;
+    std::cout << std::left << std::setw(14) << c.name << std::right << std::fixed << std::setprecision(3)
+	      << std::setw(14) << tm << std::setw(14) << tp
+	      << std::setw(9) << std::setprecision(1) << (tm / tp) << "x"
+	      << "  " << (same ? "same" : "DIFFERENT") << std::endl;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,37 @@
+#include "symbol.hpp"
+
+SymbolTable::SymbolTable(){
+  intern("");
+}
+
+SymbolTable & SymbolTable::instance(){
+  static SymbolTable table;
+  return table;
+}
+
+SymbolId SymbolTable::intern(const std::string & value){
+
+  std::lock_guard<std::mutex> lock(the_mutex);
+
+  auto result = ids.find(value);
+  if(result != ids.end()){
+    return result->second;
+  }
+
+  SymbolId id = static_cast<SymbolId>(names.size());
+  names.push_back(value);
+  ids.emplace(value, id);
+  return id;
+}
+
+const std::string & SymbolTable::name(SymbolId id) const{
+
+  std::lock_guard<std::mutex> lock(the_mutex);
+  return names.at(id);
+}
+
+std::size_t SymbolTable::size() const{
+
+  std::lock_guard<std::mutex> lock(the_mutex);
+  return names.size();
+}
@@ -0,0 +1,62 @@
+/*! \file symbol.hpp
+Defines the global symbol table used to intern Symbol and String atoms.
+
+Every distinct spelling is stored exactly once and identified by a 32-bit
+SymbolId, so atoms can be copied, compared and used as map keys as plain
+integers. The table only grows; ids stay valid for the life of the process.
+ */
+
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*! \typedef SymbolId
+\brief The interned identity of a symbol or string spelling.
+*/
+typedef std::uint32_t SymbolId;
+
+/*! \class SymbolTable
+\brief A thread-safe, append-only interner mapping spellings to SymbolIds.
+
+The empty spelling is always interned as id 0.
+*/
+class SymbolTable {
+public:
+
+  /// the process wide table
+  static SymbolTable & instance();
+
+  /// return the id of value, adding it to the table if needed
+  SymbolId intern(const std::string & value);
+
+  /// return the spelling of an interned id
+  const std::string & name(SymbolId id) const;
+
+  /// number of interned spellings
+  std::size_t size() const;
+
+private:
+  SymbolTable();
+
+  mutable std::mutex the_mutex;
+  std::unordered_map<std::string, SymbolId> ids;
+  // deque keeps references to existing names stable while growing
+  std::deque<std::string> names;
+};
+
+/// intern value in the global symbol table
+inline SymbolId intern(const std::string & value){
+  return SymbolTable::instance().intern(value);
+}
+
+/// spelling of an id in the global symbol table
+inline const std::string & symbolName(SymbolId id){
+  return SymbolTable::instance().name(id);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*! \file symbol_map.hpp
+Defines SymbolMap, the hash table the Environment uses to find bindings.
+ */
+
+#ifndef SYMBOL_MAP_HPP
+#define SYMBOL_MAP_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "symbol.hpp"
+
+/*! \class SymbolMap
+\brief An open-addressing hash table from SymbolId to T.
+
+Keys are interned ids, so hashing is a single multiplication and the
+entries are stored inline in one array, probed linearly. The table is
+kept at most half full, so a lookup touches one or two cache lines. Entries
+can be inserted and overwritten but not erased one at a time; clear()
+empties the whole table.
+
+T must be default constructible and copy assignable.
+*/
+template <typename T>
+class SymbolMap {
+public:
+
+  /// construct an empty map
+  SymbolMap();
+
+  /// pointer to the value mapped to key, or nullptr
+  T * find(SymbolId key) noexcept;
+
+  /// const pointer to the value mapped to key, or nullptr
+  const T * find(SymbolId key) const noexcept;
+
+  /*! Map key to value unless key is already mapped.
+    \return a pointer to the value mapped to key and true if value was inserted
+   */
+  std::pair<T *, bool> insert(SymbolId key, const T & value);
+
+  /// number of mapped keys
+  std::size_t size() const noexcept;
+
+  /// remove every key, the capacity is kept
+  void clear() noexcept;
+
+private:
+
+  // marks a free entry, ids are handed out from 0 and never get this high
+  static const SymbolId EmptyKey = ~SymbolId(0);
+
+  struct Entry {
+    SymbolId key;
+    T value;
+  };
+
+  // the table, its size is a power of two
+  std::vector<Entry> entries;
+
+  std::size_t count;
+
+  // 32 - log2(entries.size()), see home()
+  unsigned shift;
+
+  // the first entry to probe for key
+  std::size_t home(SymbolId key) const noexcept;
+
+  // the entry holding key, or the free entry where key would go
+  std::size_t probe(SymbolId key) const noexcept;
+
+  // double the capacity and reinsert every entry
+  void grow();
+};
+
+#include "symbol_map.tpp"
+
+#endif
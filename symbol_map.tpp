@@ -0,0 +1,75 @@
+// inline definitions for SymbolMap, included at the end of symbol_map.hpp
+
+#include <cstdint>
+
+template <typename T>
+SymbolMap<T>::SymbolMap(): entries(64, Entry{EmptyKey, T()}), count(0), shift(32 - 6){}
+
+template <typename T>
+std::size_t SymbolMap<T>::home(SymbolId key) const noexcept{
+  // Fibonacci hashing, spreads the sequential ids over the table
+  return static_cast<std::uint32_t>(key * 2654435769u) >> shift;
+}
+
+template <typename T>
+std::size_t SymbolMap<T>::probe(SymbolId key) const noexcept{
+  std::size_t mask = entries.size() - 1;
+  std::size_t i = home(key);
+  while((entries[i].key != key) && (entries[i].key != EmptyKey)){
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+template <typename T>
+T * SymbolMap<T>::find(SymbolId key) noexcept{
+  Entry & entry = entries[probe(key)];
+  return (entry.key == key) ? &entry.value : nullptr;
+}
+
+template <typename T>
+const T * SymbolMap<T>::find(SymbolId key) const noexcept{
+  const Entry & entry = entries[probe(key)];
+  return (entry.key == key) ? &entry.value : nullptr;
+}
+
+template <typename T>
+std::pair<T *, bool> SymbolMap<T>::insert(SymbolId key, const T & value){
+  std::size_t i = probe(key);
+  if(entries[i].key == key){
+    return std::make_pair(&entries[i].value, false);
+  }
+  if(2 * (count + 1) > entries.size()){
+    grow();
+    i = probe(key);
+  }
+  entries[i].key = key;
+  entries[i].value = value;
+  ++count;
+  return std::make_pair(&entries[i].value, true);
+}
+
+template <typename T>
+std::size_t SymbolMap<T>::size() const noexcept{
+  return count;
+}
+
+template <typename T>
+void SymbolMap<T>::clear() noexcept{
+  for(auto & entry : entries){
+    entry.key = EmptyKey;
+  }
+  count = 0;
+}
+
+template <typename T>
+void SymbolMap<T>::grow(){
+  std::vector<Entry> old(2 * entries.size(), Entry{EmptyKey, T()});
+  old.swap(entries);
+  --shift;
+  for(auto & entry : old){
+    if(entry.key != EmptyKey){
+      entries[probe(entry.key)] = entry;
+    }
+  }
+}
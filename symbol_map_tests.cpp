@@ -0,0 +1,53 @@
+#include "catch.hpp"
+
+#include "symbol_map.hpp"
+
+#include <string>
+#include <vector>
+
+TEST_CASE( "Test symbol map insert and find", "[symbol_map]" ) {
+
+  SymbolMap<int> map;
+  REQUIRE(map.size() == 0);
+  REQUIRE(map.find(intern("a")) == nullptr);
+
+  auto a = map.insert(intern("a"), 1);
+  REQUIRE(a.second);
+  REQUIRE(*a.first == 1);
+  REQUIRE(*map.find(intern("a")) == 1);
+
+  INFO("inserting an existing key keeps its value");
+  auto again = map.insert(intern("a"), 2);
+  REQUIRE(!again.second);
+  REQUIRE(*again.first == 1);
+  REQUIRE(map.size() == 1);
+
+  *map.find(intern("a")) = 3;
+  const SymbolMap<int> & c = map;
+  REQUIRE(*c.find(intern("a")) == 3);
+
+  map.clear();
+  REQUIRE(map.size() == 0);
+  REQUIRE(map.find(intern("a")) == nullptr);
+}
+
+TEST_CASE( "Test symbol map growth", "[symbol_map]" ) {
+
+  SymbolMap<std::size_t> map;
+  std::vector<SymbolId> ids;
+  bool all = true;
+  for(std::size_t i = 0; i < 20000; ++i){
+    ids.push_back(intern("symbol-map-test-" + std::to_string(i)));
+    all = all && map.insert(ids.back(), i).second;
+  }
+  REQUIRE(all);
+  REQUIRE(map.size() == 20000);
+
+  for(std::size_t i = 0; i < ids.size(); ++i){
+    const std::size_t * value = map.find(ids[i]);
+    all = all && value && (*value == i);
+  }
+  REQUIRE(all);
+  REQUIRE(map.find(intern("symbol-map-test-missing")) == nullptr);
+  REQUIRE(map.find(0) == nullptr);
+}
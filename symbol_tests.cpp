@@ -0,0 +1,55 @@
+#include "catch.hpp"
+
+#include "symbol.hpp"
+#include "atom.hpp"
+
+#include <thread>
+#include <vector>
+
+TEST_CASE( "Test interning", "[symbol]" ) {
+
+  SymbolId a = intern("a-symbol");
+  SymbolId b = intern("b-symbol");
+
+  REQUIRE(a != b);
+  REQUIRE(intern("a-symbol") == a);
+  REQUIRE(symbolName(a) == "a-symbol");
+  REQUIRE(symbolName(b) == "b-symbol");
+  REQUIRE(intern("") == 0);
+}
+
+TEST_CASE( "Test atoms share interned ids", "[symbol]" ) {
+
+  Atom sym("hello");
+  Atom str("hello");
+  str.setString();
+
+  REQUIRE(sym.symbolId() == intern("hello"));
+  REQUIRE(str.symbolId() == sym.symbolId());
+  REQUIRE(sym != str);
+  REQUIRE(sym.asSymbol() == "hello");
+  REQUIRE(str.asString() == "hello");
+  REQUIRE(Atom(1.0).symbolId() == 0);
+
+  Atom copy(sym);
+  REQUIRE(copy == sym);
+  REQUIRE(copy.symbolId() == sym.symbolId());
+}
+
+TEST_CASE( "Test concurrent interning", "[symbol]" ) {
+
+  std::vector<SymbolId> first(100), second(100);
+  auto work = [](std::vector<SymbolId> & out){
+    for(std::size_t i = 0; i < out.size(); ++i){
+      out[i] = intern("concurrent-" + std::to_string(i));
+    }
+  };
+
+  std::thread t1(work, std::ref(first));
+  std::thread t2(work, std::ref(second));
+  t1.join();
+  t2.join();
+
+  REQUIRE(first == second);
+  REQUIRE(symbolName(first[42]) == "concurrent-42");
+}
@@ -0,0 +1,80 @@
+// Stress benchmark for calls in tail position. Each case runs a loop written
+// as a tail-recursive lambda for the given number of iterations, one million
+// by default, and reports the time per iteration. Before calls in tail
+// position reused their frame these overflowed the C++ stack. Build with
+// optimization, e.g. -DCMAKE_BUILD_TYPE=Release, for meaningful numbers.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+struct BenchCase {
+  std::string name;
+  std::string defines;
+  std::string call;
+  Expression expected;
+};
+
+// best of several runs, in milliseconds
+static double timeProgram(const BenchCase & c, const std::string & n, Expression & result, int runs){
+  double best = 0;
+  for(int r = 0; r < runs; ++r){
+    std::istringstream iss("(begin (define n " + n + ") " + c.defines + " " + c.call + ")");
+    Interpreter interp;
+    if(!interp.parseStream(iss)){
+      throw SemanticError("Error: benchmark program did not parse");
+    }
+    auto start = std::chrono::steady_clock::now();
+    result = interp.evaluate();
+    auto stop = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if((r == 0) || (ms < best)){
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]){
+
+  std::string n = (argc > 1) ? argv[1] : "1000000";
+  double iterations = std::atof(n.c_str());
+
+  std::vector<BenchCase> cases = {
+    {"countdown", "(define loop (lambda (i) (if (= i 0) 0 (loop (- i 1)))))",
+     "(loop n)", Expression(0.)},
+    {"sum", "(define sum (lambda (i acc) (if (= i 0) acc (sum (- i 1) (+ acc i)))))",
+     "(sum n 0)", Expression(iterations * (iterations + 1) / 2)},
+    {"cond", "(define step (lambda (i) (cond (= i 0) 0 (< i 0) (step (+ i 1)) (step (- i 1)))))",
+     "(step n)", Expression(0.)},
+    {"begin", "(define count (lambda (i) (begin (define j (- i 1)) (if (< j 0) i (count j)))))",
+     "(count n)", Expression(0.)},
+    {"mutual", "(define even (lambda (i) (or (= i 0) (odd (- i 1))))) "
+     "(define odd (lambda (i) (and (not (= i 0)) (even (- i 1)))))",
+     "(even n)", Expression((static_cast<long long>(iterations) % 2 == 0) ? 1. : 0.)},
+  };
+
+  std::cout << std::left << std::setw(14) << "case" << std::right
+	    << std::setw(14) << "total (ms)" << std::setw(16) << "per call (ns)"
+	    << "  result" << std::endl;
+
+  bool ok = true;
+  for(auto & c : cases){
+    Expression result;
+    double ms = timeProgram(c, n, result, 3);
+    bool same = (result == c.expected);
+    ok = ok && same;
+    std::cout << std::left << std::setw(14) << c.name << std::right << std::fixed << std::setprecision(3)
+	      << std::setw(14) << ms << std::setw(16) << std::setprecision(1) << (ms * 1e6 / iterations)
+	      << "  " << (same ? "ok" : "WRONG") << std::endl;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,63 @@
+/*! \file test_programs.hpp
+Helpers the unit tests share to evaluate whole plotscript programs.
+ */
+
+#ifndef TEST_PROGRAMS_HPP
+#define TEST_PROGRAMS_HPP
+
+// system includes
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// module includes
+#include "catch.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "startup_config.hpp"
+
+/*! Parse a program, after evaluating the startup file if asked to.
+  \param interp the interpreter to parse into
+  \param program the program, it must parse
+  \param startup true to evaluate the startup file first
+ */
+inline void parseInto(Interpreter & interp, const std::string & program, bool startup){
+  if(startup){
+    std::ifstream ifs(STARTUP_FILE);
+    interp.parseStream(ifs);
+    interp.evaluate();
+  }
+  std::istringstream iss(program);
+  INFO("parsing " << program);
+  REQUIRE(interp.parseStream(iss));
+}
+
+/// the result of a program, any error it throws is passed on
+inline Expression run(const std::string & program){
+  Interpreter interp;
+  parseInto(interp, program, false);
+  return interp.evaluate();
+}
+
+/// the result of a program as printed
+inline std::string runToString(const std::string & program){
+  std::ostringstream out;
+  out << run(program);
+  return out.str();
+}
+
+/// the result of a program as printed, or the message it throws
+inline std::string outcome(const std::string & program, bool startup = false){
+  Interpreter interp;
+  parseInto(interp, program, startup);
+  std::ostringstream out;
+  try{
+    out << interp.evaluate();
+  }
+  catch(const SemanticError & ex){
+    out << ex.what();
+  }
+  return out.str();
+}
+
+#endif
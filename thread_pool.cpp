@@ -0,0 +1,144 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// the pool the current thread works for and the index of its queue
+thread_local const ThreadPool * owner = nullptr;
+thread_local std::size_t ownerQueue = 0;
+
+}
+
+ThreadPool::ThreadPool(std::size_t workers): queued(0), stopping(false){
+  for(std::size_t i = 0; i <= workers; ++i){
+    queues.emplace_back(new Queue);
+  }
+  for(std::size_t i = 0; i < workers; ++i){
+    threads.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool(){
+  {
+    std::lock_guard<std::mutex> lock(sleeping);
+    stopping.store(true);
+  }
+  wake.notify_all();
+  for(auto & thread : threads){
+    thread.join();
+  }
+}
+
+std::size_t ThreadPool::workers() const noexcept{
+  return threads.size();
+}
+
+ThreadPool & ThreadPool::shared(){
+  static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+void ThreadPool::parallel_for(std::size_t count, std::size_t grain, const RangeBody & body){
+
+  if(count == 0){
+    return;
+  }
+
+  Loop loop;
+  loop.body = &body;
+  loop.grain = std::max<std::size_t>(grain, 1);
+  loop.remaining.store(count);
+
+  std::size_t self = own_queue();
+  run(self, Task{&loop, 0, count});
+
+  // help with any task, ours may have been stolen, until the loop is done
+  while(loop.remaining.load(std::memory_order_acquire) > 0){
+    Task task;
+    if(take(self, task)){
+      run(self, task);
+    }
+    else{
+      std::this_thread::yield();
+    }
+  }
+}
+
+std::size_t ThreadPool::own_queue() const noexcept{
+  return (owner == this) ? ownerQueue : queues.size() - 1;
+}
+
+void ThreadPool::push(std::size_t queue, const Task & task){
+  // counted first, so queued never drops below the tasks in the queues
+  {
+    std::lock_guard<std::mutex> lock(sleeping);
+    queued.fetch_add(1);
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+    queues[queue]->tasks.push_back(task);
+  }
+  wake.notify_one();
+}
+
+bool ThreadPool::take(std::size_t self, Task & task){
+
+  // newest first from our own queue
+  {
+    Queue & queue = *queues[self];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(!queue.tasks.empty()){
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      queued.fetch_sub(1);
+      return true;
+    }
+  }
+
+  // oldest first from the others
+  for(std::size_t i = 1; i < queues.size(); ++i){
+    Queue & queue = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(!queue.tasks.empty()){
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      queued.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(std::size_t self, Task task){
+
+  Loop & loop = *task.loop;
+  while(task.end - task.begin > loop.grain){
+    std::size_t middle = task.begin + (task.end - task.begin) / 2;
+    push(self, Task{task.loop, middle, task.end});
+    task.end = middle;
+  }
+  (*loop.body)(task.begin, task.end);
+
+  // the loop may be destroyed as soon as remaining reaches 0
+  loop.remaining.fetch_sub(task.end - task.begin, std::memory_order_release);
+}
+
+void ThreadPool::work(std::size_t self){
+
+  owner = this;
+  ownerQueue = self;
+
+  while(true){
+    Task task;
+    if(take(self, task)){
+      run(self, task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleeping);
+    wake.wait(lock, [this]{ return stopping.load() || (queued.load() > 0); });
+    if(stopping.load() && (queued.load() == 0)){
+      return;
+    }
+  }
+}
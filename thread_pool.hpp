@@ -0,0 +1,103 @@
+/*! \file thread_pool.hpp
+Defines ThreadPool, the work-stealing pool pmap spreads its calls over.
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// system includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! \class ThreadPool
+\brief A fixed set of worker threads running the ranges of parallel loops.
+
+Every worker owns a deque of tasks. A task is a range of loop indices; a
+thread running a range longer than the grain splits off its upper half onto
+its own deque and keeps the lower half. Threads take their own tasks
+newest first, and when they run out steal the oldest, largest, task of
+another thread. The thread calling parallel_for runs tasks too until its
+loop is done, so loops may be nested and a pool without workers runs every
+loop on the calling thread.
+*/
+class ThreadPool {
+public:
+
+  /// the body of a loop, called with a half-open range of indices
+  typedef std::function<void(std::size_t begin, std::size_t end)> RangeBody;
+
+  /// start the given number of worker threads
+  explicit ThreadPool(std::size_t workers);
+
+  /// finish the queued tasks and join the workers
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  /// number of worker threads, not counting the callers of parallel_for
+  std::size_t workers() const noexcept;
+
+  /*! Call body on disjoint ranges covering [0, count), none longer than
+    grain, on the workers and the calling thread. Returns once every range
+    is done. body must not throw.
+   */
+  void parallel_for(std::size_t count, std::size_t grain, const RangeBody & body);
+
+  /// the pool shared by the interpreter, one worker per additional core
+  static ThreadPool & shared();
+
+private:
+
+  // one parallel_for in progress
+  struct Loop {
+    const RangeBody * body;
+    std::size_t grain;
+    // indices not yet run
+    std::atomic<std::size_t> remaining;
+  };
+
+  struct Task {
+    Loop * loop;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // a queue per worker, and a last one shared by the threads outside the pool
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  // tasks in all queues, incremented under sleeping before a push
+  std::atomic<std::size_t> queued;
+  std::atomic<bool> stopping;
+  std::mutex sleeping;
+  std::condition_variable wake;
+
+  // the queue the calling thread pushes to
+  std::size_t own_queue() const noexcept;
+
+  void push(std::size_t queue, const Task & task);
+
+  // take a task from queue self, or steal one from another queue
+  bool take(std::size_t self, Task & task);
+
+  // run a task, splitting off its upper halves onto queue self
+  void run(std::size_t self, Task task);
+
+  // the loop of worker thread self
+  void work(std::size_t self);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "test_programs.hpp"
+#include "thread_pool.hpp"
+
+TEST_CASE( "Test parallel loops", "[thread_pool]" ) {
+
+  for(std::size_t workers : {0, 1, 3}){
+    ThreadPool pool(workers);
+    REQUIRE(pool.workers() == workers);
+
+    INFO("every index is run exactly once, in ranges no longer than the grain");
+    std::vector<std::atomic<int>> runs(1000);
+    std::atomic<bool> tooLong(false);
+    pool.parallel_for(runs.size(), 7, [&](std::size_t begin, std::size_t end){
+	if(end - begin > 7){
+	  tooLong.store(true);
+	}
+	for(std::size_t i = begin; i < end; ++i){
+	  runs[i].fetch_add(1);
+	}
+      });
+    REQUIRE(!tooLong.load());
+    for(auto & r : runs){
+      REQUIRE(r.load() == 1);
+    }
+
+    INFO("loops nest, the waiting thread runs tasks");
+    std::atomic<std::size_t> sum(0);
+    pool.parallel_for(10, 1, [&](std::size_t begin, std::size_t end){
+	for(std::size_t i = begin; i < end; ++i){
+	  pool.parallel_for(100, 3, [&](std::size_t b, std::size_t e){
+	      for(std::size_t j = b; j < e; ++j){
+		sum.fetch_add(j);
+	      }
+	    });
+	}
+      });
+    REQUIRE(sum.load() == 10 * 4950);
+
+    pool.parallel_for(0, 1, [&](std::size_t, std::size_t){ tooLong.store(true); });
+    REQUIRE(!tooLong.load());
+  }
+}
+
+TEST_CASE( "Test shared environments", "[thread_pool]" ) {
+
+  Environment env;
+  {
+    Environment::Sharing sharing(env);
+    REQUIRE(env.is_proc(Atom("+")));
+    REQUIRE_THROWS_AS(env.add_exp(Atom("x"), Expression(1.)), SemanticError);
+    REQUIRE_THROWS_AS(env.reset(), SemanticError);
+  }
+  env.add_exp(Atom("x"), Expression(1.));
+  REQUIRE(env.get_exp(Atom("x")) == Expression(1.));
+}
+
+TEST_CASE( "Test pmap", "[thread_pool]" ) {
+
+  std::string define = "(define f (lambda (x) (begin (define y (* x x)) (+ y 1)))) ";
+
+  INFO("pmap gives the list map gives, in order");
+  REQUIRE(outcome("(begin " + define + "(pmap f (range 0 999 1)))") ==
+	  outcome("(begin " + define + "(map f (range 0 999 1)))"));
+  REQUIRE(outcome("(pmap sqrt (list -4 1 I))") == outcome("(map sqrt (list -4 1 I))"));
+  REQUIRE(outcome("(pmap sqrt (list))") == outcome("(map sqrt (list))"));
+  REQUIRE(outcome("(begin " + define + "(pmap f (list 1 2 3)))") == "((2) (5) (10))");
+
+  INFO("lambdas in a frame and nested pmaps");
+  REQUIRE(outcome("(begin (define h (lambda (n) (begin (define k (lambda (x) (+ x n))) (pmap k (range 0 99 1))))) (pmap h (range 0 99 1)))") ==
+	  outcome("(begin (define h (lambda (n) (begin (define k (lambda (x) (+ x n))) (map k (range 0 99 1))))) (map h (range 0 99 1)))"));
+
+  INFO("errors are the ones map throws, the first failing element wins");
+  std::string bad = "(define b (lambda (x) (if (< x 500) x (+ x \"a\")))) ";
+  REQUIRE(outcome("(begin " + bad + "(pmap b (range 0 999 1)))") ==
+	  outcome("(begin " + bad + "(map b (range 0 999 1)))"));
+  REQUIRE(outcome("(begin " + bad + "(pmap b (range 0 999 1)))").find("Error: during map: ") == 0);
+  REQUIRE(outcome("(pmap + (list 1 2 \"a\"))") == outcome("(map + (list 1 2 \"a\"))"));
+  REQUIRE(outcome("(pmap + 3)") == outcome("(map + 3)"));
+  REQUIRE(outcome("(pmap 3 (list 1 2))") == outcome("(map 3 (list 1 2))"));
+}
+
+TEST_CASE( "Test parallel plot sampling", "[thread_pool]" ) {
+
+  INFO("continuous-plot samples on the pool, with the errors of map");
+  std::string bad = "(define b (lambda (x) (if (< x 1) (sin (* 40 x)) (+ x \"a\")))) ";
+  REQUIRE(outcome("(begin " + bad + "(continuous-plot b (list -3 3)))") ==
+	  outcome("(begin " + bad + "(map b (range 1 3 1)))"));
+
+  INFO("the plot of a lambda in a frame is the plot of a global one");
+  REQUIRE(outcome("(begin (define h (lambda (n) (begin (define k (lambda (x) (sin (* n x)))) (continuous-plot k (list -3 3))))) (h 40))") ==
+	  outcome("(begin (define k (lambda (x) (sin (* 40 x)))) (continuous-plot k (list -3 3)))"));
+}
@@ -13,6 +13,8 @@ class ThreadSafeQueue
 public:
 	void push(const T & value);
 
+	void push(T && value);
+
 	bool empty() const;
 
 	bool try_pop(T & popped_value);
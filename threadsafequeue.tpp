@@ -9,6 +9,15 @@ void ThreadSafeQueue<T>::push(const T & value)
 	the_cond_var.notify_one();
 }
 
+template<typename T>
+void ThreadSafeQueue<T>::push(T && value)
+{
+	std::unique_lock<std::mutex> lock(the_mutex);
+	real_queue.push(std::move(value));
+	lock.unlock();
+	the_cond_var.notify_one();
+}
+
 template<typename T>
 bool ThreadSafeQueue<T>::empty() const
 {
@@ -25,7 +34,7 @@ bool ThreadSafeQueue<T>::try_pop(T & popped_value)
 		return false;
 	}
 
-	popped_value = real_queue.front();
+	popped_value = std::move(real_queue.front());
 	real_queue.pop();
 	return true;
 }
@@ -43,7 +52,7 @@ void ThreadSafeQueue<T>::wait_and_pop(T & popped_value)
 		the_cond_var.wait(lock);
 	}
 
-	popped_value = real_queue.front();
+	popped_value = std::move(real_queue.front());
 	real_queue.pop();
 }
 